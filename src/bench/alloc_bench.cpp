@@ -0,0 +1,162 @@
+// Counts heap allocations per frame once detection has warmed up. Without a
+// model it runs preprocessing, decode/NMS and the `yolo_detect_into` result
+// write on synthetic data and fails if any of them allocates. With a model it
+// also reports the allocations of a whole `yolo_handle_detect_into` call,
+// which include the inference engine's own.
+//
+//   yolo_alloc_bench [model] [frames]
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <vector>
+#include "postprocess.h"
+#include "preprocess.h"
+#include "yolo_ffi.h"
+#include "yolo_handle.h"
+
+static std::atomic<long> allocations{0};
+
+void* operator new(size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = malloc(size ? size : 1)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	return malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept {
+	return operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept {
+	free(p);
+}
+
+void operator delete[](void* p) noexcept {
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+	free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+	free(p);
+}
+
+static const int WIDTH = 1280;
+static const int HEIGHT = 720;
+static const int NUM_CHANNELS = 84;
+static const int NUM_ANCHORS = 8400;
+static const int WARMUP_FRAMES = 3;
+static const int CAPACITY = 300;
+
+// Background noise plus a few confident anchors, so NMS has work to do.
+static std::vector<float> synthetic_head() {
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> unit(0.f, 1.f);
+	std::vector<float> head(static_cast<size_t>(NUM_CHANNELS) * NUM_ANCHORS);
+	for (int i = 0; i < NUM_ANCHORS; ++i) {
+		head[0 * NUM_ANCHORS + i] = 640.f * unit(rng);
+		head[1 * NUM_ANCHORS + i] = 384.f * unit(rng);
+		head[2 * NUM_ANCHORS + i] = 4.f + 196.f * unit(rng);
+		head[3 * NUM_ANCHORS + i] = 4.f + 196.f * unit(rng);
+		for (int c = 4; c < NUM_CHANNELS; ++c) {
+			head[static_cast<size_t>(c) * NUM_ANCHORS + i] = 0.05f * unit(rng);
+		}
+		if (unit(rng) < 0.01f) {
+			int c = 4 + static_cast<int>(unit(rng) * (NUM_CHANNELS - 4));
+			head[static_cast<size_t>(c) * NUM_ANCHORS + i] = 0.3f + 0.7f * unit(rng);
+		}
+	}
+	return head;
+}
+
+// Runs `frame` WARMUP_FRAMES times, then returns the allocations of the next `frames` runs.
+template <typename F>
+static long count_allocations(int frames, F&& frame) {
+	for (int i = 0; i < WARMUP_FRAMES; ++i) {
+		frame();
+	}
+	long before = allocations.load();
+	for (int i = 0; i < frames; ++i) {
+		frame();
+	}
+	return allocations.load() - before;
+}
+
+int main(int argc, char** argv) {
+	const char* model_path = argc > 1 ? argv[1] : nullptr;
+	const int frames = argc > 2 ? std::max(atoi(argv[2]), 1) : 100;
+	const float conf_threshold = 0.25f;
+	const float nms_threshold = 0.45f;
+
+	std::mt19937 rng(42);
+	std::vector<uint8_t> rgba(static_cast<size_t>(WIDTH) * HEIGHT * 4);
+	std::vector<uint8_t> nv21(static_cast<size_t>(WIDTH) * HEIGHT * 3 / 2);
+	for (uint8_t& p : rgba) {
+		p = static_cast<uint8_t>(rng());
+	}
+	for (uint8_t& p : nv21) {
+		p = static_cast<uint8_t>(rng());
+	}
+	uint8_t* vu = nv21.data() + static_cast<size_t>(WIDTH) * HEIGHT;
+	FrameView rgba_view = make_rgba_view(rgba.data(), WIDTH, HEIGHT);
+	FrameView nv21_view = make_frame_view(NV21, nv21.data(), vu, nullptr, WIDTH, WIDTH, 0, 2, 2, WIDTH, HEIGHT);
+
+	InputGeometry geometry = letterbox_geometry(WIDTH, HEIGHT, 640, 32, false);
+	const size_t plane_size = static_cast<size_t>(geometry.input_w) * geometry.input_h;
+	std::vector<float> input(3 * plane_size);
+	std::vector<float> head = synthetic_head();
+	DetectSettings settings;
+	PostprocessScratch scratch;
+	std::vector<Detection> detections;
+	std::vector<float> out(static_cast<size_t>(CAPACITY) * 6);
+	int written = 0;
+
+	long preprocess_rgba = count_allocations(frames, [&] { preprocess_frame(rgba_view, false, geometry, input.data(), plane_size); });
+	long preprocess_nv21 = count_allocations(frames, [&] { preprocess_frame(nv21_view, true, letterbox_geometry(HEIGHT, WIDTH, 640, 32, false), input.data(), plane_size); });
+	long postprocess = count_allocations(frames, [&] {
+		postprocess_output(head.data(), NUM_CHANNELS, NUM_ANCHORS, geometry, conf_threshold, nms_threshold, settings, scratch, detections);
+		written = write_detections(detections, out.data(), CAPACITY);
+	});
+
+	printf("%d frames after %d warmup frames, %d detections\n", frames, WARMUP_FRAMES, written);
+	printf("preprocess RGBA : %ld allocations\n", preprocess_rgba);
+	printf("preprocess NV21 : %ld allocations\n", preprocess_nv21);
+	printf("decode/NMS/write: %ld allocations\n", postprocess);
+	const bool steady = preprocess_rgba == 0 && preprocess_nv21 == 0 && postprocess == 0;
+
+	if (model_path) {
+		yolo_handle_t handle = yolo_create(model_path);
+		if (!handle) {
+			fprintf(stderr, "failed to load %s\n", model_path);
+			return 1;
+		}
+		yolo_handle_set_resize_mode(handle, RESIZE_LETTERBOX);
+		long detect = count_allocations(frames, [&] { written = yolo_handle_detect_into(handle, rgba.data(), HEIGHT, WIDTH, conf_threshold, nms_threshold, out.data(), CAPACITY); });
+		long detect_yuv = count_allocations(frames, [&] { written = yolo_handle_detect_yuv_into(handle, NV21, nv21.data(), vu, nullptr, WIDTH, WIDTH, 0, 2, 2, WIDTH, HEIGHT, true, conf_threshold, nms_threshold, out.data(), CAPACITY); });
+		// Only the engine allocates here, through its own allocators or operator new.
+		printf("yolo_handle_detect_into    : %.2f allocations/frame\n", static_cast<double>(detect) / frames);
+		printf("yolo_handle_detect_yuv_into: %.2f allocations/frame\n", static_cast<double>(detect_yuv) / frames);
+		yolo_destroy(handle);
+	}
+
+	if (!steady) {
+		fprintf(stderr, "FAILED: the detection path allocated after warmup\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,76 @@
+// Throughput of yolo_handle_detect_batch against one yolo_handle_detect call
+// per frame, on synthetic RGBA frames. Needs a real model.
+//
+//   yolo_batch_bench <model> [frames] [batch_size] [width] [height]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "yolo_ffi.h"
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <model> [frames] [batch_size] [width] [height]\n", argv[0]);
+		return 2;
+	}
+	const char* model_path = argv[1];
+	const int frames = argc > 2 ? atoi(argv[2]) : 64;
+	const int batch_size = argc > 3 ? atoi(argv[3]) : 8;
+	const int width = argc > 4 ? atoi(argv[4]) : 1280;
+	const int height = argc > 5 ? atoi(argv[5]) : 720;
+	const float conf_threshold = 0.25f;
+	const float nms_threshold = 0.45f;
+
+	yolo_handle_t handle = yolo_create(model_path);
+	if (!handle) {
+		fprintf(stderr, "failed to load %s\n", model_path);
+		return 1;
+	}
+	yolo_handle_set_batch_size(handle, batch_size);
+
+	// Noise is enough to exercise the whole pipeline at a realistic resolution.
+	std::mt19937 rng(42);
+	std::vector<std::vector<uint8_t>> pixels(frames, std::vector<uint8_t>(static_cast<size_t>(width) * height * 4));
+	std::vector<uint8_t*> images(frames);
+	std::vector<int> heights(frames, height);
+	std::vector<int> widths(frames, width);
+	for (int i = 0; i < frames; ++i) {
+		for (uint8_t& p : pixels[i]) {
+			p = static_cast<uint8_t>(rng());
+		}
+		images[i] = pixels[i].data();
+	}
+	std::vector<DetectionResult> results(frames);
+
+	using namespace std::chrono;
+	// Warm up the allocator and the session before timing anything.
+	free_result(yolo_handle_detect(handle, images[0], height, width, conf_threshold, nms_threshold));
+
+	auto tic = steady_clock::now();
+	for (int i = 0; i < frames; ++i) {
+		results[i] = yolo_handle_detect(handle, images[i], height, width, conf_threshold, nms_threshold);
+	}
+	double sequential_s = duration<double>(steady_clock::now() - tic).count();
+	int sequential_boxes = 0;
+	for (DetectionResult& result : results) {
+		sequential_boxes += result.count;
+		free_result(result);
+	}
+
+	tic = steady_clock::now();
+	int processed = yolo_handle_detect_batch(handle, images.data(), heights.data(), widths.data(), frames, conf_threshold, nms_threshold, results.data());
+	double batch_s = duration<double>(steady_clock::now() - tic).count();
+	int batch_boxes = 0;
+	for (DetectionResult& result : results) {
+		batch_boxes += result.count;
+		free_result(result);
+	}
+
+	yolo_destroy(handle);
+
+	printf("{\"frames\": %d, \"batch_size\": %d, \"width\": %d, \"height\": %d,\n", frames, batch_size, width, height);
+	printf(" \"sequential_fps\": %.2f, \"batch_fps\": %.2f, \"speedup\": %.2f,\n", frames / sequential_s, processed / batch_s, sequential_s / batch_s);
+	printf(" \"sequential_boxes\": %d, \"batch_boxes\": %d}\n", sequential_boxes, batch_boxes);
+	return processed == frames ? 0 : 1;
+}
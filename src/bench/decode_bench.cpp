@@ -0,0 +1,137 @@
+// Microbenchmark of the YOLO output decoder against the per-anchor scalar
+// loop it replaced, and of the end-to-end decoder on the [300, 6] head of
+// NMS-free models. Runs on synthetic heads, no model needed.
+//
+//   yolo_decode_bench [iterations] [conf_threshold]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "yolo_decode.h"
+
+static const int NUM_CHANNELS = 84;
+static const int NUM_ANCHORS = 8400;
+static const int END_TO_END_ROWS = 300;
+
+// The original loop from run_ncnn/run_inference, kept as the reference.
+static void decode_reference(const float* raw_output, int num_classes, int num_detections, float conf_threshold, Candidates& candidates) {
+	candidates.clear();
+	for (int i = 0; i < num_detections; ++i) {
+		const float* detection = raw_output + i;
+		const float* class_scores = detection + 4 * num_detections;
+
+		int class_id = -1;
+		float max_score = 0.0f;
+		for (int j = 0; j < num_classes - 4; ++j) {
+			int idx = j * num_detections;
+			if (class_scores[idx] > max_score) {
+				max_score = class_scores[idx];
+				class_id = j;
+			}
+		}
+
+		if (max_score > conf_threshold) {
+			float cx = detection[0 * num_detections];
+			float cy = detection[1 * num_detections];
+			float w = detection[2 * num_detections];
+			float h = detection[3 * num_detections];
+			candidates.push_back(cx - 0.5f * w, cy - 0.5f * h, cx + 0.5f * w, cy + 0.5f * h, max_score, class_id, i);
+		}
+	}
+}
+
+// Mostly background with a few confident anchors, like a real frame.
+static std::vector<float> synthetic_head(unsigned seed) {
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> coord(0.f, 640.f);
+	std::uniform_real_distribution<float> size(4.f, 200.f);
+	std::exponential_distribution<float> background(60.f);
+	std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+	std::vector<float> head(static_cast<size_t>(NUM_CHANNELS) * NUM_ANCHORS);
+	for (int i = 0; i < NUM_ANCHORS; ++i) {
+		head[0 * NUM_ANCHORS + i] = coord(rng);
+		head[1 * NUM_ANCHORS + i] = coord(rng);
+		head[2 * NUM_ANCHORS + i] = size(rng);
+		head[3 * NUM_ANCHORS + i] = size(rng);
+		for (int c = 4; c < NUM_CHANNELS; ++c) {
+			head[static_cast<size_t>(c) * NUM_ANCHORS + i] = std::min(background(rng), 1.f);
+		}
+		if (unit(rng) < 0.01f) {
+			int c = 4 + static_cast<int>(unit(rng) * (NUM_CHANNELS - 4));
+			head[static_cast<size_t>(c) * NUM_ANCHORS + i] = 0.3f + 0.7f * unit(rng);
+		}
+	}
+	return head;
+}
+
+// Top-k rows of an end-to-end head, best first, the tail padded with low scores.
+static std::vector<float> synthetic_end_to_end(unsigned seed) {
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> coord(0.f, 440.f);
+	std::uniform_real_distribution<float> size(4.f, 200.f);
+	std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+	std::vector<float> head(static_cast<size_t>(END_TO_END_ROWS) * END_TO_END_ROW);
+	for (int r = 0; r < END_TO_END_ROWS; ++r) {
+		float* row = head.data() + static_cast<size_t>(r) * END_TO_END_ROW;
+		row[0] = coord(rng);
+		row[1] = coord(rng);
+		row[2] = row[0] + size(rng);
+		row[3] = row[1] + size(rng);
+		row[4] = r < 20 ? 0.9f - 0.03f * r : 0.02f * unit(rng);
+		row[5] = static_cast<float>(static_cast<int>(unit(rng) * (NUM_CHANNELS - 4)));
+	}
+	return head;
+}
+
+template <typename F>
+static double time_us(int iterations, F&& run) {
+	using namespace std::chrono;
+	run();  // warm up caches and the candidate buffers
+	auto tic = steady_clock::now();
+	for (int i = 0; i < iterations; ++i) {
+		run();
+	}
+	auto toc = steady_clock::now();
+	return duration<double, std::micro>(toc - tic).count() / iterations;
+}
+
+int main(int argc, char** argv) {
+	const int iterations = argc > 1 ? atoi(argv[1]) : 200;
+	const float conf_threshold = argc > 2 ? static_cast<float>(atof(argv[2])) : 0.25f;
+
+	std::vector<float> head = synthetic_head(42);
+	const InputGeometry geometry = stretch_geometry(640, 640);
+	const std::vector<float> no_filter;
+	// Keep only the first 10 classes, with a stricter threshold for class 0.
+	std::vector<float> subset(NUM_CHANNELS - 4, -1.f);
+	for (int c = 0; c < 10; ++c) {
+		subset[c] = 0.f;
+	}
+	subset[0] = 0.5f;
+
+	Candidates reference;
+	Candidates decoded;
+	Candidates filtered;
+	Candidates end_to_end;
+	std::vector<float> end_to_end_head = synthetic_end_to_end(42);
+
+	double reference_us = time_us(iterations, [&] { decode_reference(head.data(), NUM_CHANNELS, NUM_ANCHORS, conf_threshold, reference); });
+	double decoded_us = time_us(iterations, [&] { decode_yolo(head.data(), NUM_CHANNELS, NUM_ANCHORS, conf_threshold, no_filter, geometry, decoded); });
+	double filtered_us = time_us(iterations, [&] { decode_yolo(head.data(), NUM_CHANNELS, NUM_ANCHORS, conf_threshold, subset, geometry, filtered); });
+	double end_to_end_us = time_us(iterations, [&] { decode_end_to_end(end_to_end_head.data(), END_TO_END_ROWS, END_TO_END_ROW, conf_threshold, no_filter, geometry, end_to_end); });
+
+	bool same = reference.size() == decoded.size();
+	for (size_t i = 0; same && i < reference.size(); ++i) {
+		same = reference.class_ids[i] == decoded.class_ids[i] && reference.scores[i] == decoded.scores[i] && reference.x1[i] == decoded.x1[i];
+	}
+
+	printf("{\"anchors\": %d, \"classes\": %d, \"conf_threshold\": %.2f, \"iterations\": %d,\n", NUM_ANCHORS, NUM_CHANNELS - 4, conf_threshold, iterations);
+	printf(" \"reference_us\": %.1f, \"decode_us\": %.1f, \"decode_subset_us\": %.1f, \"speedup\": %.2f,\n", reference_us, decoded_us, filtered_us, reference_us / decoded_us);
+	printf(" \"end_to_end_us\": %.2f, \"end_to_end_candidates\": %zu,\n", end_to_end_us, end_to_end.size());
+	printf(" \"candidates\": %zu, \"subset_candidates\": %zu, \"matches_reference\": %s}\n", decoded.size(), filtered.size(), same ? "true" : "false");
+	return same ? 0 : 1;
+}
@@ -0,0 +1,222 @@
+// Compares an int8 ncnn model with its float original on the same frames:
+// latency of fp32, bf16 and int8 inference, and how closely the bf16 and int8
+// detections match the fp32 ones. Prints JSON on stdout.
+//
+//   yolo_int8_bench <float model> <int8 model> [--frames 50] [--threads 0]
+//                   [--input recording.rgba --size 1280x720]
+//
+// Detections on noise frames say little about accuracy, pass a recording of
+// raw RGBA frames of the given size for a meaningful comparison.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "yolo_ffi.h"
+
+static const int CAPACITY = 300;
+static const float CONF_THRESHOLD = 0.25f;
+static const float NMS_THRESHOLD = 0.45f;
+// Detections of the same class overlapping this much count as the same object.
+static const float MATCH_IOU = 0.5f;
+
+struct Box {
+	float x1, y1, x2, y2;
+	int class_id;
+	float confidence;
+};
+
+struct Variant {
+	const char* name;
+	const char* model_path;
+	yolo_options options;
+	double load_ms;
+	std::vector<double> times;
+	// Detections per frame.
+	std::vector<std::vector<Box>> frames;
+};
+
+static float box_iou(const Box& a, const Box& b) {
+	const float w = std::min(a.x2, b.x2) - std::max(a.x1, b.x1);
+	const float h = std::min(a.y2, b.y2) - std::max(a.y1, b.y1);
+	if (w <= 0 || h <= 0) {
+		return 0.f;
+	}
+	const float inter = w * h;
+	return inter / ((a.x2 - a.x1) * (a.y2 - a.y1) + (b.x2 - b.x1) * (b.y2 - b.y1) - inter);
+}
+
+static double percentile(std::vector<double> times, double p) {
+	if (times.empty()) {
+		return 0;
+	}
+	std::sort(times.begin(), times.end());
+	size_t rank = static_cast<size_t>(p / 100.0 * (times.size() - 1) + 0.5);
+	return times[std::min(rank, times.size() - 1)];
+}
+
+static bool run_variant(Variant& variant, const std::vector<std::vector<uint8_t>>& frames, int width, int height) {
+	using namespace std::chrono;
+	auto tic = steady_clock::now();
+	yolo_handle_t handle = yolo_create_with_options(variant.model_path, &variant.options);
+	variant.load_ms = duration<double, std::milli>(steady_clock::now() - tic).count();
+	if (!handle) {
+		fprintf(stderr, "failed to load %s\n", variant.model_path);
+		return false;
+	}
+
+	std::vector<float> out(CAPACITY * 6);
+	// One untimed frame, the first inference sets up the engine's buffers.
+	yolo_handle_detect_into(handle, const_cast<uint8_t*>(frames[0].data()), height, width, CONF_THRESHOLD, NMS_THRESHOLD, out.data(), CAPACITY);
+	for (const std::vector<uint8_t>& frame : frames) {
+		auto start = steady_clock::now();
+		int count = yolo_handle_detect_into(handle, const_cast<uint8_t*>(frame.data()), height, width, CONF_THRESHOLD, NMS_THRESHOLD, out.data(), CAPACITY);
+		variant.times.push_back(duration<double, std::milli>(steady_clock::now() - start).count());
+
+		std::vector<Box> boxes(count);
+		for (int i = 0; i < count; ++i) {
+			const float* d = &out[i * 6];
+			boxes[i] = {d[0], d[1], d[2], d[3], static_cast<int>(d[4]), d[5]};
+		}
+		variant.frames.push_back(boxes);
+	}
+	yolo_destroy(handle);
+	return true;
+}
+
+// Greedy same-class matching of `boxes` against the `reference` detections,
+// best overlaps first.
+static void compare(const std::vector<Box>& reference, const std::vector<Box>& boxes, long& matched, double& iou_sum, double& confidence_delta_sum) {
+	std::vector<bool> used(boxes.size(), false);
+	for (const Box& ref : reference) {
+		int best = -1;
+		float best_iou = MATCH_IOU;
+		for (size_t i = 0; i < boxes.size(); ++i) {
+			if (used[i] || boxes[i].class_id != ref.class_id) {
+				continue;
+			}
+			float iou = box_iou(ref, boxes[i]);
+			if (iou >= best_iou) {
+				best = static_cast<int>(i);
+				best_iou = iou;
+			}
+		}
+		if (best >= 0) {
+			used[best] = true;
+			++matched;
+			iou_sum += best_iou;
+			confidence_delta_sum += std::abs(boxes[best].confidence - ref.confidence);
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s <float model> <int8 model> [--frames N] [--threads N] [--input file --size WxH]\n", argv[0]);
+		return 2;
+	}
+	const char* float_model = argv[1];
+	const char* int8_model = argv[2];
+	int frame_count = 50;
+	int threads = 0;
+	int width = 1280;
+	int height = 720;
+	const char* input_path = nullptr;
+	for (int i = 3; i + 1 < argc; i += 2) {
+		const char* flag = argv[i];
+		const char* value = argv[i + 1];
+		if (!strcmp(flag, "--frames")) {
+			frame_count = std::max(atoi(value), 1);
+		} else if (!strcmp(flag, "--threads")) {
+			threads = atoi(value);
+		} else if (!strcmp(flag, "--input")) {
+			input_path = value;
+		} else if (!strcmp(flag, "--size")) {
+			if (sscanf(value, "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+				fprintf(stderr, "bad size %s\n", value);
+				return 2;
+			}
+		} else {
+			fprintf(stderr, "unknown option %s\n", flag);
+			return 2;
+		}
+	}
+
+	const size_t bytes = static_cast<size_t>(width) * height * 4;
+	std::vector<std::vector<uint8_t>> frames;
+	if (input_path) {
+		FILE* file = fopen(input_path, "rb");
+		if (!file) {
+			fprintf(stderr, "cannot open %s\n", input_path);
+			return 1;
+		}
+		std::vector<uint8_t> frame(bytes);
+		while (static_cast<int>(frames.size()) < frame_count && fread(frame.data(), 1, bytes, file) == bytes) {
+			frames.push_back(frame);
+		}
+		fclose(file);
+	} else {
+		std::mt19937 rng(42);
+		frames.resize(frame_count, std::vector<uint8_t>(bytes));
+		for (std::vector<uint8_t>& frame : frames) {
+			for (uint8_t& p : frame) {
+				p = static_cast<uint8_t>(rng());
+			}
+		}
+	}
+	if (frames.empty()) {
+		fprintf(stderr, "%s holds no complete %dx%d RGBA frame\n", input_path, width, height);
+		return 1;
+	}
+
+	// fp16 stays off everywhere so only the storage type differs.
+	yolo_options fp32 = yolo_default_options();
+	fp32.num_threads = threads;
+	fp32.use_fp16 = false;
+	fp32.use_bf16 = false;
+	fp32.use_int8 = false;
+	yolo_options bf16 = fp32;
+	bf16.use_bf16 = true;
+	yolo_options int8 = fp32;
+	int8.use_int8 = true;
+	std::vector<Variant> variants = {
+	    {"fp32", float_model, fp32, 0, {}, {}},
+	    {"bf16", float_model, bf16, 0, {}, {}},
+	    {"int8", int8_model, int8, 0, {}, {}},
+	};
+	for (Variant& variant : variants) {
+		if (!run_variant(variant, frames, width, height)) {
+			return 1;
+		}
+	}
+
+	printf("{\n  \"frames\": %zu,\n  \"width\": %d,\n  \"height\": %d,\n  \"variants\": [\n", frames.size(), width, height);
+	const Variant& reference = variants[0];
+	for (size_t v = 0; v < variants.size(); ++v) {
+		const Variant& variant = variants[v];
+		long reference_count = 0;
+		long count = 0;
+		long matched = 0;
+		double iou_sum = 0;
+		double confidence_delta_sum = 0;
+		for (size_t f = 0; f < frames.size(); ++f) {
+			reference_count += reference.frames[f].size();
+			count += variant.frames[f].size();
+			compare(reference.frames[f], variant.frames[f], matched, iou_sum, confidence_delta_sum);
+		}
+		double mean = 0;
+		for (double time : variant.times) {
+			mean += time;
+		}
+		mean /= variant.times.size();
+
+		printf("    {\"name\": \"%s\", \"model\": \"%s\", \"load_ms\": %.1f, \"p50_ms\": %.3f, \"p95_ms\": %.3f, \"mean_ms\": %.3f, \"speedup_vs_fp32\": %.2f,\n", variant.name, variant.model_path, variant.load_ms, percentile(variant.times, 50), percentile(variant.times, 95), mean, percentile(reference.times, 50) / std::max(percentile(variant.times, 50), 1e-9));
+		// Agreement with the fp32 detections, which stand in for ground truth.
+		printf("     \"detections_per_frame\": %.2f, \"recall_vs_fp32\": %.4f, \"precision_vs_fp32\": %.4f, \"mean_iou\": %.4f, \"mean_confidence_delta\": %.4f}%s\n", static_cast<double>(count) / frames.size(), reference_count ? static_cast<double>(matched) / reference_count : 1.0, count ? static_cast<double>(matched) / count : 1.0, matched ? iou_sum / matched : 0.0, matched ? confidence_delta_sum / matched : 0.0, v + 1 < variants.size() ? "," : "");
+	}
+	printf("  ]\n}\n");
+	return 0;
+}
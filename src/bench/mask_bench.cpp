@@ -0,0 +1,149 @@
+// Microbenchmark of the box-restricted mask decoder against the naive path:
+// every prototype pixel combined for every detection and the whole plane
+// upsampled to the frame before cropping to the box. Runs on synthetic
+// [32, 160, 160] prototypes, no model needed.
+//
+//   yolo_mask_bench [iterations] [detections]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "yolo_mask.h"
+
+static const int NUM_MASKS = 32;
+static const int PROTO_SIZE = 160;
+static const int FRAME_W = 1280;
+static const int FRAME_H = 720;
+
+// Full 160x160 logits, bilinear upsampling of the whole content to the frame,
+// then the box crop.
+static void decode_reference(const MaskPrototypes& protos, const float* coefficients, const InputGeometry& geometry, Detection& detection, std::vector<float>& logits) {
+	logits.assign(static_cast<size_t>(protos.width) * protos.height, 0.f);
+	for (int k = 0; k < protos.count; ++k) {
+		const float* plane = protos.data + k * protos.plane_stride;
+		for (size_t i = 0; i < logits.size(); ++i) {
+			logits[i] += coefficients[k] * plane[i];
+		}
+	}
+	const float scale_x = static_cast<float>(protos.width) / geometry.input_w;
+	const float scale_y = static_cast<float>(protos.height) / geometry.input_h;
+	std::vector<uint8_t> frame(static_cast<size_t>(FRAME_W) * FRAME_H);
+	for (int y = 0; y < FRAME_H; ++y) {
+		float py = ((y + 0.5f) / geometry.box_scale_y + geometry.content_y) * scale_y - 0.5f;
+		py = std::min(std::max(py, 0.f), static_cast<float>(protos.height - 1));
+		const int y0 = std::min(static_cast<int>(py), protos.height - 2);
+		const float fy = py - y0;
+		for (int x = 0; x < FRAME_W; ++x) {
+			float px = ((x + 0.5f) / geometry.box_scale_x + geometry.content_x) * scale_x - 0.5f;
+			px = std::min(std::max(px, 0.f), static_cast<float>(protos.width - 1));
+			const int x0 = std::min(static_cast<int>(px), protos.width - 2);
+			const float fx = px - x0;
+			const float* top = logits.data() + static_cast<size_t>(y0) * protos.width + x0;
+			const float* bottom = top + protos.width;
+			const float upper = top[0] + fx * (top[1] - top[0]);
+			const float lower = bottom[0] + fx * (bottom[1] - bottom[0]);
+			frame[static_cast<size_t>(y) * FRAME_W + x] = upper + fy * (lower - upper) > 0.f;
+		}
+	}
+	const int left = std::max(0, static_cast<int>(std::floor(detection.box.x)));
+	const int top = std::max(0, static_cast<int>(std::floor(detection.box.y)));
+	const int right = std::min(FRAME_W, static_cast<int>(std::ceil(detection.box.x + detection.box.width)));
+	const int bottom = std::min(FRAME_H, static_cast<int>(std::ceil(detection.box.y + detection.box.height)));
+	const cv::Rect rect(left, top, right - left, bottom - top);
+	const size_t row_bytes = (rect.width + 7) / 8;
+	detection.mask_rect = rect;
+	detection.mask.assign(row_bytes * rect.height, 0);
+	for (int y = 0; y < rect.height; ++y) {
+		for (int x = 0; x < rect.width; ++x) {
+			if (frame[static_cast<size_t>(rect.y + y) * FRAME_W + rect.x + x]) {
+				detection.mask[y * row_bytes + x / 8] |= static_cast<uint8_t>(1u << (x % 8));
+			}
+		}
+	}
+}
+
+template <typename F>
+static double time_us(int iterations, F&& run) {
+	using namespace std::chrono;
+	run();  // warm up caches and the mask buffers
+	auto tic = steady_clock::now();
+	for (int i = 0; i < iterations; ++i) {
+		run();
+	}
+	auto toc = steady_clock::now();
+	return duration<double, std::micro>(toc - tic).count() / iterations;
+}
+
+int main(int argc, char** argv) {
+	const int iterations = argc > 1 ? atoi(argv[1]) : 20;
+	const int count = argc > 2 ? atoi(argv[2]) : 10;
+
+	std::mt19937 rng(42);
+	std::normal_distribution<float> value(0.f, 1.f);
+	std::uniform_real_distribution<float> unit(0.f, 1.f);
+	std::vector<float> planes(static_cast<size_t>(NUM_MASKS) * PROTO_SIZE * PROTO_SIZE);
+	for (float& v : planes) {
+		v = value(rng);
+	}
+	MaskPrototypes protos;
+	protos.data = planes.data();
+	protos.count = NUM_MASKS;
+	protos.width = PROTO_SIZE;
+	protos.height = PROTO_SIZE;
+	protos.plane_stride = static_cast<size_t>(PROTO_SIZE) * PROTO_SIZE;
+
+	// A 16:9 frame letterboxed into the square 640 input.
+	const InputGeometry geometry = letterbox_geometry(FRAME_W, FRAME_H, 640, 32, true);
+	std::vector<Detection> detections(count);
+	std::vector<float> coefficients(static_cast<size_t>(count) * NUM_MASKS);
+	for (int i = 0; i < count; ++i) {
+		const float w = 40.f + 300.f * unit(rng);
+		const float h = 40.f + 300.f * unit(rng);
+		detections[i].box = cv::Rect2f(unit(rng) * (FRAME_W - w), unit(rng) * (FRAME_H - h), w, h);
+		for (int k = 0; k < NUM_MASKS; ++k) {
+			coefficients[static_cast<size_t>(i) * NUM_MASKS + k] = value(rng);
+		}
+	}
+	std::vector<Detection> reference = detections;
+
+	MaskScratch scratch;
+	std::vector<float> logits;
+	double roi_us = time_us(iterations, [&] {
+		for (int i = 0; i < count; ++i) {
+			decode_mask(protos, coefficients.data() + static_cast<size_t>(i) * NUM_MASKS, 1, geometry, detections[i], scratch);
+		}
+	});
+	double reference_us = time_us(iterations, [&] {
+		for (int i = 0; i < count; ++i) {
+			decode_reference(protos, coefficients.data() + static_cast<size_t>(i) * NUM_MASKS, geometry, reference[i], logits);
+		}
+	});
+
+	// Both paths sample the same bilinear surface, only float rounding differs.
+	long pixels = 0;
+	long differing = 0;
+	for (int i = 0; i < count; ++i) {
+		const Detection& a = detections[i];
+		const Detection& b = reference[i];
+		if (a.mask_rect.x != b.mask_rect.x || a.mask_rect.y != b.mask_rect.y || a.mask_rect.width != b.mask_rect.width || a.mask_rect.height != b.mask_rect.height) {
+			differing += static_cast<long>(b.mask_rect.area());
+			continue;
+		}
+		const size_t row_bytes = (a.mask_rect.width + 7) / 8;
+		for (int y = 0; y < a.mask_rect.height; ++y) {
+			for (int x = 0; x < a.mask_rect.width; ++x) {
+				const size_t byte = y * row_bytes + x / 8;
+				differing += (a.mask[byte] ^ b.mask[byte]) >> (x % 8) & 1;
+			}
+		}
+		pixels += a.mask_rect.area();
+	}
+	const double agreement = pixels > 0 ? 1.0 - static_cast<double>(differing) / pixels : 0.0;
+
+	printf("{\"detections\": %d, \"frame\": \"%dx%d\", \"prototypes\": \"%dx%dx%d\", \"iterations\": %d,\n", count, FRAME_W, FRAME_H, NUM_MASKS, PROTO_SIZE, PROTO_SIZE, iterations);
+	printf(" \"reference_us\": %.1f, \"roi_us\": %.1f, \"speedup\": %.1f, \"pixel_agreement\": %.5f}\n", reference_us, roi_us, reference_us / roi_us, agreement);
+	return agreement > 0.999 ? 0 : 1;
+}
@@ -0,0 +1,295 @@
+// End-to-end latency of the public API across resolutions, input formats,
+// thread counts and thresholds. Every combination loads the model with
+// `load_model_with_options`, converts camera formats with `convert_image` and
+// detects with `yolo_detect`. Prints p50/p95/p99 and throughput per stage as
+// JSON on stdout, library logs go to stderr. The stages inside detection,
+// preprocess, inference, decode and nms, come from the record `yolo_get_stats`
+// keeps of each frame, which covers the last YOLO_STATS_RECORDS frames of a run.
+//
+//   yolo_bench <model> [--sizes 640x480,1280x720] [--formats rgba,nv21,yuv420,bgra]
+//              [--threads 0,1,4] [--conf 0.25] [--nms 0.45]
+//              [--frames 100] [--warmup 5] [--input recording.raw]
+//
+// Frames are noise unless --input names a file of raw frames in the format and
+// size being measured, e.g. NV21 dumped from a camera, which then needs a
+// single size and format.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include "yolo_ffi.h"
+
+struct Size {
+	int width;
+	int height;
+};
+
+struct Format {
+	const char* name;
+	ImageFormat format;
+	// Whether the frame needs convert_image before yolo_detect.
+	bool camera;
+};
+
+static const Format FORMATS[] = {
+    {"rgba", BGRA8888, false},
+    {"bgra", BGRA8888, true},
+    {"nv21", NV21, true},
+    {"yuv420", YUV420, true},
+};
+
+// Latencies of one stage in milliseconds.
+struct Stage {
+	const char* name;
+	std::vector<double> times;
+};
+
+// Stages inside yolo_detect, in the order they are printed.
+static const struct {
+	const char* name;
+	YoloStage stage;
+} INNER_STAGES[] = {
+    {"preprocess", YOLO_STAGE_PREPROCESS},
+    {"inference", YOLO_STAGE_INFERENCE},
+    {"decode", YOLO_STAGE_DECODE},
+    {"nms", YOLO_STAGE_NMS},
+};
+
+static std::vector<std::string> split(const char* list) {
+	std::vector<std::string> items;
+	std::string item;
+	for (const char* c = list; *c; ++c) {
+		if (*c == ',') {
+			items.push_back(item);
+			item.clear();
+		} else {
+			item += *c;
+		}
+	}
+	items.push_back(item);
+	return items;
+}
+
+static size_t frame_bytes(const Format& format, const Size& size) {
+	const size_t pixels = static_cast<size_t>(size.width) * size.height;
+	return format.format == BGRA8888 ? pixels * 4 : pixels * 3 / 2;
+}
+
+// Loads `frame_count` frames of `bytes` each, cycling through a recording if
+// there is one, else a few distinct noise frames.
+static std::vector<std::vector<uint8_t>> load_frames(const char* input_path, size_t bytes, int frame_count) {
+	std::vector<std::vector<uint8_t>> frames;
+	if (input_path) {
+		FILE* file = fopen(input_path, "rb");
+		if (!file) {
+			fprintf(stderr, "cannot open %s\n", input_path);
+			return frames;
+		}
+		std::vector<uint8_t> frame(bytes);
+		while (static_cast<int>(frames.size()) < frame_count && fread(frame.data(), 1, bytes, file) == bytes) {
+			frames.push_back(frame);
+		}
+		fclose(file);
+		if (frames.empty()) {
+			fprintf(stderr, "%s holds no complete frame of %zu bytes\n", input_path, bytes);
+		}
+		return frames;
+	}
+
+	std::mt19937 rng(42);
+	frames.resize(std::min(frame_count, 4), std::vector<uint8_t>(bytes));
+	for (std::vector<uint8_t>& frame : frames) {
+		for (uint8_t& p : frame) {
+			p = static_cast<uint8_t>(rng());
+		}
+	}
+	return frames;
+}
+
+static double percentile(std::vector<double> times, double p) {
+	if (times.empty()) {
+		return 0;
+	}
+	std::sort(times.begin(), times.end());
+	size_t rank = static_cast<size_t>(p / 100.0 * (times.size() - 1) + 0.5);
+	return times[std::min(rank, times.size() - 1)];
+}
+
+static void print_stage(const Stage& stage, bool last) {
+	double sum = 0;
+	for (double time : stage.times) {
+		sum += time;
+	}
+	double mean = stage.times.empty() ? 0 : sum / stage.times.size();
+	printf("        \"%s\": {\"p50_ms\": %.3f, \"p95_ms\": %.3f, \"p99_ms\": %.3f, \"mean_ms\": %.3f, \"fps\": %.1f}%s\n", stage.name, percentile(stage.times, 50), percentile(stage.times, 95), percentile(stage.times, 99), mean, mean > 0 ? 1000.0 / mean : 0.0, last ? "" : ",");
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <model> [--sizes WxH,...] [--formats rgba,bgra,nv21,yuv420] [--threads N,...] [--conf T,...] [--nms T,...] [--frames N] [--warmup N] [--input file]\n", argv[0]);
+		return 2;
+	}
+	const char* model_path = argv[1];
+	std::vector<std::string> size_args = {"1280x720"};
+	std::vector<std::string> format_args = {"rgba"};
+	std::vector<std::string> thread_args = {"0"};
+	std::vector<std::string> conf_args = {"0.25"};
+	std::vector<std::string> nms_args = {"0.45"};
+	int frame_count = 100;
+	int warmup = 5;
+	const char* input_path = nullptr;
+	for (int i = 2; i + 1 < argc; i += 2) {
+		const char* flag = argv[i];
+		const char* value = argv[i + 1];
+		if (!strcmp(flag, "--sizes")) {
+			size_args = split(value);
+		} else if (!strcmp(flag, "--formats")) {
+			format_args = split(value);
+		} else if (!strcmp(flag, "--threads")) {
+			thread_args = split(value);
+		} else if (!strcmp(flag, "--conf")) {
+			conf_args = split(value);
+		} else if (!strcmp(flag, "--nms")) {
+			nms_args = split(value);
+		} else if (!strcmp(flag, "--frames")) {
+			frame_count = std::max(atoi(value), 1);
+		} else if (!strcmp(flag, "--warmup")) {
+			warmup = std::max(atoi(value), 0);
+		} else if (!strcmp(flag, "--input")) {
+			input_path = value;
+		} else {
+			fprintf(stderr, "unknown option %s\n", flag);
+			return 2;
+		}
+	}
+
+	std::vector<Size> sizes;
+	for (const std::string& arg : size_args) {
+		Size size{};
+		if (sscanf(arg.c_str(), "%dx%d", &size.width, &size.height) != 2 || size.width <= 0 || size.height <= 0) {
+			fprintf(stderr, "bad size %s\n", arg.c_str());
+			return 2;
+		}
+		sizes.push_back(size);
+	}
+	std::vector<Format> formats;
+	for (const std::string& arg : format_args) {
+		auto it = std::find_if(std::begin(FORMATS), std::end(FORMATS), [&](const Format& format) { return arg == format.name; });
+		if (it == std::end(FORMATS)) {
+			fprintf(stderr, "bad format %s\n", arg.c_str());
+			return 2;
+		}
+		formats.push_back(*it);
+	}
+	if (input_path && (sizes.size() > 1 || formats.size() > 1)) {
+		fprintf(stderr, "--input needs a single size and format\n");
+		return 2;
+	}
+
+	// load_model reports no error, so make sure the model loads before sweeping.
+	yolo_handle_t probe = yolo_create(model_path);
+	if (!probe) {
+		fprintf(stderr, "failed to load %s\n", model_path);
+		return 1;
+	}
+	yolo_destroy(probe);
+
+	using namespace std::chrono;
+	printf("{\n  \"model\": \"%s\",\n  \"frames\": %d,\n  \"warmup\": %d,\n  \"runs\": [\n", model_path, frame_count, warmup);
+	bool first_run = true;
+	for (const std::string& thread_arg : thread_args) {
+		yolo_options options = yolo_default_options();
+		options.num_threads = atoi(thread_arg.c_str());
+		auto tic = steady_clock::now();
+		load_model_with_options(model_path, &options);
+		double load_ms = duration<double, std::milli>(steady_clock::now() - tic).count();
+
+		for (const Size& size : sizes) {
+			for (const Format& format : formats) {
+				std::vector<std::vector<uint8_t>> frames = load_frames(input_path, frame_bytes(format, size), frame_count);
+				if (frames.empty()) {
+					return 1;
+				}
+
+				for (const std::string& conf_arg : conf_args) {
+					for (const std::string& nms_arg : nms_args) {
+						const float conf_threshold = static_cast<float>(atof(conf_arg.c_str()));
+						const float nms_threshold = static_cast<float>(atof(nms_arg.c_str()));
+						Stage convert{"convert", {}};
+						Stage detect{"detect", {}};
+						Stage total{"total", {}};
+						long detections = 0;
+
+						for (int i = -warmup; i < frame_count; ++i) {
+							if (i == 0) {
+								// Only the measured frames end up in the stage records.
+								yolo_reset_stats();
+							}
+							uint8_t* data = frames[(i + warmup) % frames.size()].data();
+							auto start = steady_clock::now();
+							uint8_t* rgba = data;
+							if (format.camera) {
+								const int y_size = size.width * size.height;
+								uint8_t* plane1 = format.format == YUV420 ? data + y_size : nullptr;
+								uint8_t* plane2 = format.format == YUV420 ? data + y_size + y_size / 4 : nullptr;
+								int row_stride = format.format == BGRA8888 ? size.width * 4 : size.width;
+								int chroma_stride = format.format == YUV420 ? size.width / 2 : size.width;
+								rgba = convert_image(format.format, data, plane1, plane2, row_stride, chroma_stride, chroma_stride, 1, 1, size.width, size.height, false);
+							}
+							auto converted = steady_clock::now();
+							DetectionResult result = yolo_detect(rgba, size.height, size.width, conf_threshold, nms_threshold);
+							auto detected = steady_clock::now();
+							free_result(result);
+							if (format.camera) {
+								free_rgba_buffer(rgba);
+							}
+
+							if (i < 0) {
+								continue;
+							}
+							detections += result.count;
+							if (format.camera) {
+								convert.times.push_back(duration<double, std::milli>(converted - start).count());
+							}
+							detect.times.push_back(duration<double, std::milli>(detected - converted).count());
+							total.times.push_back(duration<double, std::milli>(detected - start).count());
+						}
+
+						std::vector<YoloFrameStats> records(std::min(frame_count, YOLO_STATS_RECORDS));
+						const int recorded = yolo_get_stats(nullptr, records.data(), static_cast<int>(records.size()));
+						std::vector<Stage> inner;
+						for (const auto& inner_stage : INNER_STAGES) {
+							Stage stage{inner_stage.name, {}};
+							for (int r = 0; r < recorded; ++r) {
+								stage.times.push_back(records[r].stage_ns[inner_stage.stage] / 1e6);
+							}
+							inner.push_back(stage);
+						}
+
+						printf("%s    {\n", first_run ? "" : ",\n");
+						first_run = false;
+						printf("      \"threads\": %d, \"load_ms\": %.1f, \"width\": %d, \"height\": %d, \"format\": \"%s\", \"conf\": %.3f, \"nms\": %.3f,\n", options.num_threads, load_ms, size.width, size.height, format.name, conf_threshold, nms_threshold);
+						printf("      \"detections_per_frame\": %.2f,\n", static_cast<double>(detections) / frame_count);
+						printf("      \"stages\": {\n");
+						if (format.camera) {
+							print_stage(convert, false);
+						}
+						for (const Stage& stage : inner) {
+							print_stage(stage, false);
+						}
+						print_stage(detect, false);
+						print_stage(total, true);
+						printf("      }\n    }");
+					}
+				}
+			}
+		}
+	}
+	printf("\n  ]\n}\n");
+	close_model();
+	return 0;
+}
@@ -0,0 +1,570 @@
+// Offline detection over recorded footage, for backfills that would take days
+// one frame at a time through the app. Frames come from a raw recording or a
+// directory with one frame per file, are spread over several detector
+// instances and written in frame order, as JSON lines or a binary stream.
+//
+//   yolo_batch <model> --input <file|dir> --output <file>
+//              [--format rgba|bgra|nv21|i420] [--size 1280x720]
+//              [--workers 0] [--threads 0] [--conf 0.25] [--nms 0.45]
+//              [--binary] [--checkpoint-every 100] [--resume]
+//
+// A raw recording holds consecutive frames of --format and --size. In a
+// directory every file is one frame, read in name order: binary PPMs (P6,
+// as written by `ffmpeg -i in.mp4 frames/%08d.ppm`) carry their own size,
+// other files are raw frames like a recording. The OpenCV built with the
+// library has no image codecs, so compressed images need converting first.
+//
+// Workers default to one per 4 cores, each with an equal share of the cores.
+// A checkpoint next to the output records how far the output is complete, the
+// input and the output settings; --resume continues from it after an
+// interruption, with the same --input, --binary, --format and --size. Exits with 3 if any frame
+// could not be read, those are still written, marked as unreadable.
+//
+// JSON lines: {"frame": 0, "source": "...", "detections": [[x1, y1, x2, y2, class_id, conf], ...]}
+// Binary: "YOLB" and a uint32 version (1), then per frame an int64 frame
+// index, an int32 count (-1 for unreadable frames) and count * 6 floats in
+// the same order, all in native byte order.
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "yolo_ffi.h"
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+static const int CAPACITY = 300;
+static const uint32_t BINARY_VERSION = 1;
+// Frames a worker may run ahead of the writer, per worker.
+static const int WINDOW_PER_WORKER = 4;
+
+enum FrameFormat {
+	FRAME_RGBA,
+	FRAME_BGRA,
+	FRAME_NV21,
+	FRAME_I420,
+};
+
+struct Config {
+	const char* model_path = nullptr;
+	const char* input_path = nullptr;
+	const char* output_path = nullptr;
+	FrameFormat format = FRAME_RGBA;
+	int width = 1280;
+	int height = 720;
+	int workers = 0;
+	int threads = 0;
+	float conf_threshold = 0.25f;
+	float nms_threshold = 0.45f;
+	bool binary = false;
+	int checkpoint_every = 100;
+	bool resume = false;
+};
+
+// Where the frames come from: consecutive frames of one file, or one file per frame.
+struct Source {
+	bool directory = false;
+	std::vector<std::string> files;
+	size_t frame_bytes = 0;
+	int64_t frame_count = 0;
+};
+
+struct FrameResult {
+	// False when the frame could not be read.
+	bool ok = false;
+	std::vector<float> boxes;
+};
+
+static size_t frame_size(FrameFormat format, int width, int height) {
+	const size_t pixels = static_cast<size_t>(width) * height;
+	return format == FRAME_RGBA || format == FRAME_BGRA ? pixels * 4 : pixels * 3 / 2;
+}
+
+static bool parse_format(const char* name, FrameFormat& format) {
+	static const struct {
+		const char* name;
+		FrameFormat format;
+	} formats[] = {{"rgba", FRAME_RGBA}, {"bgra", FRAME_BGRA}, {"nv21", FRAME_NV21}, {"i420", FRAME_I420}};
+	for (const auto& entry : formats) {
+		if (!strcmp(name, entry.name)) {
+			format = entry.format;
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool open_source(const Config& config, Source& source) {
+	std::error_code error;
+	source.frame_bytes = frame_size(config.format, config.width, config.height);
+	if (fs::is_directory(config.input_path, error)) {
+		source.directory = true;
+		for (const fs::directory_entry& entry : fs::directory_iterator(config.input_path, error)) {
+			if (entry.is_regular_file(error)) {
+				source.files.push_back(entry.path().string());
+			}
+		}
+		std::sort(source.files.begin(), source.files.end());
+		source.frame_count = static_cast<int64_t>(source.files.size());
+		return true;
+	}
+	const uintmax_t size = fs::file_size(config.input_path, error);
+	if (error) {
+		fprintf(stderr, "cannot read %s\n", config.input_path);
+		return false;
+	}
+	source.frame_count = static_cast<int64_t>(size / source.frame_bytes);
+	return true;
+}
+
+// Skips whitespace and # comments between PPM header fields.
+static bool read_ppm_field(FILE* file, int& value) {
+	int c = fgetc(file);
+	while (c == '#' || isspace(c)) {
+		if (c == '#') {
+			while (c != '\n' && c != EOF) {
+				c = fgetc(file);
+			}
+		}
+		c = fgetc(file);
+	}
+	if (c == EOF) {
+		return false;
+	}
+	ungetc(c, file);
+	return fscanf(file, "%d", &value) == 1;
+}
+
+// Reads a binary PPM into RGBA pixels.
+static bool read_ppm(FILE* file, std::vector<uint8_t>& rgba, int& width, int& height) {
+	char magic[2];
+	int max_value = 0;
+	if (fread(magic, 1, 2, file) != 2 || magic[0] != 'P' || magic[1] != '6' || !read_ppm_field(file, width) || !read_ppm_field(file, height) || !read_ppm_field(file, max_value) || width <= 0 || height <= 0 || max_value != 255) {
+		return false;
+	}
+	// A single whitespace byte ends the header.
+	fgetc(file);
+	const size_t pixels = static_cast<size_t>(width) * height;
+	rgba.resize(pixels * 4);
+	// RGB is read into the tail of the buffer and spread out front to back.
+	uint8_t* rgb = rgba.data() + pixels;
+	if (fread(rgb, 3, pixels, file) != pixels) {
+		return false;
+	}
+	for (size_t i = 0; i < pixels; ++i) {
+		rgba[i * 4 + 0] = rgb[i * 3 + 0];
+		rgba[i * 4 + 1] = rgb[i * 3 + 1];
+		rgba[i * 4 + 2] = rgb[i * 3 + 2];
+		rgba[i * 4 + 3] = 255;
+	}
+	return true;
+}
+
+// Detects on frame `index` with the worker's handle. `pixels` and `file` are
+// the worker's own, so workers read in parallel.
+static bool detect_frame(yolo_handle_t handle, const Config& config, const Source& source, int64_t index, FILE*& file, std::vector<uint8_t>& pixels, std::vector<float>& boxes) {
+	FrameFormat format = config.format;
+	int width = config.width;
+	int height = config.height;
+	if (source.directory) {
+		const std::string& path = source.files[index];
+		FILE* frame_file = fopen(path.c_str(), "rb");
+		if (!frame_file) {
+			return false;
+		}
+		bool ok;
+		if (fs::path(path).extension() == ".ppm") {
+			ok = read_ppm(frame_file, pixels, width, height);
+			format = FRAME_RGBA;
+		} else {
+			pixels.resize(source.frame_bytes);
+			ok = fread(pixels.data(), 1, pixels.size(), frame_file) == pixels.size();
+		}
+		fclose(frame_file);
+		if (!ok) {
+			return false;
+		}
+	} else {
+		if (!file && !(file = fopen(config.input_path, "rb"))) {
+			return false;
+		}
+		pixels.resize(source.frame_bytes);
+		if (fseeko(file, static_cast<off_t>(index * source.frame_bytes), SEEK_SET) != 0 || fread(pixels.data(), 1, pixels.size(), file) != pixels.size()) {
+			return false;
+		}
+	}
+
+	boxes.resize(CAPACITY * 6);
+	uint8_t* y = pixels.data();
+	const size_t luma = static_cast<size_t>(width) * height;
+	int count = 0;
+	switch (format) {
+		case FRAME_RGBA:
+			count = yolo_handle_detect_into(handle, y, height, width, config.conf_threshold, config.nms_threshold, boxes.data(), CAPACITY);
+			break;
+		case FRAME_BGRA:
+			count = yolo_handle_detect_yuv_into(handle, BGRA8888, y, nullptr, nullptr, width * 4, 0, 0, 0, 0, width, height, false, config.conf_threshold, config.nms_threshold, boxes.data(), CAPACITY);
+			break;
+		case FRAME_NV21:
+			count = yolo_handle_detect_yuv_into(handle, NV21, y, y + luma, nullptr, width, width, 0, 2, 2, width, height, false, config.conf_threshold, config.nms_threshold, boxes.data(), CAPACITY);
+			break;
+		case FRAME_I420:
+			count = yolo_handle_detect_yuv_into(handle, YUV420, y, y + luma, y + luma + luma / 4, width, width / 2, width / 2, 1, 1, width, height, false, config.conf_threshold, config.nms_threshold, boxes.data(), CAPACITY);
+			break;
+	}
+	boxes.resize(static_cast<size_t>(count) * 6);
+	return true;
+}
+
+static void write_json_string(FILE* out, const std::string& text) {
+	fputc('"', out);
+	for (unsigned char c : text) {
+		if (c == '"' || c == '\\') {
+			fputc('\\', out);
+			fputc(c, out);
+		} else if (c < 0x20) {
+			fprintf(out, "\\u%04x", c);
+		} else {
+			fputc(c, out);
+		}
+	}
+	fputc('"', out);
+}
+
+static void write_result(FILE* out, const Config& config, const Source& source, int64_t index, const FrameResult& result) {
+	const int count = result.ok ? static_cast<int>(result.boxes.size() / 6) : -1;
+	if (config.binary) {
+		const int32_t count32 = count;
+		fwrite(&index, sizeof(index), 1, out);
+		fwrite(&count32, sizeof(count32), 1, out);
+		if (count > 0) {
+			fwrite(result.boxes.data(), sizeof(float), result.boxes.size(), out);
+		}
+		return;
+	}
+
+	fprintf(out, "{\"frame\": %lld, \"source\": ", static_cast<long long>(index));
+	write_json_string(out, source.directory ? fs::path(source.files[index]).filename().string() : std::string(config.input_path));
+	if (!result.ok) {
+		fputs(", \"error\": \"unreadable frame\"}\n", out);
+		return;
+	}
+	fputs(", \"detections\": [", out);
+	for (int i = 0; i < count; ++i) {
+		const float* d = &result.boxes[i * 6];
+		fprintf(out, "%s[%.2f, %.2f, %.2f, %.2f, %d, %.4f]", i ? ", " : "", d[0], d[1], d[2], d[3], static_cast<int>(d[4]), d[5]);
+	}
+	fputs("]}\n", out);
+}
+
+// The output is complete up to `bytes`, which hold every frame before
+// `next_frame`, written from the input and with the settings that follow.
+struct Checkpoint {
+	int64_t next_frame = 0;
+	long long bytes = 0;
+	bool binary = false;
+	FrameFormat format = FRAME_RGBA;
+	int width = 0;
+	int height = 0;
+	// Absolute input path and its frame count, which changes when files are
+	// added to or removed from an input directory.
+	int64_t frame_count = 0;
+	std::string input;
+};
+
+// Flushes `file` through to the disk, so a checkpoint never points past data
+// a crash could still lose.
+static bool sync_file(FILE* file) {
+	if (fflush(file) != 0) {
+		return false;
+	}
+#if defined(_WIN32)
+	return _commit(_fileno(file)) == 0;
+#else
+	return fsync(fileno(file)) == 0;
+#endif
+}
+
+static bool write_checkpoint(const std::string& path, const Checkpoint& checkpoint) {
+	const std::string temp = path + ".tmp";
+	FILE* file = fopen(temp.c_str(), "w");
+	if (!file) {
+		return false;
+	}
+	// The path goes on a line of its own, it may contain spaces.
+	fprintf(file, "%lld %lld %d %d %d %d %lld\n%s\n", static_cast<long long>(checkpoint.next_frame), checkpoint.bytes, checkpoint.binary ? 1 : 0, static_cast<int>(checkpoint.format), checkpoint.width, checkpoint.height, static_cast<long long>(checkpoint.frame_count), checkpoint.input.c_str());
+	const bool synced = sync_file(file);
+	const bool ok = fclose(file) == 0 && synced;
+	// Renamed once on disk, so a crash never leaves a torn checkpoint.
+	return ok && rename(temp.c_str(), path.c_str()) == 0;
+}
+
+static bool read_checkpoint(const std::string& path, Checkpoint& checkpoint) {
+	FILE* file = fopen(path.c_str(), "r");
+	if (!file) {
+		return false;
+	}
+	long long frame = 0;
+	int binary = 0;
+	int format = 0;
+	long long frame_count = 0;
+	bool ok = fscanf(file, "%lld %lld %d %d %d %d %lld\n", &frame, &checkpoint.bytes, &binary, &format, &checkpoint.width, &checkpoint.height, &frame_count) == 7;
+	char input[4096];
+	ok = ok && fgets(input, sizeof(input), file);
+	fclose(file);
+	if (!ok) {
+		return false;
+	}
+	checkpoint.next_frame = frame;
+	checkpoint.binary = binary != 0;
+	checkpoint.format = static_cast<FrameFormat>(format);
+	checkpoint.frame_count = frame_count;
+	checkpoint.input = input;
+	if (!checkpoint.input.empty() && checkpoint.input.back() == '\n') {
+		checkpoint.input.pop_back();
+	}
+	return true;
+}
+
+// Results in flight between the workers and the writer.
+struct Shared {
+	std::mutex mutex;
+	std::condition_variable written;
+	std::condition_variable finished;
+	std::map<int64_t, FrameResult> done;
+	// Next frame the writer waits for.
+	int64_t next_write = 0;
+	std::atomic<int64_t> next_frame{0};
+};
+
+static void worker_loop(yolo_handle_t handle, const Config& config, const Source& source, Shared& shared, int64_t window) {
+	FILE* file = nullptr;
+	std::vector<uint8_t> pixels;
+	while (true) {
+		const int64_t index = shared.next_frame.fetch_add(1);
+		if (index >= source.frame_count) {
+			break;
+		}
+		{
+			// Stay close to the writer, so finished frames never pile up.
+			std::unique_lock<std::mutex> lock(shared.mutex);
+			shared.written.wait(lock, [&] { return index - shared.next_write < window; });
+		}
+		FrameResult result;
+		result.ok = detect_frame(handle, config, source, index, file, pixels, result.boxes);
+		{
+			std::lock_guard<std::mutex> lock(shared.mutex);
+			shared.done.emplace(index, std::move(result));
+		}
+		shared.finished.notify_one();
+	}
+	if (file) {
+		fclose(file);
+	}
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <model> --input <file|dir> --output <file> [--format rgba|bgra|nv21|i420] [--size WxH] [--workers N] [--threads N] [--conf T] [--nms T] [--binary] [--checkpoint-every N] [--resume]\n", argv[0]);
+		return 2;
+	}
+	Config config;
+	config.model_path = argv[1];
+	for (int i = 2; i < argc; ++i) {
+		const char* flag = argv[i];
+		if (!strcmp(flag, "--binary")) {
+			config.binary = true;
+			continue;
+		}
+		if (!strcmp(flag, "--resume")) {
+			config.resume = true;
+			continue;
+		}
+		if (i + 1 >= argc) {
+			fprintf(stderr, "missing value for %s\n", flag);
+			return 2;
+		}
+		const char* value = argv[++i];
+		if (!strcmp(flag, "--input")) {
+			config.input_path = value;
+		} else if (!strcmp(flag, "--output")) {
+			config.output_path = value;
+		} else if (!strcmp(flag, "--format")) {
+			if (!parse_format(value, config.format)) {
+				fprintf(stderr, "unknown format %s\n", value);
+				return 2;
+			}
+		} else if (!strcmp(flag, "--size")) {
+			if (sscanf(value, "%dx%d", &config.width, &config.height) != 2 || config.width <= 0 || config.height <= 0) {
+				fprintf(stderr, "bad size %s\n", value);
+				return 2;
+			}
+		} else if (!strcmp(flag, "--workers")) {
+			config.workers = atoi(value);
+		} else if (!strcmp(flag, "--threads")) {
+			config.threads = atoi(value);
+		} else if (!strcmp(flag, "--conf")) {
+			config.conf_threshold = static_cast<float>(atof(value));
+		} else if (!strcmp(flag, "--nms")) {
+			config.nms_threshold = static_cast<float>(atof(value));
+		} else if (!strcmp(flag, "--checkpoint-every")) {
+			config.checkpoint_every = std::max(atoi(value), 1);
+		} else {
+			fprintf(stderr, "unknown option %s\n", flag);
+			return 2;
+		}
+	}
+	if (!config.input_path || !config.output_path) {
+		fprintf(stderr, "--input and --output are required\n");
+		return 2;
+	}
+
+	Source source;
+	if (!open_source(config, source)) {
+		return 1;
+	}
+
+	// Pick up where the checkpoint says the output is complete, dropping
+	// anything written after it.
+	const std::string checkpoint_path = std::string(config.output_path) + ".checkpoint";
+	Checkpoint checkpoint;
+	const bool resuming = config.resume && read_checkpoint(checkpoint_path, checkpoint);
+	if (config.resume && !resuming) {
+		fprintf(stderr, "no checkpoint at %s, starting over\n", checkpoint_path.c_str());
+	}
+	const int64_t first_frame = resuming ? checkpoint.next_frame : 0;
+	std::error_code path_error;
+	const std::string input = fs::absolute(config.input_path, path_error).lexically_normal().string();
+	FILE* out = nullptr;
+	if (resuming) {
+		// Frame indexes of another input would refer to other frames, and the
+		// output would still parse.
+		if (checkpoint.input != input || checkpoint.frame_count != source.frame_count) {
+			fprintf(stderr, "%s was written from %s with %lld frames, not %s with %lld, resume with the same input\n", config.output_path, checkpoint.input.c_str(), static_cast<long long>(checkpoint.frame_count), input.c_str(), static_cast<long long>(source.frame_count));
+			return 1;
+		}
+		// Appending JSON lines to a binary stream, or frames of another size,
+		// would leave an output no reader can parse.
+		if (checkpoint.binary != config.binary || checkpoint.format != config.format || checkpoint.width != config.width || checkpoint.height != config.height) {
+			fprintf(stderr, "%s was written with other --binary, --format or --size settings, resume with the same ones\n", config.output_path);
+			return 1;
+		}
+		// A shorter output lost frames the checkpoint counts as written,
+		// extending it would fill them with zeros.
+		std::error_code error;
+		const uintmax_t size = fs::file_size(config.output_path, error);
+		if (error || size < static_cast<uintmax_t>(checkpoint.bytes)) {
+			fprintf(stderr, "%s is shorter than its checkpoint, cannot resume\n", config.output_path);
+			return 1;
+		}
+		fs::resize_file(config.output_path, static_cast<uintmax_t>(checkpoint.bytes), error);
+		out = error ? nullptr : fopen(config.output_path, "ab");
+	} else {
+		out = fopen(config.output_path, "wb");
+		if (out && config.binary) {
+			fwrite("YOLB", 1, 4, out);
+			fwrite(&BINARY_VERSION, sizeof(BINARY_VERSION), 1, out);
+		}
+	}
+	if (!out) {
+		fprintf(stderr, "cannot write %s\n", config.output_path);
+		return 1;
+	}
+
+	// Several small instances scale better than one wide one, each frame's
+	// inference only keeps a few cores busy.
+	const int cores = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+	const int workers = config.workers > 0 ? config.workers : std::max(cores / 4, 1);
+	yolo_options options = yolo_default_options();
+	options.num_threads = config.threads > 0 ? config.threads : std::max(cores / workers, 1);
+	std::vector<yolo_handle_t> handles;
+	for (int i = 0; i < workers; ++i) {
+		yolo_handle_t handle = yolo_create_with_options(config.model_path, &options);
+		if (!handle) {
+			fprintf(stderr, "failed to load %s\n", config.model_path);
+			for (yolo_handle_t loaded : handles) {
+				yolo_destroy(loaded);
+			}
+			fclose(out);
+			return 1;
+		}
+		handles.push_back(handle);
+	}
+	fprintf(stderr, "%lld frames, %lld done, %d workers with %d threads each\n", static_cast<long long>(source.frame_count), static_cast<long long>(first_frame), workers, options.num_threads);
+
+	Shared shared;
+	shared.next_write = first_frame;
+	shared.next_frame = first_frame;
+	std::vector<std::thread> threads;
+	for (yolo_handle_t handle : handles) {
+		threads.emplace_back(worker_loop, handle, std::cref(config), std::cref(source), std::ref(shared), static_cast<int64_t>(workers) * WINDOW_PER_WORKER);
+	}
+
+	// Results are written in frame order as soon as the next one is done.
+	using namespace std::chrono;
+	const auto start = steady_clock::now();
+	auto last_report = start;
+	int64_t unreadable = 0;
+	checkpoint.binary = config.binary;
+	checkpoint.format = config.format;
+	checkpoint.width = config.width;
+	checkpoint.height = config.height;
+	checkpoint.frame_count = source.frame_count;
+	checkpoint.input = input;
+	for (int64_t index = first_frame; index < source.frame_count; ++index) {
+		FrameResult result;
+		{
+			std::unique_lock<std::mutex> lock(shared.mutex);
+			shared.finished.wait(lock, [&] { return shared.done.count(index) > 0; });
+			auto it = shared.done.find(index);
+			result = std::move(it->second);
+			shared.done.erase(it);
+			shared.next_write = index + 1;
+		}
+		shared.written.notify_all();
+
+		unreadable += !result.ok;
+		write_result(out, config, source, index, result);
+		if ((index + 1) % config.checkpoint_every == 0 || index + 1 == source.frame_count) {
+			checkpoint.next_frame = index + 1;
+			checkpoint.bytes = static_cast<long long>(ftello(out));
+			if (!sync_file(out) || !write_checkpoint(checkpoint_path, checkpoint)) {
+				fprintf(stderr, "cannot save the checkpoint at frame %lld\n", static_cast<long long>(index + 1));
+			}
+		}
+		const auto now = steady_clock::now();
+		if (now - last_report >= seconds(10)) {
+			last_report = now;
+			const double fps = (index + 1 - first_frame) / duration<double>(now - start).count();
+			fprintf(stderr, "%lld/%lld frames, %.1f fps\n", static_cast<long long>(index + 1), static_cast<long long>(source.frame_count), fps);
+		}
+	}
+
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+	for (yolo_handle_t handle : handles) {
+		yolo_destroy(handle);
+	}
+	fclose(out);
+
+	const double seconds_taken = duration<double>(steady_clock::now() - start).count();
+	const int64_t processed = source.frame_count - first_frame;
+	fprintf(stderr, "%lld frames in %.1f s (%.1f fps), %lld unreadable\n", static_cast<long long>(processed), seconds_taken, seconds_taken > 0 ? processed / seconds_taken : 0.0, static_cast<long long>(unreadable));
+	return unreadable > 0 ? 3 : 0;
+}
@@ -1,60 +1,97 @@
 #include "coreml_yolo.h"
+#include <opencv2/imgproc.hpp>
 #include "print.h"
+#include "yolo_backend.h"
 #include "yolo_ffi.h"
 
-// Global pointer to the session container.
-static struct MlContainer* mlmodel_container = nullptr;
+// CoreML implementation of the backend used by yolo_handle.cpp.
+struct BackendModel {
+	MlContainer* container;
+};
 
-extern "C" {
-FFI_PLUGIN_EXPORT void load_model(const char* model_path) {
-	// If a model is already loaded, close it before loading a new one.
-	if (mlmodel_container) {
-		shutdown_model(mlmodel_container);
+BackendModel* backend_open(const ModelSource& source, const yolo_options& options) {
+	// CoreML compiles models from a file.
+	if (source.path.empty()) {
+		log_message(YOLO_LOG_ERROR, "CoreML models can only be loaded from a file.");
+		return nullptr;
 	}
-	mlmodel_container = initialize_model(model_path);
+	// Vision schedules the model itself, there are no engine options to apply.
+	MlContainer* container = initialize_model(source.path.c_str());
+	if (!container || !container->model) {
+		log_message(YOLO_LOG_ERROR, "model load fail");
+		shutdown_model(container);
+		return nullptr;
+	}
+	return new BackendModel{container};
 }
 
-FFI_PLUGIN_EXPORT DetectionResult yolo_detect(uint8_t* image_data, int height, int width, float conf_threshold, float nms_threshold) {
-	if (!mlmodel_container || !mlmodel_container->model) {
-		print_message("model load fail");
-		return {nullptr, 0};
+void backend_close(BackendModel* model) {
+	if (model) {
+		shutdown_model(model->container);
+		delete model;
 	}
+}
 
-	// Create a cv::Mat from the raw image data without copying.
-	// The data is expected to be in RGBA format.
-	cv::Mat image(height, width, CV_8UC4, image_data);
-
-	std::vector<Detection> detections = perform_inference(mlmodel_container, image, conf_threshold, nms_threshold);
+bool backend_has_options(BackendModel* model) {
+	return false;
+}
 
-	int num_detections = detections.size();
-	if (num_detections == 0) {
-		return {nullptr, 0};
-	}
+void backend_detect(BackendModel* model, cv::InputArray image, float conf_threshold, float nms_threshold, const DetectSettings& settings, std::vector<Detection>& detections) {
+	perform_inference(model->container, image, conf_threshold, nms_threshold, settings, detections);
+}
 
-	// Allocate memory for the flat array of detection results.
-	// Each detection has 6 floats: [x, y, w, h, class_id, conf]
-	float* const bboxes = new float[num_detections * 6];
-
-	for (int i = 0; i < num_detections; ++i) {
-		bboxes[i * 6 + 0] = detections[i].box.x;
-		bboxes[i * 6 + 1] = detections[i].box.y;
-		bboxes[i * 6 + 2] = detections[i].box.br().x;
-		bboxes[i * 6 + 3] = detections[i].box.br().y;
-		bboxes[i * 6 + 4] = static_cast<float>(detections[i].class_id);
-		bboxes[i * 6 + 5] = detections[i].confidence;
+void backend_detect_frame(BackendModel* model, const FrameView& frame, bool rotate_cw, float conf_threshold, float nms_threshold, const DetectSettings& settings, std::vector<Detection>& detections) {
+	if (frame.layout == LAYOUT_RGBA) {
+		cv::Mat image(frame.height, frame.width, CV_8UC4, const_cast<uint8_t*>(frame.planes[0]), frame.row_strides[0]);
+		if (rotate_cw) {
+			cv::rotate(image, image, cv::ROTATE_90_CLOCKWISE);
+		}
+		perform_inference(model->container, image, conf_threshold, nms_threshold, settings, detections);
+		return;
 	}
 
-	return {bboxes, num_detections};
+	// Vision takes an 8-bit pixel buffer rather than a float tensor, so go through RGBA here.
+	ImageFormat format = frame.layout == LAYOUT_I420 ? YUV420 : frame.layout == LAYOUT_NV21 ? NV21 : BGRA8888;
+	uint8_t* planes[3] = {const_cast<uint8_t*>(frame.planes[0]), const_cast<uint8_t*>(frame.planes[1]), const_cast<uint8_t*>(frame.planes[2])};
+	uint8_t* rgba = convert_image(format, planes[0], planes[1], planes[2], frame.row_strides[0], frame.row_strides[1], frame.row_strides[2], frame.pixel_strides[1], frame.pixel_strides[2], frame.width, frame.height, rotate_cw);
+	// convert_image swaps the dimensions when it rotates.
+	int rgba_height = rotate_cw ? frame.width : frame.height;
+	int rgba_width = rotate_cw ? frame.height : frame.width;
+	cv::Mat image(rgba_height, rgba_width, CV_8UC4, rgba);
+	perform_inference(model->container, image, conf_threshold, nms_threshold, settings, detections);
+	free_rgba_buffer(rgba);
 }
 
-FFI_PLUGIN_EXPORT void close_model() {
-	if (mlmodel_container) {
-		shutdown_model(mlmodel_container);
-		mlmodel_container = nullptr;
+std::vector<std::vector<Detection>> backend_detect_batch(BackendModel* model, const std::vector<cv::Mat>& images, float conf_threshold, float nms_threshold, const DetectSettings& settings) {
+	// Vision schedules one request per image on the Neural Engine, there is no batch tensor to pack.
+	std::vector<std::vector<Detection>> results(images.size());
+	for (size_t i = 0; i < images.size(); ++i) {
+		perform_inference(model->container, images[i], conf_threshold, nms_threshold, settings, results[i]);
 	}
+	return results;
 }
 
-const char* get_model_input_name() {
+const char* backend_input_name(BackendModel* model) {
 	return nullptr;
 }
-}
\ No newline at end of file
+
+bool backend_has_stages(BackendModel* model) {
+	return false;
+}
+
+ModelInput backend_model_input(BackendModel* model) {
+	return {640, 640, false};
+}
+
+InputGeometry backend_input_geometry(BackendModel* model, int image_w, int image_h, ResizeMode mode, int input_size) {
+	// Same as perform_inference, the model input is a fixed 640x640.
+	return mode == RESIZE_LETTERBOX ? letterbox_geometry(image_w, image_h, 640, 640, true) : stretch_geometry(640, 640);
+}
+
+bool backend_infer(BackendModel* model, float* input, const InputGeometry& geometry, std::vector<float>& output, int& num_channels, int& num_anchors, int& num_masks) {
+	return false;
+}
+
+bool backend_classify(BackendModel* model, float* input, int count, int size, std::vector<float>& scores, int& num_classes) {
+	return false;
+}
@@ -3,20 +3,20 @@
 
 #include <opencv2/core.hpp>
 #include <vector>
+#include "detect_settings.h"
+#include "detection.h"
+#include "postprocess.h"
+#include "preprocess.h"
 
 struct MlContainer {
 	// Using void* to hold the model makes the struct C-compatible
 	// and hides the Objective-C details from the header.
 	void* model;
+	PostprocessScratch scratch;
 };
 
-struct Detection {
-	cv::Rect box;
-	int class_id;
-	float confidence;
-};
-
-std::vector<Detection> perform_inference(MlContainer* container, cv::InputArray image, float conf_threshold, float nms_threshold);
+// Detects on an RGBA image, `detections` is overwritten.
+void perform_inference(MlContainer* container, cv::InputArray image, float conf_threshold, float nms_threshold, const DetectSettings& settings, std::vector<Detection>& detections);
 
 extern "C" {
 struct MlContainer* initialize_model(const char* model_path);
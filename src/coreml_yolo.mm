@@ -2,10 +2,10 @@
 #import <CoreML/CoreML.h>
 #import <Foundation/Foundation.h>
 #import <Vision/Vision.h>
-#include <chrono>
-#include <opencv2/dnn.hpp>
 #include <opencv2/imgproc.hpp>
 #include "print.h"
+#include "postprocess.h"
+#include "yolo_stats.h"
 
 // Helper function to convert cv::Mat to CVPixelBufferRef
 CVPixelBufferRef matToCVPixelBuffer(const cv::Mat& mat) {
@@ -18,7 +18,7 @@ CVPixelBufferRef matToCVPixelBuffer(const cv::Mat& mat) {
 
 	// Ensure the input Mat is continuous
 	if (!mat.isContinuous()) {
-		print_message("Error: Input cv::Mat is not continuous.");
+		log_message(YOLO_LOG_ERROR, "Input cv::Mat is not continuous.");
 		return nullptr;
 	}
 
@@ -35,9 +35,7 @@ CVPixelBufferRef matToCVPixelBuffer(const cv::Mat& mat) {
 	    &pixelBuffer);
 
 	if (status != kCVReturnSuccess) {
-		char buffer[256];
-		sprintf(buffer, "Failed to create CVPixelBuffer. Status: %d", status);
-		print_message(buffer);
+		log_message(YOLO_LOG_ERROR, "Failed to create CVPixelBuffer. Status: %d", status);
 		return nullptr;
 	}
 
@@ -57,21 +55,21 @@ MlContainer* initialize_model(const char* model_path) {
 		// Compile the model if it's not already compiled
 		NSURL* compiledURL = [MLModel compileModelAtURL:modelURL error:&error];
 		if (error) {
-			print_message([[NSString stringWithFormat:@"Error compiling model: %@", error.localizedDescription] UTF8String]);
+			log_message(YOLO_LOG_ERROR, "Error compiling model: %s", error.localizedDescription.UTF8String);
 			return nullptr;
 		}
 
 		// Load the compiled model
 		MLModel* mlModel = [MLModel modelWithContentsOfURL:compiledURL configuration:config error:&error];
 		if (!mlModel || error) {
-			print_message([[NSString stringWithFormat:@"Error loading model: %@", error.localizedDescription] UTF8String]);
+			log_message(YOLO_LOG_ERROR, "Error loading model: %s", error.localizedDescription.UTF8String);
 			return nullptr;
 		}
 
 		// Create a Vision model from the CoreML model
 		VNCoreMLModel* visionModel = [VNCoreMLModel modelForMLModel:mlModel error:&error];
 		if (!visionModel || error) {
-			print_message([[NSString stringWithFormat:@"Error creating Vision model: %@", error.localizedDescription] UTF8String]);
+			log_message(YOLO_LOG_ERROR, "Error creating Vision model: %s", error.localizedDescription.UTF8String);
 			return nullptr;
 		}
 		// [visionModel retain]; //When you don't open ARC, you have to retain manually.
@@ -85,42 +83,51 @@ MlContainer* initialize_model(const char* model_path) {
 	}
 }
 
-std::vector<Detection> perform_inference(MlContainer* container, cv::InputArray image, float conf_threshold, float nms_threshold) {
+void perform_inference(MlContainer* container, cv::InputArray image, float conf_threshold, float nms_threshold, const DetectSettings& settings, std::vector<Detection>& detections) {
+	detections.clear();
 	@autoreleasepool {
 		if (!container || !container->model) {
-			return {};
+			return;
 		}
 
-		using namespace std::chrono;
 		const int INPUT_WIDTH = 640;
 		const int INPUT_HEIGHT = 640;
 
 		// Preprocessing
-		auto tic = high_resolution_clock::now();
+		YoloFrameStats stats{};
+		stats.timestamp_ns = stats_now_ns();
 		cv::Mat resized_img;
 		cv::Mat input_image = image.getMat();
-		cv::resize(input_image, resized_img, cv::Size(INPUT_WIDTH, INPUT_HEIGHT));
+		// The Core ML model has a fixed input, so letterboxing always pads to a square.
+		InputGeometry geometry = settings.resize_mode == RESIZE_LETTERBOX
+		                             ? letterbox_geometry(input_image.cols, input_image.rows, INPUT_WIDTH, INPUT_WIDTH, true)
+		                             : stretch_geometry(INPUT_WIDTH, INPUT_HEIGHT);
+		cv::resize(input_image, resized_img, cv::Size(geometry.content_w, geometry.content_h));
 		cv::cvtColor(resized_img, resized_img, cv::COLOR_RGBA2RGB);
+		if (settings.resize_mode == RESIZE_LETTERBOX) {
+			int right = geometry.input_w - geometry.content_w - geometry.content_x;
+			int bottom = geometry.input_h - geometry.content_h - geometry.content_y;
+			cv::copyMakeBorder(resized_img, resized_img, geometry.content_y, bottom, geometry.content_x, right, cv::BORDER_CONSTANT, cv::Scalar::all(LETTERBOX_PAD_VALUE));
+		}
 
 		// Convert cv::Mat to CVPixelBufferRef
 		CVPixelBufferRef pixelBuffer = matToCVPixelBuffer(resized_img);
 		if (!pixelBuffer) {
-			return {};
+			return;
 		}
-		auto toc = high_resolution_clock::now();
-		auto pre_elapsed = duration_cast<milliseconds>(toc - tic);
+		stats.stage_ns[YOLO_STAGE_PREPROCESS] = stats_now_ns() - stats.timestamp_ns;
 
 		// Inference
-		tic = high_resolution_clock::now();
+		int64_t tic = stats_now_ns();
 		// Bridge the C pointer back to an Objective-C object without transferring ownership.
 		VNCoreMLModel* visionModel = (__bridge VNCoreMLModel*)container->model;
 		// Create a Vision request
 		// VNCoreMLRequest* request = [[[VNCoreMLRequest alloc] initWithModel:visionModel] autorelease];
 		VNCoreMLRequest* request = [[VNCoreMLRequest alloc] initWithModel:visionModel];
 		if (!request) {
-			print_message("Failed to create VNCoreMLRequest.");
+			log_message(YOLO_LOG_ERROR, "Failed to create VNCoreMLRequest.");
 			CVPixelBufferRelease(pixelBuffer);
-			return {};
+			return;
 		}
 
 		// Create a handler and perform the synchronous request
@@ -129,88 +136,58 @@ std::vector<Detection> perform_inference(MlContainer* container, cv::InputArray
 		[handler performRequests:@[ request ] error:&error];
 		CVPixelBufferRelease(pixelBuffer);
 		if (error) {
-			print_message([[NSString stringWithFormat:@"Error performing request: %@", error.localizedDescription] UTF8String]);
-			return {};
+			log_message(YOLO_LOG_ERROR, "Error performing request: %s", error.localizedDescription.UTF8String);
+			return;
 		}
 
 		// Get the results directly from the request's results property.
 		NSArray* observations = request.results;
 
-		toc = high_resolution_clock::now();
-		auto infer_elapsed = duration_cast<milliseconds>(toc - tic);
+		stats.stage_ns[YOLO_STAGE_INFERENCE] = stats_now_ns() - tic;
 
 		// Post-processing
-		tic = high_resolution_clock::now();
 		if (observations.count == 0) {
-			return {};
+			return;
 		}
 
-		VNCoreMLFeatureValueObservation* rawOutput = (VNCoreMLFeatureValueObservation*)observations[0];
-		MLMultiArray* multiArray = rawOutput.featureValue.multiArrayValue;
+		// Segmentation models add the [1, 32, 160, 160] mask prototypes as a
+		// second output. Vision does not keep the output order, the rank tells them apart.
+		MLMultiArray* multiArray = nil;
+		MLMultiArray* protoArray = nil;
+		for (VNObservation* observation in observations) {
+			if (![observation isKindOfClass:[VNCoreMLFeatureValueObservation class]]) {
+				continue;
+			}
+			MLMultiArray* array = ((VNCoreMLFeatureValueObservation*)observation).featureValue.multiArrayValue;
+			if (array.shape.count == 4) {
+				protoArray = array;
+			} else if (!multiArray) {
+				multiArray = array;
+			}
+		}
 
 		if (!multiArray) {
-			print_message("Model output is not an MLMultiArray.");
-			return {};
+			log_message(YOLO_LOG_ERROR, "Model output is not an MLMultiArray.");
+			return;
 		}
 
 		const float* raw_output = (const float*)multiArray.dataPointer;
 		const int num_classes = [multiArray.shape[1] intValue];
 		const int num_detections = [multiArray.shape[2] intValue];
 
-		std::vector<cv::Rect> boxes;
-		std::vector<float> confidences;
-		std::vector<int> class_ids;
-
-		for (int i = 0; i < num_detections; ++i) {
-			const float* detection = raw_output + i;
-			const float* class_scores = detection + 4 * num_detections;
-
-			int class_id = -1;
-			float max_score = 0.0f;
-			for (int j = 0; j < num_classes - 4; ++j) {
-				int idx = j * num_detections;
-				if (class_scores[idx] > max_score) {
-					max_score = class_scores[idx];
-					class_id = j;
-				}
-			}
-
-			if (max_score > conf_threshold) {
-				float cx = detection[0 * num_detections];
-				float cy = detection[1 * num_detections];
-				float w = detection[2 * num_detections];
-				float h = detection[3 * num_detections];
-
-				int left = static_cast<int>(std::round(cx - 0.5 * w));
-				int top = static_cast<int>(std::round(cy - 0.5 * h));
-				int width = static_cast<int>(std::round(w));
-				int height = static_cast<int>(std::round(h));
-
-				boxes.emplace_back(left, top, width, height);
-				confidences.emplace_back(max_score);
-				class_ids.emplace_back(class_id);
-			}
+		MaskPrototypes protos;
+		if (protoArray) {
+			protos.data = (const float*)protoArray.dataPointer;
+			protos.count = [protoArray.shape[1] intValue];
+			protos.height = [protoArray.shape[2] intValue];
+			protos.width = [protoArray.shape[3] intValue];
+			protos.plane_stride = [protoArray.strides[1] unsignedLongValue];
 		}
 
-		std::vector<int> nms_indices;
-		cv::dnn::NMSBoxes(boxes, confidences, conf_threshold, nms_threshold, nms_indices);
+		postprocess_output(raw_output, num_classes, num_detections, geometry, conf_threshold, nms_threshold, settings, container->scratch, detections, &stats, protoArray ? &protos : nullptr);
 
-		std::vector<Detection> detections;
-		for (int idx : nms_indices) {
-			Detection result;
-			result.box = boxes[idx];
-			result.confidence = confidences[idx];
-			result.class_id = class_ids[idx];
-			detections.push_back(result);
-		}
-		toc = high_resolution_clock::now();
-		auto post_elapsed = duration_cast<milliseconds>(toc - tic);
-		char buffer[1024];
-		auto total = pre_elapsed + infer_elapsed + post_elapsed;
-		sprintf(buffer, "Elapsed Time(%lld ms): preprocess: %lld ms, inference: %lld ms, postprocess: %lld ms", total.count(), pre_elapsed.count(), infer_elapsed.count(), post_elapsed.count());
-		print_message(buffer);
-
-		return detections;
+		stats.stage_ns[YOLO_STAGE_TOTAL] = stats_now_ns() - stats.timestamp_ns;
+		stats_record(stats);
 	}
 }
 
@@ -0,0 +1,45 @@
+#ifndef DETECT_SETTINGS_H
+#define DETECT_SETTINGS_H
+
+#include <vector>
+#include "yolo_ffi.h"
+
+// Detection settings configured through the FFI setters and shared by every
+// backend. They are kept across model reloads.
+struct DetectSettings {
+	ResizeMode resize_mode = RESIZE_STRETCH;
+	// Indexed by class id, see `set_class_thresholds`.
+	std::vector<float> class_thresholds;
+	// Detections kept after NMS, 0 keeps all of them.
+	int max_detections = 300;
+	// Best scoring candidates that enter NMS, the rest are dropped.
+	int nms_top_k = 30000;
+	// See `set_output_layout`.
+	OutputLayout output_layout = OUTPUT_LAYOUT_AUTO;
+	// Instance masks of segmentation models, see `set_masks`.
+	bool masks = false;
+	// Frames run through the network together by `yolo_detect_batch`.
+	int batch_size = 8;
+	// Tracking runs the detector on every `detect_interval`-th frame, or
+	// sooner once the tracks' mean confidence drops below
+	// `track_min_confidence`, see `set_tracking`.
+	int detect_interval = 1;
+	float track_min_confidence = 0.f;
+	// Frames whose luma changed less than this since the last detection reuse
+	// its result, 0 turns the gate off. See `set_motion_gate`.
+	float motion_threshold = 0.f;
+	int motion_max_skipped = 30;
+	// RGBA images larger than this are detected tile by tile, 0 never tiles.
+	// See `set_tiling`.
+	int tile_size = 0;
+	float tile_overlap = 0.2f;
+	// Long side of the network input, 0 for the size the model was made for.
+	// See `set_input_size`, the resolution controller changes it between frames.
+	int input_size = 0;
+	// Input sizes the resolution controller picks from, ascending, to keep
+	// detections within `latency_budget_ms`. See `set_latency_budget`.
+	std::vector<int> input_sizes;
+	float latency_budget_ms = 0.f;
+};
+
+#endif  // DETECT_SETTINGS_H
@@ -0,0 +1,25 @@
+#ifndef DETECTION_H
+#define DETECTION_H
+
+#include <stdint.h>
+#include <opencv2/core.hpp>
+#include <vector>
+
+struct Detection {
+	cv::Rect2f box;
+	int class_id;
+	float confidence;
+	// Stable id assigned by the tracker, -1 for plain detections.
+	int track_id = -1;
+	// Instance mask of segmentation models over `mask_rect`, in the space of
+	// `box`: (width + 7) / 8 bytes per row, pixel x in bit x % 8 of byte x / 8.
+	// Empty unless masks are turned on, see `set_masks`.
+	cv::Rect mask_rect;
+	std::vector<uint8_t> mask;
+	// Class the cascade classifier gave the crop of `box` and its score, -1
+	// unless a classifier is set, see `yolo_handle_set_classifier`.
+	int crop_class_id = -1;
+	float crop_confidence = 0.f;
+};
+
+#endif  // DETECTION_H
@@ -0,0 +1,140 @@
+#include "frame_pool.h"
+#include <opencv2/opencv.hpp>
+#include "print.h"
+
+// Slots start on cache lines, so the SIMD loads of preprocessing stay aligned.
+static const size_t SLOT_ALIGN = 64;
+
+static FrameSlot* find_slot(YoloFramePool* pool, int slot) {
+	if (!pool || slot < 0 || slot >= pool->slot_count) {
+		return nullptr;
+	}
+	return &pool->slots[slot];
+}
+
+bool frame_pool_retain(YoloFramePool* pool, int slot) {
+	FrameSlot* entry = find_slot(pool, slot);
+	if (!entry) {
+		return false;
+	}
+	int refs = entry->refs.load();
+	while (refs > 0) {
+		if (entry->refs.compare_exchange_weak(refs, refs + 1)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void frame_pool_release(YoloFramePool* pool, int slot) {
+	FrameSlot* entry = find_slot(pool, slot);
+	if (!entry) {
+		return;
+	}
+	int refs = entry->refs.load();
+	while (refs > 0) {
+		if (entry->refs.compare_exchange_weak(refs, refs - 1)) {
+			return;
+		}
+	}
+	log_message(YOLO_LOG_WARN, "Frame slot %d released while free.", slot);
+}
+
+FrameSlot* frame_pool_slot(YoloFramePool* pool, int slot) {
+	FrameSlot* entry = find_slot(pool, slot);
+	return entry && entry->refs.load() > 0 ? entry : nullptr;
+}
+
+uint8_t* frame_pool_data(YoloFramePool* pool, int slot) {
+	FrameSlot* entry = frame_pool_slot(pool, slot);
+	return entry ? entry->data : nullptr;
+}
+
+extern "C" {
+FFI_PLUGIN_EXPORT yolo_frame_pool_t yolo_frame_pool_create(int slot_count, size_t slot_size) {
+	if (slot_count <= 0 || slot_size == 0) {
+		log_message(YOLO_LOG_ERROR, "Invalid frame pool of %d slots of %zu bytes.", slot_count, slot_size);
+		return nullptr;
+	}
+
+	// Every slot rounded up to whole cache lines, so neighbours never share one.
+	size_t stride = (slot_size + SLOT_ALIGN - 1) / SLOT_ALIGN * SLOT_ALIGN;
+	auto* pool = new YoloFramePool;
+	pool->slot_size = slot_size;
+	pool->slot_count = slot_count;
+	pool->slots.reset(new FrameSlot[slot_count]);
+	pool->memory = static_cast<uint8_t*>(cv::fastMalloc(stride * slot_count));
+	for (int i = 0; i < slot_count; ++i) {
+		pool->slots[i].data = pool->memory + stride * i;
+	}
+	return pool;
+}
+
+FFI_PLUGIN_EXPORT void yolo_frame_pool_destroy(yolo_frame_pool_t pool) {
+	if (!pool) {
+		return;
+	}
+	cv::fastFree(pool->memory);
+	delete pool;
+}
+
+FFI_PLUGIN_EXPORT int yolo_frame_pool_acquire(yolo_frame_pool_t pool) {
+	if (!pool) {
+		return -1;
+	}
+	for (int i = 0; i < pool->slot_count; ++i) {
+		int expected = 0;
+		if (pool->slots[i].refs.compare_exchange_strong(expected, 1)) {
+			pool->slots[i].frame = FrameView{};
+			pool->slots[i].rotate_cw = false;
+			return i;
+		}
+	}
+	return -1;
+}
+
+FFI_PLUGIN_EXPORT uint8_t* yolo_frame_pool_data(yolo_frame_pool_t pool, int slot) {
+	return frame_pool_data(pool, slot);
+}
+
+FFI_PLUGIN_EXPORT size_t yolo_frame_pool_slot_size(yolo_frame_pool_t pool) {
+	return pool ? pool->slot_size : 0;
+}
+
+FFI_PLUGIN_EXPORT bool yolo_frame_pool_write_yuv(
+    yolo_frame_pool_t pool,
+    int slot,
+    ImageFormat format,
+    uint8_t* plane0,
+    uint8_t* plane1,
+    uint8_t* plane2,
+    int bytesPerRow0,
+    int bytesPerRow1,
+    int bytesPerRow2,
+    int bytesPerPixel1,
+    int bytesPerPixel2,
+    int width,
+    int height,
+    bool isAndroid) {
+	FrameSlot* entry = frame_pool_slot(pool, slot);
+	if (!entry || !plane0 || width <= 0 || height <= 0) {
+		return false;
+	}
+	// The planes are copied as they are, with their strides, and converted
+	// and rotated only once preprocessing reads them.
+	FrameView frame = make_frame_view(format, plane0, plane1, plane2, bytesPerRow0, bytesPerRow1, bytesPerRow2, bytesPerPixel1, bytesPerPixel2, width, height);
+	const size_t size = frame_size(frame);
+	if (size > pool->slot_size) {
+		log_message(YOLO_LOG_ERROR, "A %dx%d frame needs %zu bytes, more than the %zu byte frame slots.", width, height, size, pool->slot_size);
+		return false;
+	}
+	entry->frame = copy_frame(frame, entry->data);
+	// on Android the raw camera data is rotated 90 clockwise, same as convert_image
+	entry->rotate_cw = isAndroid;
+	return true;
+}
+
+FFI_PLUGIN_EXPORT void yolo_frame_pool_release(yolo_frame_pool_t pool, int slot) {
+	frame_pool_release(pool, slot);
+}
+}
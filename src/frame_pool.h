@@ -0,0 +1,47 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include "preprocess.h"
+#include "yolo_ffi.h"
+
+// One pooled frame buffer. Free while `refs` is 0.
+struct FrameSlot {
+	uint8_t* data = nullptr;
+	std::atomic<int> refs{0};
+	// Planes written by yolo_frame_pool_write_yuv, pointing into `data`, and
+	// whether they are rotated when detected. Cleared on acquire, a slot
+	// without a frame holds RGBA written through yolo_frame_pool_data.
+	FrameView frame{};
+	bool rotate_cw = false;
+};
+
+// Fixed set of equally sized, cache-line aligned frame buffers in one block,
+// handed out by reference count. Acquiring and releasing never allocate or
+// take a lock, so the camera thread, Dart isolates and the pipeline stages
+// can pass frames around by slot index without copying pixels.
+struct YoloFramePool {
+	size_t slot_size = 0;
+	int slot_count = 0;
+	std::unique_ptr<FrameSlot[]> slots;
+	// Backing memory of every slot, from cv::fastMalloc.
+	uint8_t* memory = nullptr;
+};
+
+// Adds a reference to a slot the caller already holds one on, for another
+// reader. Returns false for an invalid or free slot.
+bool frame_pool_retain(YoloFramePool* pool, int slot);
+
+// Drops a reference taken with yolo_frame_pool_acquire or frame_pool_retain.
+void frame_pool_release(YoloFramePool* pool, int slot);
+
+// A held slot, nullptr for an invalid or free one.
+FrameSlot* frame_pool_slot(YoloFramePool* pool, int slot);
+
+// Memory of a held slot, nullptr for an invalid or free one.
+uint8_t* frame_pool_data(YoloFramePool* pool, int slot);
+
+#endif  // FRAME_POOL_H
@@ -0,0 +1,132 @@
+#include "model_source.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "print.h"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+ModelBuffer::~ModelBuffer() {
+#if !defined(_WIN32)
+	if (mapped) {
+		munmap(const_cast<unsigned char*>(data), size);
+		return;
+	}
+#endif
+	free(const_cast<unsigned char*>(data));
+}
+
+#if defined(_WIN32)
+std::shared_ptr<const ModelBuffer> map_model_file(const std::string& path) {
+	// No mapping here, the file is read into memory once per load.
+	FILE* file = fopen(path.c_str(), "rb");
+	if (!file) {
+		log_message(YOLO_LOG_ERROR, "Failed to open model file %s.", path.c_str());
+		return nullptr;
+	}
+	std::vector<unsigned char> bytes;
+	unsigned char chunk[1 << 16];
+	size_t read;
+	while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+		bytes.insert(bytes.end(), chunk, chunk + read);
+	}
+	fclose(file);
+	return copy_model_bytes(bytes.data(), bytes.size());
+}
+#else
+// Live mappings by path. Entries expire with the last model using them and
+// are pruned whenever a file is mapped.
+static std::unordered_map<std::string, std::weak_ptr<const ModelBuffer>> mappings;
+static std::mutex mappings_mutex;
+
+std::shared_ptr<const ModelBuffer> map_model_file(const std::string& path) {
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		log_message(YOLO_LOG_ERROR, "Failed to open model file %s.", path.c_str());
+		return nullptr;
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+		close(fd);
+		log_message(YOLO_LOG_ERROR, "Model file %s is empty.", path.c_str());
+		return nullptr;
+	}
+
+	std::lock_guard<std::mutex> lock(mappings_mutex);
+	for (auto it = mappings.begin(); it != mappings.end();) {
+		it = it->second.expired() ? mappings.erase(it) : std::next(it);
+	}
+	auto it = mappings.find(path);
+	if (it != mappings.end()) {
+		std::shared_ptr<const ModelBuffer> existing = it->second.lock();
+		if (existing && existing->device == static_cast<unsigned long long>(info.st_dev) && existing->inode == static_cast<unsigned long long>(info.st_ino) &&
+		    existing->size == static_cast<size_t>(info.st_size) && existing->modified == static_cast<long long>(info.st_mtime)) {
+			close(fd);
+			return existing;
+		}
+	}
+
+	void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping stays valid after the descriptor is closed.
+	close(fd);
+	if (data == MAP_FAILED) {
+		log_message(YOLO_LOG_ERROR, "Failed to map model file %s.", path.c_str());
+		return nullptr;
+	}
+	// Loading reads the whole file front to back, start reading it in now.
+	madvise(data, info.st_size, MADV_WILLNEED);
+
+	auto buffer = std::make_shared<ModelBuffer>();
+	buffer->data = static_cast<const unsigned char*>(data);
+	buffer->size = info.st_size;
+	buffer->mapped = true;
+	buffer->device = info.st_dev;
+	buffer->inode = info.st_ino;
+	buffer->modified = info.st_mtime;
+	mappings[path] = buffer;
+	return buffer;
+}
+#endif
+
+std::shared_ptr<const ModelBuffer> copy_model_bytes(const void* data, size_t size) {
+	if (!data || size == 0) {
+		return nullptr;
+	}
+	// malloc's alignment is enough for weights referenced in place.
+	auto* copy = static_cast<unsigned char*>(malloc(size + 1));
+	if (!copy) {
+		log_message(YOLO_LOG_ERROR, "Out of memory copying a %zu byte model.", size);
+		return nullptr;
+	}
+	memcpy(copy, data, size);
+	copy[size] = 0;
+
+	auto buffer = std::make_shared<ModelBuffer>();
+	buffer->data = copy;
+	buffer->size = size;
+	return buffer;
+}
+
+uint64_t hash_model_bytes(const ModelBuffer& buffer) {
+	const uint64_t prime = 0x100000001b3ULL;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	// Eight bytes per step, hashing a model file should not show up next to loading it.
+	size_t i = 0;
+	for (; i + 8 <= buffer.size; i += 8) {
+		uint64_t word;
+		memcpy(&word, buffer.data + i, 8);
+		hash = (hash ^ word) * prime;
+	}
+	for (; i < buffer.size; ++i) {
+		hash = (hash ^ buffer.data[i]) * prime;
+	}
+	return hash;
+}
@@ -0,0 +1,53 @@
+#ifndef MODEL_SOURCE_H
+#define MODEL_SOURCE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <string>
+
+// Read-only bytes of a model file, released with the last reference.
+struct ModelBuffer {
+	const unsigned char* data = nullptr;
+	size_t size = 0;
+	// Set when `data` is a file mapping rather than a heap copy.
+	bool mapped = false;
+	// Identity of the mapped file, so a file replaced on disk is mapped anew.
+	unsigned long long device = 0;
+	unsigned long long inode = 0;
+	long long modified = 0;
+
+	ModelBuffer() = default;
+	ModelBuffer(const ModelBuffer&) = delete;
+	ModelBuffer& operator=(const ModelBuffer&) = delete;
+	~ModelBuffer();
+};
+
+// Maps `path` read-only. The pages come from the OS file cache and are only
+// read in as the weights are touched, and every model loaded from the same
+// file shares one mapping while any of them is alive. Returns nullptr if the
+// file cannot be read.
+std::shared_ptr<const ModelBuffer> map_model_file(const std::string& path);
+
+// Copies `size` bytes handed over by the caller, followed by a NUL so text
+// formats can be parsed in place. Returns nullptr if `data` is NULL or empty.
+std::shared_ptr<const ModelBuffer> copy_model_bytes(const void* data, size_t size);
+
+// FNV-1a style 64-bit hash of the bytes, identifies a model in file caches.
+uint64_t hash_model_bytes(const ModelBuffer& buffer);
+
+// Where a model comes from: a path as given to yolo_create, or bytes the
+// caller already holds in memory.
+struct ModelSource {
+	// Empty for in-memory models.
+	std::string path;
+	// ncnn's .param text, unused by single-file formats.
+	std::shared_ptr<const ModelBuffer> param;
+	// ncnn's .bin weights, or the whole model for single-file formats.
+	std::shared_ptr<const ModelBuffer> weights;
+	// Where backends may keep what they derive from the model, such as ONNX
+	// Runtime's optimized graph, across app starts. Empty disables caching.
+	std::string cache_dir;
+};
+
+#endif  // MODEL_SOURCE_H
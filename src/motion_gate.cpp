@@ -0,0 +1,78 @@
+#include "motion_gate.h"
+#include <algorithm>
+#include <utility>
+#include "simd.h"
+
+// Thumbnail size. Each cell averages a grid of samples, which filters sensor
+// noise at a fraction of the cost of reading every pixel.
+static const int THUMB_W = 64;
+static const int THUMB_H = 48;
+static const int CELL_SAMPLES = 4;
+// Change is measured per block of BLOCK x BLOCK thumbnail pixels, a 8x6 grid,
+// so a small object moving through a still scene is not averaged away by the
+// rest of the frame. The thumbnail is stored block by block, each block's 64
+// bytes contiguous, so one block is a single SIMD SAD.
+static const int BLOCK = 8;
+static const int BLOCK_SIZE = BLOCK * BLOCK;
+
+static inline uint8_t luma_at(const FrameView& frame, int x, int y) {
+	const uint8_t* p = frame.planes[0] + static_cast<size_t>(y) * frame.row_strides[0] + x * frame.pixel_strides[0];
+	if (frame.layout == LAYOUT_RGBA || frame.layout == LAYOUT_BGRA) {
+		// (R + 2G + B) / 4 is close enough to luma for spotting change.
+		return static_cast<uint8_t>((p[0] + 2 * p[1] + p[2]) >> 2);
+	}
+	// The Y plane of camera frames is luma already.
+	return p[0];
+}
+
+// Averages CELL_SAMPLES x CELL_SAMPLES pixels per cell. Rotation does not
+// matter here, frames are only ever compared in the same orientation.
+static void make_thumbnail(const FrameView& frame, std::vector<uint8_t>& thumbnail) {
+	thumbnail.resize(THUMB_W * THUMB_H);
+	for (int ty = 0; ty < THUMB_H; ++ty) {
+		for (int tx = 0; tx < THUMB_W; ++tx) {
+			int sum = 0;
+			for (int sy = 0; sy < CELL_SAMPLES; ++sy) {
+				const int y = static_cast<int>((ty * CELL_SAMPLES + sy + 0.5f) * frame.height / (THUMB_H * CELL_SAMPLES));
+				for (int sx = 0; sx < CELL_SAMPLES; ++sx) {
+					const int x = static_cast<int>((tx * CELL_SAMPLES + sx + 0.5f) * frame.width / (THUMB_W * CELL_SAMPLES));
+					sum += luma_at(frame, x, y);
+				}
+			}
+			const int block = (ty / BLOCK) * (THUMB_W / BLOCK) + tx / BLOCK;
+			thumbnail[block * BLOCK_SIZE + (ty % BLOCK) * BLOCK + tx % BLOCK] = static_cast<uint8_t>(sum / (CELL_SAMPLES * CELL_SAMPLES));
+		}
+	}
+}
+
+// Mean absolute difference of the most changed block.
+static float block_change(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b) {
+	uint32_t largest = 0;
+	for (int offset = 0; offset < THUMB_W * THUMB_H; offset += BLOCK_SIZE) {
+		largest = std::max(largest, simd::sad_u8(a.data() + offset, b.data() + offset, BLOCK_SIZE));
+	}
+	return static_cast<float>(largest) / BLOCK_SIZE;
+}
+
+bool motion_gate_skip(MotionGate& gate, const FrameView& frame, bool rotate_cw, float conf_threshold, float nms_threshold, float threshold, int max_skipped) {
+	make_thumbnail(frame, gate.thumbnail);
+
+	const bool same_key = gate.valid && gate.width == frame.width && gate.height == frame.height && gate.rotate_cw == rotate_cw && gate.conf_threshold == conf_threshold && gate.nms_threshold == nms_threshold;
+	gate.last_change = same_key ? block_change(gate.thumbnail, gate.reference) : 0.f;
+	if (same_key && gate.last_change < threshold && (max_skipped <= 0 || gate.skipped_in_row < max_skipped)) {
+		++gate.skipped_in_row;
+		++gate.skipped;
+		return true;
+	}
+
+	std::swap(gate.reference, gate.thumbnail);
+	gate.valid = true;
+	gate.width = frame.width;
+	gate.height = frame.height;
+	gate.rotate_cw = rotate_cw;
+	gate.conf_threshold = conf_threshold;
+	gate.nms_threshold = nms_threshold;
+	gate.skipped_in_row = 0;
+	++gate.inferred;
+	return false;
+}
@@ -0,0 +1,36 @@
+#ifndef MOTION_GATE_H
+#define MOTION_GATE_H
+
+#include <stdint.h>
+#include <vector>
+#include "preprocess.h"
+
+// Decides whether a frame changed enough since the last detection to be worth
+// running the network on. Frames are reduced to a small luma thumbnail and
+// compared with the thumbnail of the frame the cached detections came from.
+struct MotionGate {
+	std::vector<uint8_t> reference;
+	std::vector<uint8_t> thumbnail;
+	// What the reference was detected with, any change forces a detection.
+	bool valid = false;
+	int width = 0;
+	int height = 0;
+	bool rotate_cw = false;
+	float conf_threshold = 0.f;
+	float nms_threshold = 0.f;
+	// Frames skipped since the reference was taken.
+	int skipped_in_row = 0;
+	// Counters reported by `get_motion_stats`.
+	int64_t inferred = 0;
+	int64_t skipped = 0;
+	float last_change = 0.f;
+};
+
+// Returns true if `frame` differs from the reference by less than
+// `threshold`, the mean absolute luma difference of the most changed block of
+// the thumbnail, and
+// fewer than `max_skipped` frames were skipped in a row (0 for no limit).
+// Otherwise the frame becomes the new reference and detection should run.
+bool motion_gate_skip(MotionGate& gate, const FrameView& frame, bool rotate_cw, float conf_threshold, float nms_threshold, float threshold, int max_skipped);
+
+#endif  // MOTION_GATE_H
@@ -1,60 +1,66 @@
 #include "ncnn_yolo.h"
-#include "yolo_ffi.h"
+#include <cstring>
+#include "yolo_backend.h"
 
-// Global pointer to the session container.
-static struct NcnnContainer* net_container = nullptr;
+// ncnn implementation of the backend used by yolo_handle.cpp.
+struct BackendModel {
+	NcnnContainer* container;
+};
 
-extern "C" {
-FFI_PLUGIN_EXPORT void load_model(const char* model_path) {
-	// If a model is already loaded, close it before loading a new one.
-	if (net_container) {
-		close_net(net_container);
+BackendModel* backend_open(const ModelSource& source, const yolo_options& options) {
+	NcnnContainer* container = create_net(source, &options);
+	if (!container) {
+		return nullptr;
 	}
-	net_container = create_net(model_path);
+	return new BackendModel{container};
 }
 
-FFI_PLUGIN_EXPORT DetectionResult yolo_detect(uint8_t* image_data, int height, int width, float conf_threshold, float nms_threshold) {
-	if (!net_container) {
-		return {nullptr, 0};
+void backend_close(BackendModel* model) {
+	if (model) {
+		close_net(model->container);
+		delete model;
 	}
+}
 
-	// Create a cv::Mat from the raw image data without copying.
-	// The data is expected to be in RGBA format.
-	cv::Mat image(height, width, CV_8UC4, image_data);
-	// on Android need to rotate 90 clockwise from raw camera data
-	// cv::rotate(image, image, cv::ROTATE_90_CLOCKWISE);
+bool backend_has_options(BackendModel* model) {
+	return true;
+}
 
-	std::vector<Detection> detections = run_ncnn(net_container, image, conf_threshold, nms_threshold);
+void backend_detect(BackendModel* model, cv::InputArray image, float conf_threshold, float nms_threshold, const DetectSettings& settings, std::vector<Detection>& detections) {
+	run_ncnn(model->container, image, conf_threshold, nms_threshold, settings, detections);
+}
 
-	int num_detections = detections.size();
-	if (num_detections == 0) {
-		return {nullptr, 0};
-	}
+void backend_detect_frame(BackendModel* model, const FrameView& frame, bool rotate_cw, float conf_threshold, float nms_threshold, const DetectSettings& settings, std::vector<Detection>& detections) {
+	run_ncnn(model->container, frame, rotate_cw, conf_threshold, nms_threshold, settings, detections);
+}
 
-	// Allocate memory for the flat array of detection results.
-	// Each detection has 6 floats: [x, y, w, h, class_id, conf]
-	float* const bboxes = new float[num_detections * 6];
-
-	for (int i = 0; i < num_detections; ++i) {
-		bboxes[i * 6 + 0] = detections[i].box.x;
-		bboxes[i * 6 + 1] = detections[i].box.y;
-		bboxes[i * 6 + 2] = detections[i].box.br().x;
-		bboxes[i * 6 + 3] = detections[i].box.br().y;
-		bboxes[i * 6 + 4] = static_cast<float>(detections[i].class_id);
-		bboxes[i * 6 + 5] = detections[i].confidence;
-	}
+std::vector<std::vector<Detection>> backend_detect_batch(BackendModel* model, const std::vector<cv::Mat>& images, float conf_threshold, float nms_threshold, const DetectSettings& settings) {
+	return run_ncnn_batch(model->container, images, conf_threshold, nms_threshold, settings);
+}
 
-	return {bboxes, num_detections};
+ModelInput backend_model_input(BackendModel* model) {
+	return {model->container->input_w, model->container->input_h, true};
 }
 
-FFI_PLUGIN_EXPORT void close_model() {
-	if (net_container) {
-		close_net(net_container);
-		net_container = nullptr;
-	}
+const char* backend_input_name(BackendModel* model) {
+	const std::string& name = model->container->input_name;
+	char* name_copy = new char[name.size() + 1];
+	memcpy(name_copy, name.c_str(), name.size() + 1);
+	return name_copy;
+}
+
+bool backend_has_stages(BackendModel* model) {
+	return true;
+}
+
+InputGeometry backend_input_geometry(BackendModel* model, int image_w, int image_h, ResizeMode mode, int input_size) {
+	return input_geometry(model->container, image_w, image_h, mode, input_size);
+}
+
+bool backend_infer(BackendModel* model, float* input, const InputGeometry& geometry, std::vector<float>& output, int& num_channels, int& num_anchors, int& num_masks) {
+	return infer_ncnn(model->container, input, geometry, output, num_channels, num_anchors, num_masks);
 }
 
-const char* get_model_input_name() {
-	return nullptr;
+bool backend_classify(BackendModel* model, float* input, int count, int size, std::vector<float>& scores, int& num_classes) {
+	return classify_ncnn(model->container, input, count, size, scores, num_classes);
 }
-}
\ No newline at end of file
@@ -1,149 +1,397 @@
 #include "ncnn_yolo.h"
-#include <chrono>
-#include <opencv2/dnn.hpp>
+#include <algorithm>
+#include <cstring>
+#include <datareader.h>
+#include "postprocess.h"
 #include "print.h"
+#include "yolo_stats.h"
+
+// Fills `cpus` with the selected cores and returns how many there are, 0 if
+// ncnn should keep its default thread count.
+static int select_cpus(const yolo_options& options, ncnn::CpuSet& cpus) {
+	if (options.cpu_affinity == CPU_AFFINITY_MASK) {
+		cpus.disable_all();
+		for (int i = 0; i < 64; ++i) {
+			if (options.cpu_mask >> i & 1) {
+				cpus.enable(i);
+			}
+		}
+		return cpus.num_enabled();
+	}
+
+	// Same values as ncnn's powersave modes: 0 all, 1 little, 2 big cores.
+	cpus = ncnn::get_cpu_thread_affinity_mask(options.cpu_affinity);
+	if (options.cpu_affinity == CPU_AFFINITY_LITTLE) {
+		return ncnn::get_little_cpu_count();
+	}
+	return options.cpu_affinity == CPU_AFFINITY_BIG ? ncnn::get_big_cpu_count() : 0;
+}
+
+// Pins the calling thread and the OpenMP threads it runs layers on to the
+// model's cores. ncnn keeps affinity per thread, so this runs on whichever
+// thread is about to infer, and is skipped when it already has the mask.
+static void pin_inference_threads(const NcnnContainer* container) {
+	thread_local ncnn::CpuSet pinned;
+	thread_local bool has_pinned = false;
+	if (has_pinned) {
+		bool same = true;
+		for (int i = 0; i < ncnn::get_cpu_count() && same; ++i) {
+			same = pinned.is_enabled(i) == container->cpus.is_enabled(i);
+		}
+		if (same) {
+			return;
+		}
+	}
+	ncnn::set_cpu_thread_affinity(container->cpus);
+	pinned = container->cpus;
+	has_pinned = true;
+}
+
+static void apply_options(ncnn::Option& opt, const yolo_options& options, ncnn::CpuSet& cpus) {
+	int selected_cpus = select_cpus(options, cpus);
+	if (options.num_threads > 0) {
+		opt.num_threads = options.num_threads;
+	} else if (selected_cpus > 0) {
+		opt.num_threads = selected_cpus;
+	}
+	// 0 makes idle OpenMP threads sleep right away instead of spinning 20 ms.
+	opt.openmp_blocktime = options.spin_wait ? 20 : 0;
+	opt.use_winograd_convolution = options.use_winograd;
+	opt.use_sgemm_convolution = options.use_sgemm;
+	// fp16 paths are only taken on CPUs that support them.
+	opt.use_fp16_packed = options.use_fp16;
+	opt.use_fp16_storage = options.use_fp16;
+	opt.use_fp16_arithmetic = options.use_fp16;
+	opt.use_bf16_storage = options.use_bf16;
+	opt.use_int8_inference = options.use_int8;
+	opt.use_int8_packed = options.use_int8;
+	opt.use_int8_storage = options.use_int8;
+}
+
+// Input size of models that do not say.
+static const int DEFAULT_INPUT_SIZE = 640;
+// Inputs are resized to multiples of the largest YOLO stride.
+static const int INPUT_STRIDE = 32;
 
 // Creates and returns a new NCNN container.
 // It is the caller's responsibility to call close_net on the returned pointer.
-NcnnContainer* create_net(const char* model_stem) {
+NcnnContainer* create_net(const ModelSource& source, const yolo_options* options) {
+	std::shared_ptr<const ModelBuffer> param = source.param;
+	std::shared_ptr<const ModelBuffer> weights = source.weights;
+	if (!source.path.empty()) {
+		// The .param text is small and parsed as a C string, so it is copied
+		// with a terminating NUL. Only the weights are worth sharing.
+		std::shared_ptr<const ModelBuffer> param_file = map_model_file(source.path + ".param");
+		param = param_file ? copy_model_bytes(param_file->data, param_file->size) : nullptr;
+		weights = map_model_file(source.path + ".bin");
+	}
+	if (!param || !weights) {
+		log_message(YOLO_LOG_ERROR, "Failed to load NCNN model, both the param and the bin are needed.");
+		return nullptr;
+	}
+
 	auto* container = new NcnnContainer;
 	container->net = new ncnn::Net();
-	// container->net->opt.num_threads = 4;
+	// Recycle blob and workspace memory instead of going back to the heap every frame.
+	container->net->opt.blob_allocator = &container->blob_allocator;
+	container->net->opt.workspace_allocator = &container->workspace_allocator;
+	yolo_options defaults = yolo_default_options();
+	apply_options(container->net->opt, options ? *options : defaults, container->cpus);
 	container->net->opt.use_packing_layout = true;
-	container->net->opt.use_bf16_storage = true;
-	// container->net->opt.use_winograd_convolution = true;
-	// container->net->opt.use_sgemm_convolution = true;
-	// container->net->opt.use_fp16_storage = true;
 
 	// container->net->opt.use_vulkan_compute = true;
-	// container->net->opt.use_fp16_packed = true;
-	// container->net->opt.use_fp16_arithmetic = true;  // 如果设备支持 FP16
 
-	char param_path[512];
-	char bin_path[512];
-	snprintf(param_path, sizeof(param_path), "%s.param", model_stem);
-	snprintf(bin_path, sizeof(bin_path), "%s.bin", model_stem);
-
-	// Load the NCNN model
-	if (container->net->load_param(param_path) != 0) {
+	// Load the NCNN model. Weights that layers use as stored are referenced
+	// in the buffer instead of copied, so it has to outlive the net.
+	const unsigned char* param_data = param->data;
+	const unsigned char* weights_data = weights->data;
+	if (container->net->load_param(ncnn::DataReaderFromMemory(param_data)) != 0) {
 		delete container->net;
 		delete container;
-		print_message("Failed to load NCNN param file.");
+		log_message(YOLO_LOG_ERROR, "Failed to load NCNN param file.");
 		return nullptr;
 	}
-	if (container->net->load_model(bin_path) != 0) {
+	if (container->net->load_model(ncnn::DataReaderFromMemory(weights_data)) != 0) {
 		delete container->net;
 		delete container;
-		print_message("Failed to load NCNN bin file.");
+		log_message(YOLO_LOG_ERROR, "Failed to load NCNN bin file.");
 		return nullptr;
 	}
+	container->weights = weights;
 
-	return container;
-}
-
-std::vector<Detection> run_ncnn(NcnnContainer* container, cv::InputArray image, float conf_threshold, float nms_threshold) {
-	if (!container || !container->net) {
-		return {};
+	// Blob names depend on the converter (pnnx writes in0 and out0), so take
+	// the net's first input and output.
+	if (container->net->input_indexes().empty() || container->net->output_indexes().empty()) {
+		close_net(container);
+		log_message(YOLO_LOG_ERROR, "NCNN model has no input or output blob.");
+		return nullptr;
 	}
+	container->input_blob = container->net->input_indexes()[0];
+	container->output_blob = container->net->output_indexes()[0];
+	// YOLO-seg exports put the prototypes after the detection head.
+	container->proto_blob = container->net->output_indexes().size() > 1 ? container->net->output_indexes()[1] : -1;
+	container->mask_count = -1;
+	container->input_name = container->net->input_names()[0];
+	// Optimized params may carry the input shape as a hint; the network
+	// itself accepts any multiple of the stride, so 640 is only the default.
+	const ncnn::Mat& shape = container->net->blobs()[container->input_blob].shape;
+	container->input_w = shape.dims == 3 && shape.w > 0 ? shape.w : DEFAULT_INPUT_SIZE;
+	container->input_h = shape.dims == 3 && shape.h > 0 ? shape.h : DEFAULT_INPUT_SIZE;
 
-	using namespace std::chrono;
-	const int INPUT_WIDTH = 640;
-	const int INPUT_HEIGHT = 640;
-
-	// Preprocessing
-	auto tic = high_resolution_clock::now();
+	return container;
+}
 
-	cv::Mat img = image.getMat();
-	ncnn::Mat in = ncnn::Mat::from_pixels_resize(img.data, ncnn::Mat::PIXEL_RGBA2RGB, img.cols, img.rows, INPUT_WIDTH, INPUT_HEIGHT);
+NcnnContainer* create_net(const char* model_stem, const yolo_options* options) {
+	ModelSource source;
+	source.path = model_stem ? model_stem : "";
+	return create_net(source, options);
+}
 
-	const float mean_vals[3] = {0, 0, 0};
-	const float norm_vals[3] = {1 / 255.f, 1 / 255.f, 1 / 255.f};
-	in.substract_mean_normalize(mean_vals, norm_vals);
+// Chooses the input size and the placement of an image of the given size.
+InputGeometry input_geometry(NcnnContainer* container, int image_w, int image_h, ResizeMode mode, int input_size) {
+	return model_input_geometry(image_w, image_h, mode, container->input_w, container->input_h, input_size, INPUT_STRIDE, true);
+}
 
-	auto toc = high_resolution_clock::now();
-	auto pre_elapsed = duration_cast<milliseconds>(toc - tic);
+// Prototypes of segmentation models for postprocess_output, nullptr for
+// detection models. The prototype branch only runs when masks are wanted, or
+// once to learn how many of the head's channels are mask coefficients.
+static const MaskPrototypes* extract_protos(NcnnContainer* container, ncnn::Extractor& ex, bool masks, ncnn::Mat& mat, MaskPrototypes& protos) {
+	if (container->proto_blob < 0) {
+		return nullptr;
+	}
+	protos = MaskPrototypes();
+	if (masks || container->mask_count < 0) {
+		if (ex.extract(container->proto_blob, mat) != 0 || mat.dims != 3) {
+			log_message(YOLO_LOG_ERROR, "NCNN model has a second output, but no mask prototypes in it.");
+			container->proto_blob = -1;
+			return nullptr;
+		}
+		container->mask_count = mat.c;
+		protos.data = (const float*)mat.data;
+		protos.width = mat.w;
+		protos.height = mat.h;
+		protos.plane_stride = mat.cstep;
+	}
+	protos.count = container->mask_count;
+	return &protos;
+}
 
+// Runs the network on the normalized CHW input in `container->input`, decodes
+// the output and records the frame, whose preprocessing is already in `stats`.
+// A failed extraction leaves `detections` empty and records nothing, the
+// output Mat still holds the previous frame's head.
+static void infer_and_decode(NcnnContainer* container, const InputGeometry& geometry, float conf_threshold, float nms_threshold, const DetectSettings& settings, std::vector<Detection>& detections, YoloFrameStats& stats) {
 	// Inference
-	tic = high_resolution_clock::now();
+	int64_t tic = stats_now_ns();
+	pin_inference_threads(container);
 	ncnn::Extractor ex = container->net->create_extractor();
-	ex.input("in0", in);
-	ncnn::Mat out;
-	ex.extract("out0", out);
-	toc = high_resolution_clock::now();
-	auto infer_elapsed = duration_cast<milliseconds>(toc - tic);
+	ex.input(container->input_blob, container->input);
+	if (ex.extract(container->output_blob, container->output) != 0) {
+		log_message(YOLO_LOG_ERROR, "NCNN inference failed.");
+		detections.clear();
+		return;
+	}
+	MaskPrototypes protos;
+	const MaskPrototypes* seg_protos = extract_protos(container, ex, settings.masks, container->protos, protos);
+	stats.stage_ns[YOLO_STAGE_INFERENCE] = stats_now_ns() - tic;
 
 	// Post-processing
-	tic = high_resolution_clock::now();
-
+	const ncnn::Mat& out = container->output;
 	int num_detections = out.w;
 	int num_classes = out.h;
-	// Output shape should be [1, 84, N]
+	// Output shape should be [1, 84, N], or [1, 300, 6] for end-to-end models
 	// char out_shape[128];
 	// sprintf(out_shape, "output shape: [%d, %d, %d]", out.d, out.h, out.w);
 	// print_message(out_shape);
 	auto raw_output = (const float*)((unsigned char*)out.data);
+	postprocess_output(raw_output, num_classes, num_detections, geometry, conf_threshold, nms_threshold, settings, container->scratch, detections, &stats, seg_protos);
 
-	std::vector<cv::Rect> boxes;
-	std::vector<float> confidences;
-	std::vector<int> class_ids;
-
-	for (int i = 0; i < num_detections; ++i) {
-		const float* detection = raw_output + i;
-		const float* class_scores = detection + 4 * num_detections;
-
-		int class_id = -1;
-		float max_score = 0.0f;
-		for (int j = 0; j < num_classes - 4; ++j) {
-			int idx = j * num_detections;
-			if (class_scores[idx] > max_score) {
-				max_score = class_scores[idx];
-				class_id = j;
-			}
-		}
+	stats.stage_ns[YOLO_STAGE_TOTAL] = stats_now_ns() - stats.timestamp_ns;
+	stats_record(stats);
+}
 
-		if (max_score > conf_threshold) {
-			float cx = detection[0 * num_detections];
-			float cy = detection[1 * num_detections];
-			float w = detection[2 * num_detections];
-			float h = detection[3 * num_detections];
+// Resizes (and letterboxes) an RGBA image into `in`, which keeps its buffer
+// when the input size does not change.
+static void preprocess_image(const cv::Mat& img, const InputGeometry& geometry, ncnn::Mat& in) {
+	in.create(geometry.input_w, geometry.input_h, 3);
+	preprocess_frame(make_rgba_view(img.data, img.cols, img.rows, static_cast<int>(img.step)), false, geometry, (float*)in.data, in.cstep);
+}
 
-			int left = static_cast<int>(std::round(cx - 0.5 * w));
-			int top = static_cast<int>(std::round(cy - 0.5 * h));
-			int width = static_cast<int>(std::round(w));
-			int height = static_cast<int>(std::round(h));
+void run_ncnn(NcnnContainer* container, cv::InputArray image, float conf_threshold, float nms_threshold, const DetectSettings& settings, std::vector<Detection>& detections) {
+	detections.clear();
+	if (!container || !container->net) {
+		return;
+	}
 
-			boxes.emplace_back(left, top, width, height);
-			confidences.emplace_back(max_score);
-			class_ids.emplace_back(class_id);
-		}
+	// Preprocessing
+	YoloFrameStats stats{};
+	stats.timestamp_ns = stats_now_ns();
+
+	cv::Mat img = image.getMat();
+	InputGeometry geometry = input_geometry(container, img.cols, img.rows, settings.resize_mode, settings.input_size);
+	preprocess_image(img, geometry, container->input);
+
+	stats.stage_ns[YOLO_STAGE_PREPROCESS] = stats_now_ns() - stats.timestamp_ns;
+	infer_and_decode(container, geometry, conf_threshold, nms_threshold, settings, detections, stats);
+}
+
+void run_ncnn(NcnnContainer* container, const FrameView& frame, bool rotate_cw, float conf_threshold, float nms_threshold, const DetectSettings& settings, std::vector<Detection>& detections) {
+	detections.clear();
+	if (!container || !container->net) {
+		return;
 	}
 
-	std::vector<int> nms_indices;
-	cv::dnn::NMSBoxes(boxes, confidences, conf_threshold, nms_threshold, nms_indices);
+	// Preprocessing straight from the camera planes into the input blob.
+	YoloFrameStats stats{};
+	stats.timestamp_ns = stats_now_ns();
+
+	int image_w = rotate_cw ? frame.height : frame.width;
+	int image_h = rotate_cw ? frame.width : frame.height;
+	InputGeometry geometry = input_geometry(container, image_w, image_h, settings.resize_mode, settings.input_size);
+	container->input.create(geometry.input_w, geometry.input_h, 3);
+	preprocess_frame(frame, rotate_cw, geometry, (float*)container->input.data, container->input.cstep);
+
+	stats.stage_ns[YOLO_STAGE_PREPROCESS] = stats_now_ns() - stats.timestamp_ns;
+	infer_and_decode(container, geometry, conf_threshold, nms_threshold, settings, detections, stats);
+}
 
-	std::vector<Detection> detections;
-	for (int idx : nms_indices) {
-		Detection result;
-		result.box = boxes[idx];
-		result.confidence = confidences[idx];
-		result.class_id = class_ids[idx];
-		detections.push_back(result);
+bool infer_ncnn(NcnnContainer* container, float* input, const InputGeometry& geometry, std::vector<float>& output, int& num_channels, int& num_anchors, int& num_masks) {
+	if (!container || !container->net) {
+		return false;
 	}
 
-	toc = high_resolution_clock::now();
-	auto post_elapsed = duration_cast<milliseconds>(toc - tic);
+	// Input sizes are multiples of 32, so the planes need no extra alignment.
+	ncnn::Mat in(geometry.input_w, geometry.input_h, 3, input, 4u);
+	pin_inference_threads(container);
+	ncnn::Extractor ex = container->net->create_extractor();
+	ex.input(container->input_blob, in);
+	ncnn::Mat out;
+	if (ex.extract(container->output_blob, out) != 0) {
+		return false;
+	}
 
-	char buffer[1024];
-	auto total = pre_elapsed + infer_elapsed + post_elapsed;
-	sprintf(buffer, "Elapsed Time(%lld ms): preprocess: %lld ms, inference: %lld ms, postprocess: %lld ms", total.count(), pre_elapsed.count(), infer_elapsed.count(), post_elapsed.count());
-	print_message(buffer);
+	num_anchors = out.w;
+	num_channels = out.h;
+	ncnn::Mat proto_mat;
+	MaskPrototypes protos;
+	num_masks = extract_protos(container, ex, false, proto_mat, protos) ? protos.count : 0;
+	const float* raw_output = (const float*)out.data;
+	output.assign(raw_output, raw_output + static_cast<size_t>(num_channels) * num_anchors);
+	return true;
+}
+
+bool classify_ncnn(NcnnContainer* container, float* input, int count, int size, std::vector<float>& scores, int& num_classes) {
+	if (!container || !container->net) {
+		return false;
+	}
+
+	const size_t plane_size = static_cast<size_t>(size) * size;
+	num_classes = 0;
+	pin_inference_threads(container);
+	// ncnn has no batch dimension, the crops run one after another on the
+	// same net, each spread over its threads.
+	for (int i = 0; i < count; ++i) {
+		float* crop = input + i * 3 * plane_size;
+		ncnn::Mat in;
+		if (plane_size % 4 == 0) {
+			// Planes already sit on the 16 byte boundaries ncnn pads channels to.
+			in = ncnn::Mat(size, size, 3, crop, 4u);
+		} else {
+			container->input.create(size, size, 3);
+			for (int c = 0; c < 3; ++c) {
+				memcpy(container->input.channel(c), crop + c * plane_size, plane_size * sizeof(float));
+			}
+			in = container->input;
+		}
+		ncnn::Extractor ex = container->net->create_extractor();
+		ex.input(container->input_blob, in);
+		if (ex.extract(container->output_blob, container->output) != 0) {
+			return false;
+		}
+		const int classes = static_cast<int>(container->output.total());
+		if (i == 0) {
+			num_classes = classes;
+			scores.resize(static_cast<size_t>(count) * num_classes);
+		} else if (classes != num_classes) {
+			return false;
+		}
+		memcpy(scores.data() + static_cast<size_t>(i) * num_classes, container->output.data, num_classes * sizeof(float));
+	}
+	return true;
+}
+
+std::vector<std::vector<Detection>> run_ncnn_batch(NcnnContainer* container, const std::vector<cv::Mat>& images, float conf_threshold, float nms_threshold, const DetectSettings& settings) {
+	std::vector<std::vector<Detection>> results(images.size());
+	if (!container || !container->net) {
+		return results;
+	}
+
+	const int count = static_cast<int>(images.size());
+	const int batch_size = std::max(settings.batch_size, 1);
+	std::vector<InputGeometry> geometries(batch_size);
+	std::vector<ncnn::Mat> inputs(batch_size);
+	std::vector<ncnn::Mat> outputs(batch_size);
+	std::vector<ncnn::Mat> proto_mats(batch_size);
+	std::vector<MaskPrototypes> protos(batch_size);
+	std::vector<const MaskPrototypes*> seg_protos(batch_size);
+	// Frames whose extraction failed keep no detections.
+	std::vector<char> extracted(batch_size);
+
+	for (int start = 0; start < count; start += batch_size) {
+		const int n = std::min(batch_size, count - start);
+
+		// Frames are independent, so preprocess them on all cores.
+		const int64_t tic = stats_now_ns();
+		cv::parallel_for_(cv::Range(0, n), [&](const cv::Range& range) {
+			for (int i = range.start; i < range.end; ++i) {
+				const cv::Mat& img = images[start + i];
+				geometries[i] = input_geometry(container, img.cols, img.rows, settings.resize_mode, settings.input_size);
+				preprocess_image(img, geometries[i], inputs[i]);
+			}
+		});
+		const int64_t preprocessed = stats_now_ns();
+
+		// ncnn has no batch dimension, the net already spreads each frame over its threads.
+		pin_inference_threads(container);
+		for (int i = 0; i < n; ++i) {
+			ncnn::Extractor ex = container->net->create_extractor();
+			ex.input(container->input_blob, inputs[i]);
+			extracted[i] = ex.extract(container->output_blob, outputs[i]) == 0;
+			if (!extracted[i]) {
+				log_message(YOLO_LOG_ERROR, "NCNN inference failed.");
+				continue;
+			}
+			seg_protos[i] = extract_protos(container, ex, settings.masks, proto_mats[i], protos[i]);
+		}
+		const int64_t inferred = stats_now_ns();
+
+		cv::parallel_for_(cv::Range(0, n), [&](const cv::Range& range) {
+			PostprocessScratch scratch;
+			for (int i = range.start; i < range.end; ++i) {
+				if (!extracted[i]) {
+					continue;
+				}
+				YoloFrameStats stats{};
+				stats.timestamp_ns = tic;
+				stats.stage_ns[YOLO_STAGE_PREPROCESS] = (preprocessed - tic) / n;
+				stats.stage_ns[YOLO_STAGE_INFERENCE] = (inferred - preprocessed) / n;
+				postprocess_output((const float*)outputs[i].data, outputs[i].h, outputs[i].w, geometries[i], conf_threshold, nms_threshold, settings, scratch, results[start + i], &stats, seg_protos[i]);
+				stats.stage_ns[YOLO_STAGE_TOTAL] = stats.stage_ns[YOLO_STAGE_PREPROCESS] + stats.stage_ns[YOLO_STAGE_INFERENCE] + stats.stage_ns[YOLO_STAGE_DECODE] + stats.stage_ns[YOLO_STAGE_NMS] + stats.stage_ns[YOLO_STAGE_MASK];
+				stats_record(stats);
+			}
+		});
+	}
 
-	return detections;
+	return results;
 }
 
 // Closes the ncnn net and frees the container.
 void close_net(NcnnContainer* container) {
 	if (container) {
+		// Blobs have to go back to the pools before they are destroyed.
+		container->input.release();
+		container->output.release();
+		container->protos.release();
 		delete container->net;
 		delete container;
 	}
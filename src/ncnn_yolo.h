@@ -1,25 +1,78 @@
 #ifndef NCNN_YOLO_H
 #define NCNN_YOLO_H
 
+#include <cpu.h>
 #include <net.h>
 #include <opencv2/core.hpp>
+#include <string>
 #include <vector>
+#include "detect_settings.h"
+#include "detection.h"
+#include "model_source.h"
+#include "postprocess.h"
+#include "preprocess.h"
 
 struct NcnnContainer {
 	ncnn::Net* net;
+	// Weights the net may reference in place, kept alive as long as the net.
+	std::shared_ptr<const ModelBuffer> weights;
+	// First input and output of the net, read from the param.
+	int input_blob;
+	int output_blob;
+	// Second output of segmentation models, the mask prototypes, -1 without.
+	int proto_blob;
+	// Prototype planes, learned from the first extraction, -1 before it.
+	int mask_count;
+	std::string input_name;
+	// Input size from the param's shape hints, 640x640 without them.
+	int input_w;
+	int input_h;
+	// Cores the inference threads run on, from `cpu_affinity`.
+	ncnn::CpuSet cpus;
+	// Blobs are only extracted from one thread at a time, workspace memory is
+	// shared by the net's worker threads.
+	ncnn::UnlockedPoolAllocator blob_allocator;
+	ncnn::PoolAllocator workspace_allocator;
+	ncnn::Mat input;
+	ncnn::Mat output;
+	ncnn::Mat protos;
+	PostprocessScratch scratch;
 };
 
-struct Detection {
-	cv::Rect box;
-	int class_id;
-	float confidence;
-};
+// Detects on an RGBA image, `detections` is overwritten.
+void run_ncnn(NcnnContainer* container, cv::InputArray image, float conf_threshold, float nms_threshold, const DetectSettings& settings, std::vector<Detection>& detections);
+
+// Detects on camera planes, rotating them 90 degrees clockwise first if asked.
+void run_ncnn(NcnnContainer* container, const FrameView& frame, bool rotate_cw, float conf_threshold, float nms_threshold, const DetectSettings& settings, std::vector<Detection>& detections);
+
+// Detects on several RGBA images, `settings.batch_size` at a time. Returns one
+// list of detections per image, in order.
+std::vector<std::vector<Detection>>
+run_ncnn_batch(NcnnContainer* container, const std::vector<cv::Mat>& images, float conf_threshold, float nms_threshold, const DetectSettings& settings = DetectSettings());
+
+// Runs a classification net on `count` crops packed as [count, 3, size, size]
+// and copies the [count, classes] scores to `scores`.
+bool classify_ncnn(NcnnContainer* container, float* input, int count, int size, std::vector<float>& scores, int& num_classes);
+
+// MARK: - Stages of run_ncnn, used by the async pipeline
+
+// Chooses the input size and the placement of an image of the given size,
+// `input_size` on the long side (0 for the model's own size).
+InputGeometry input_geometry(NcnnContainer* container, int image_w, int image_h, ResizeMode mode, int input_size);
+
+// Runs the net on three planes of `input_w x input_h` normalized floats and
+// copies the raw [channels, anchors] head to `output`. `num_masks` of the
+// channels are mask coefficients of a segmentation model.
+bool infer_ncnn(NcnnContainer* container, float* input, const InputGeometry& geometry, std::vector<float>& output, int& num_channels, int& num_anchors, int& num_masks);
 
-std::vector<Detection>
-run_ncnn(NcnnContainer* container, cv::InputArray image, float conf_threshold, float nms_threshold);
+// Loads `source.path` + .param/.bin through a shared read-only mapping, or
+// the in-memory `source.param` and `source.weights`. `options` may be NULL to
+// use the defaults.
+NcnnContainer* create_net(const ModelSource& source, const yolo_options* options);
 
 extern "C" {
-struct NcnnContainer* create_net(const char* model_path);
+// `options` may be NULL to use the defaults.
+struct NcnnContainer* create_net(const char* model_path, const yolo_options* options);
 void close_net(NcnnContainer* container);
 }
 
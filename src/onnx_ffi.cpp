@@ -1,61 +1,62 @@
 #include "onnx_yolo.h"
-#include "yolo_ffi.h"
+#include "yolo_backend.h"
 
-// Global pointer to the session container.
-static struct OrtSessionContainer* session_container = nullptr;
+// ONNX Runtime implementation of the backend used by yolo_handle.cpp.
+struct BackendModel {
+	OrtSessionContainer* container;
+};
 
-extern "C" {
-FFI_PLUGIN_EXPORT void load_model(const char* model_path) {
-	// If a model is already loaded, close it before loading a new one.
-	if (session_container) {
-		close_session(session_container);
+BackendModel* backend_open(const ModelSource& source, const yolo_options& options) {
+	OrtSessionContainer* container = create_session(source, &options);
+	if (!container) {
+		return nullptr;
 	}
-	session_container = create_session(model_path);
+	return new BackendModel{container};
 }
 
-FFI_PLUGIN_EXPORT DetectionResult yolo_detect(uint8_t* image_data, int height, int width, float conf_threshold, float nms_threshold) {
-	if (!session_container) {
-		return {nullptr, 0};
+void backend_close(BackendModel* model) {
+	if (model) {
+		close_session(model->container);
+		delete model;
 	}
+}
 
-	// Create a cv::Mat from the raw image data without copying.
-	// The data is expected to be in RGBA format.
-	cv::Mat image(height, width, CV_8UC4, image_data);
+bool backend_has_options(BackendModel* model) {
+	return true;
+}
 
-	std::vector<Detection> detections = run_inference(session_container, image, conf_threshold, nms_threshold);
+void backend_detect(BackendModel* model, cv::InputArray image, float conf_threshold, float nms_threshold, const DetectSettings& settings, std::vector<Detection>& detections) {
+	run_inference(model->container, image, conf_threshold, nms_threshold, settings, detections);
+}
 
-	int num_detections = detections.size();
-	if (num_detections == 0) {
-		return {nullptr, 0};
-	}
+void backend_detect_frame(BackendModel* model, const FrameView& frame, bool rotate_cw, float conf_threshold, float nms_threshold, const DetectSettings& settings, std::vector<Detection>& detections) {
+	run_inference(model->container, frame, rotate_cw, conf_threshold, nms_threshold, settings, detections);
+}
 
-	// Allocate memory for the flat array of detection results.
-	// Each detection has 6 floats: [x, y, w, h, class_id, conf]
-	float* const bboxes = new float[num_detections * 6];
-
-	for (int i = 0; i < num_detections; ++i) {
-		bboxes[i * 6 + 0] = detections[i].box.x;
-		bboxes[i * 6 + 1] = detections[i].box.y;
-		bboxes[i * 6 + 2] = detections[i].box.br().x;
-		bboxes[i * 6 + 3] = detections[i].box.br().y;
-		bboxes[i * 6 + 4] = static_cast<float>(detections[i].class_id);
-		bboxes[i * 6 + 5] = detections[i].confidence;
-	}
+std::vector<std::vector<Detection>> backend_detect_batch(BackendModel* model, const std::vector<cv::Mat>& images, float conf_threshold, float nms_threshold, const DetectSettings& settings) {
+	return run_inference_batch(model->container, images, conf_threshold, nms_threshold, settings);
+}
 
-	return {bboxes, num_detections};
+ModelInput backend_model_input(BackendModel* model) {
+	return {model->container->input_w, model->container->input_h, model->container->dynamic_input};
 }
 
-const char* get_model_input_name() {
-	if (session_container) {
-		return get_input_name(session_container);
-	}
-	return nullptr;
+const char* backend_input_name(BackendModel* model) {
+	return get_input_name(model->container);
 }
 
-FFI_PLUGIN_EXPORT void close_model() {
-	if (session_container) {
-		close_session(session_container);
-		session_container = nullptr;
-	}
+bool backend_has_stages(BackendModel* model) {
+	return true;
+}
+
+InputGeometry backend_input_geometry(BackendModel* model, int image_w, int image_h, ResizeMode mode, int input_size) {
+	return input_geometry(model->container, image_w, image_h, mode, input_size);
+}
+
+bool backend_infer(BackendModel* model, float* input, const InputGeometry& geometry, std::vector<float>& output, int& num_channels, int& num_anchors, int& num_masks) {
+	return infer_session(model->container, input, geometry, output, num_channels, num_anchors, num_masks);
+}
+
+bool backend_classify(BackendModel* model, float* input, int count, int size, std::vector<float>& scores, int& num_classes) {
+	return classify_session(model->container, input, count, size, scores, num_classes);
 }
-}
\ No newline at end of file
@@ -1,23 +1,144 @@
 #include "onnx_yolo.h"
-#include <chrono>
+#include <algorithm>
+#include <cstdio>
 #include <cstring>  // For strlen and strcpy
-#include <opencv2/dnn.hpp>
 #include <vector>
+#include "postprocess.h"
 #include "print.h"
 #include "yolo_ffi.h"
+#include "yolo_stats.h"
+#include <onnxruntime_session_options_config_keys.h>
+#include <string>
 #if __ANDROID__
 #include <nnapi_provider_factory.h>
-#include <onnxruntime_session_options_config_keys.h>
 #endif
 
+// Binds `data` as the [1, 3, h, w] input, unless it is bound already. A new
+// input size also unbinds the output, whose shape follows from the input.
+static void bind_input(OrtSessionContainer* container, float* data, int input_w, int input_h) {
+	if (container->bound_input == data && container->bound_w == input_w && container->bound_h == input_h) {
+		return;
+	}
+	if (container->bound_w != input_w || container->bound_h != input_h) {
+		container->binding->BindOutput(container->output_name.c_str(), container->memory_info);
+		container->output_bound = false;
+	}
+
+	const int64_t input_shape[4] = {1, 3, input_h, input_w};
+	container->input_tensor = Ort::Value::CreateTensor<float>(container->memory_info, data, static_cast<size_t>(3) * input_h * input_w, input_shape, 4);
+	container->binding->BindInput(container->input_name.c_str(), container->input_tensor);
+	container->bound_input = data;
+	container->bound_w = input_w;
+	container->bound_h = input_h;
+}
+
+// Binds `container->output`, already sized for `shape`, as the output tensor.
+static void bind_output(OrtSessionContainer* container, const std::vector<int64_t>& shape) {
+	container->output_shape = shape;
+	container->output_tensor = Ort::Value::CreateTensor<float>(container->memory_info, container->output.data(), container->output.size(), container->output_shape.data(), container->output_shape.size());
+	container->binding->BindOutput(container->output_name.c_str(), container->output_tensor);
+	container->output_bound = true;
+}
+
+// Runs the bound input and returns the [channels, anchors] head. The first run
+// at a new input size lets ORT allocate the output, later runs reuse `container->output`.
+static const float* run_bound(OrtSessionContainer* container, int& num_channels, int& num_anchors) {
+	container->session->Run(Ort::RunOptions{nullptr}, *container->binding);
+
+	if (!container->output_bound) {
+		std::vector<Ort::Value> outputs = container->binding->GetOutputValues();
+		auto shape = outputs[0].GetTensorTypeAndShapeInfo().GetShape();  // Should be [1, 84, N]
+		const float* raw_output = outputs[0].GetTensorData<float>();
+		container->output.assign(raw_output, raw_output + static_cast<size_t>(shape[1]) * shape[2]);
+		bind_output(container, shape);
+	}
+
+	num_channels = static_cast<int>(container->output_shape[1]);
+	num_anchors = static_cast<int>(container->output_shape[2]);
+	return container->output.data();
+}
+
+static void apply_options(Ort::SessionOptions& session_options, const yolo_options& options) {
+	std::vector<int> cpus;
+	if (options.cpu_affinity == CPU_AFFINITY_MASK) {
+		for (int i = 0; i < 64; ++i) {
+			if (options.cpu_mask >> i & 1) {
+				cpus.push_back(i);
+			}
+		}
+	}
+
+	int num_threads = options.num_threads > 0 ? options.num_threads : std::max(static_cast<int>(cpus.size()), 1);
+	session_options.SetIntraOpNumThreads(num_threads);
+	if (!cpus.empty() && num_threads > 1) {
+		// One entry per pool thread, the calling thread is not part of the pool.
+		// ORT numbers processors from 1.
+		std::string affinities;
+		for (int i = 1; i < num_threads; ++i) {
+			if (i > 1) {
+				affinities += ';';
+			}
+			affinities += std::to_string(cpus[i % cpus.size()] + 1);
+		}
+		session_options.AddConfigEntry(kOrtSessionOptionsConfigIntraOpThreadAffinities, affinities.c_str());
+	}
+	session_options.AddConfigEntry(kOrtSessionOptionsConfigAllowIntraOpSpinning, options.spin_wait ? "1" : "0");
+	session_options.SetGraphOptimizationLevel(static_cast<GraphOptimizationLevel>(options.graph_optimization));
+}
+
+// Input size of models that do not say.
+static const int DEFAULT_INPUT_SIZE = 640;
+// Inputs are resized to multiples of the largest YOLO stride.
+static const int INPUT_STRIDE = 32;
+
+// Reads the training size Ultralytics stores as "imgsz" = "[h, w]" in the
+// model metadata. Leaves `width` and `height` alone if it is missing.
+static void read_metadata_size(const Ort::Session& session, int& width, int& height) {
+	Ort::AllocatorWithDefaultOptions allocator;
+	Ort::AllocatedStringPtr imgsz = session.GetModelMetadata().LookupCustomMetadataMapAllocated("imgsz", allocator);
+	int h = 0;
+	int w = 0;
+	if (imgsz && sscanf(imgsz.get(), "[%d, %d]", &h, &w) == 2 && h > 0 && w > 0) {
+		width = w;
+		height = h;
+	}
+}
+
+static bool file_exists(const std::string& path) {
+	FILE* file = fopen(path.c_str(), "rb");
+	if (file) {
+		fclose(file);
+	}
+	return file != nullptr;
+}
+
+// Path of the cached optimized graph of `model`, empty if caching is off.
+// Another ORT version or optimization level optimizes differently.
+static std::string optimized_model_path(const std::string& cache_dir, const ModelBuffer& model, const yolo_options& options) {
+	if (cache_dir.empty()) {
+		return "";
+	}
+	char name[128];
+	snprintf(name, sizeof(name), "/yolo_%016llx_ort%s_o%d.ort", static_cast<unsigned long long>(hash_model_bytes(model)), OrtGetApiBase()->GetVersionString(), options.graph_optimization);
+	return cache_dir + name;
+}
+
 // Creates and returns a new session container.
 // It is the caller's responsibility to call close_session on the returned pointer.
-OrtSessionContainer* create_session(const char* model_path) {
-	auto* container = new OrtSessionContainer;
+OrtSessionContainer* create_session(const ModelSource& source, const yolo_options* options) {
+	std::shared_ptr<const ModelBuffer> model = source.path.empty() ? source.weights : map_model_file(source.path);
+	if (!model) {
+		log_message(YOLO_LOG_ERROR, "Failed to load ONNX model.");
+		return nullptr;
+	}
+
+	auto* container = new OrtSessionContainer{};
 	container->env = new Ort::Env(ORT_LOGGING_LEVEL_WARNING, "yolo_ffi_ort_env");
 
+	yolo_options defaults = yolo_default_options();
+	const yolo_options& resolved = options ? *options : defaults;
 	Ort::SessionOptions session_options;
-	session_options.SetIntraOpNumThreads(1);
+	apply_options(session_options, resolved);
 
 #if __iOS__
 	// Use Core ML execution provider for iOS/macOS.
@@ -40,20 +161,122 @@ OrtSessionContainer* create_session(const char* model_path) {
 	// Ort::ThrowOnError(OrtSessionOptionsAppendExecutionProvider_Nnapi(session_options, nnapi_flags));
 #endif
 
+	// Graph optimization is most of the session setup time. The optimized
+	// graph is saved in ORT format on the first load, later loads map it and
+	// skip optimizing. Graphs partly compiled by an execution provider, as
+	// with Core ML, cannot be saved.
+	std::string cache_path;
+	std::string cache_temp;
+#if !__iOS__
+	cache_path = optimized_model_path(source.cache_dir, *model, resolved);
+#endif
+	if (!cache_path.empty()) {
+		std::shared_ptr<const ModelBuffer> cached = file_exists(cache_path) ? map_model_file(cache_path) : nullptr;
+		if (cached) {
+			model = cached;
+			session_options.SetGraphOptimizationLevel(ORT_DISABLE_ALL);
+		} else {
+			// Written under a name of its own and renamed once complete, so
+			// concurrent or interrupted loads never leave a partial graph behind.
+			cache_temp = cache_path + "." + std::to_string(reinterpret_cast<uintptr_t>(container)) + ".tmp";
+			session_options.SetOptimizedModelFilePath(cache_temp.c_str());
+			session_options.AddConfigEntry(kOrtSessionOptionsConfigSaveModelFormat, "ORT");
+		}
+	}
+
+	// ORT format models (a flatbuffer with the "ORTM" identifier) can run from
+	// the mapped bytes, initializers included, instead of copying them.
+	// ONNX protobufs are always parsed into a copy, so their bytes are
+	// released once the session exists.
+	if (model->size >= 8 && memcmp(model->data + 4, "ORTM", 4) == 0) {
+		session_options.AddConfigEntry(kOrtSessionOptionsConfigUseORTModelBytesDirectly, "1");
+		session_options.AddConfigEntry(kOrtSessionOptionsConfigUseORTModelBytesForInitializers, "1");
+		container->model_bytes = model;
+	}
+
 	try {
-		container->session = new Ort::Session(*container->env, model_path, session_options);
+		container->session = new Ort::Session(*container->env, model->data, model->size, session_options);
+		// Models exported with dynamic=True report -1 for height and width.
+		auto input_shape = container->session->GetInputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape();
+		container->dynamic_input = input_shape.size() == 4 && (input_shape[2] < 0 || input_shape[3] < 0);
+		container->input_w = DEFAULT_INPUT_SIZE;
+		container->input_h = DEFAULT_INPUT_SIZE;
+		if (input_shape.size() == 4 && !container->dynamic_input) {
+			container->input_w = static_cast<int>(input_shape[3]);
+			container->input_h = static_cast<int>(input_shape[2]);
+		} else {
+			read_metadata_size(*container->session, container->input_w, container->input_h);
+		}
+		// A fixed batch dimension (usually 1) limits how many frames fit in one Run.
+		container->batch_limit = input_shape.empty() || input_shape[0] < 0 ? 0 : static_cast<int>(input_shape[0]);
+
+		// Resolve everything Run needs once, instead of on every frame.
+		Ort::AllocatorWithDefaultOptions allocator;
+		container->input_name = container->session->GetInputNameAllocated(0, allocator).get();
+		container->output_name = container->session->GetOutputNameAllocated(0, allocator).get();
+		container->memory_info = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+		container->binding = new Ort::IoBinding(*container->session);
+		container->mask_count = 0;
+		if (container->session->GetOutputCount() > 1) {
+			auto proto_shape = container->session->GetOutputTypeInfo(1).GetTensorTypeAndShapeInfo().GetShape();
+			if (proto_shape.size() == 4 && proto_shape[1] > 0) {
+				container->proto_name = container->session->GetOutputNameAllocated(1, allocator).get();
+				container->mask_count = static_cast<int>(proto_shape[1]);
+				// The head is bound first, so it stays the first bound output.
+				container->binding->BindOutput(container->output_name.c_str(), container->memory_info);
+				container->binding->BindOutput(container->proto_name.c_str(), container->memory_info);
+			}
+		}
+
+		// A fixed [1, 3, H, W] model can have both tensors ready before the first frame.
+		if (!container->dynamic_input && input_shape.size() == 4 && container->batch_limit == 1) {
+			const int input_w = static_cast<int>(input_shape[3]);
+			const int input_h = static_cast<int>(input_shape[2]);
+			container->input.resize(static_cast<size_t>(3) * input_h * input_w);
+			bind_input(container, container->input.data(), input_w, input_h);
+
+			auto output_shape = container->session->GetOutputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape();
+			bool static_output = output_shape.size() == 3 && std::all_of(output_shape.begin(), output_shape.end(), [](int64_t dim) { return dim > 0; });
+			if (static_output) {
+				container->output.resize(static_cast<size_t>(output_shape[1]) * output_shape[2]);
+				bind_output(container, output_shape);
+			}
+		}
 	} catch (const Ort::Exception& e) {
 		// If session creation fails, clean up and return null.
+		delete container->binding;
+		delete container->session;
 		delete container->env;
 		delete container;
+		if (!cache_path.empty()) {
+			// A stale or unwritable cache must never keep the model from loading.
+			remove(cache_temp.empty() ? cache_path.c_str() : cache_temp.c_str());
+			log_message(YOLO_LOG_WARN, "Optimized model cache unusable, loading without it: %s", e.what());
+			ModelSource uncached = source;
+			uncached.cache_dir.clear();
+			return create_session(uncached, options);
+		}
 		// Optionally, log the error message e.what()
-		print_message(e.what());
+		log_message(YOLO_LOG_ERROR, "%s", e.what());
 		return nullptr;
 	}
 
+	if (!cache_temp.empty()) {
+		if (rename(cache_temp.c_str(), cache_path.c_str()) != 0) {
+			remove(cache_temp.c_str());
+		} else {
+			log_message(YOLO_LOG_INFO, "Saved the optimized model to %s.", cache_path.c_str());
+		}
+	}
 	return container;
 }
 
+OrtSessionContainer* create_session(const char* model_path, const yolo_options* options) {
+	ModelSource source;
+	source.path = model_path ? model_path : "";
+	return create_session(source, options);
+}
+
 // Returns the input name of the model.
 // The caller is responsible for freeing the returned C-string.
 const char* get_input_name(OrtSessionContainer* container) {
@@ -61,64 +284,60 @@ const char* get_input_name(OrtSessionContainer* container) {
 		return nullptr;
 	}
 
-	Ort::AllocatorWithDefaultOptions allocator;
-	// GetInputNameAllocated returns a smart pointer that manages the memory of the string.
-	Ort::AllocatedStringPtr input_name_ptr = container->session->GetInputNameAllocated(0, allocator);
-	const char* input_name = input_name_ptr.get();
-
-	// We must copy the string, because the memory managed by input_name_ptr will be
-	// freed when it goes out of scope at the end of this function.
-	char* name_copy = new char[strlen(input_name) + 1];
-	if (name_copy) {
-		strcpy(name_copy, input_name);
-	}
-
+	char* name_copy = new char[container->input_name.size() + 1];
+	strcpy(name_copy, container->input_name.c_str());
 	return name_copy;
 }
 
-std::vector<Detection> run_inference(OrtSessionContainer* container, cv::InputArray image, float conf_threshold, float nms_threshold) {
-	if (!container || !container->session) {
-		return {};
-	}
-	using namespace std::chrono;
-	const int INPUT_WIDTH = 640;
-	const int INPUT_HEIGHT = 640;
-
-	// Preprocessing
-	auto tic = high_resolution_clock::now();
-	cv::Mat3b input_image;
-	cv::cvtColor(image, input_image, cv::COLOR_RGBA2RGB);
-
-	cv::Mat blob;
-	cv::dnn::blobFromImage(input_image, blob, 1. / 255., cv::Size(INPUT_WIDTH, INPUT_HEIGHT), cv::Scalar(), true, false);
-
-	auto toc = high_resolution_clock::now();
-	auto pre_elapsed = duration_cast<milliseconds>(toc - tic);
+// Chooses the input size and the placement of an image of the given size.
+// Models with a fixed input shape get a square letterbox instead.
+InputGeometry input_geometry(OrtSessionContainer* container, int image_w, int image_h, ResizeMode mode, int input_size) {
+	return model_input_geometry(image_w, image_h, mode, container->input_w, container->input_h, input_size, INPUT_STRIDE, container->dynamic_input);
+}
 
-	// Create input tensor
-	tic = high_resolution_clock::now();
-	Ort::AllocatorWithDefaultOptions allocator;
-	Ort::AllocatedStringPtr input_name_ptr = container->session->GetInputNameAllocated(0, allocator);
-	const char* input_name = input_name_ptr.get();
-	Ort::AllocatedStringPtr output_name_ptr = container->session->GetOutputNameAllocated(0, allocator);
-	const char* output_name = output_name_ptr.get();
+// Runs the session on `batch` already normalized frames packed as [batch, 3, H, W].
+// The batch size varies from call to call, so ORT allocates these outputs:
+// the head, followed by the mask prototypes if `with_protos`.
+static std::vector<Ort::Value> run_session(OrtSessionContainer* container, float* blob, int batch, int input_w, int input_h, bool with_protos) {
+	const char* input_name = container->input_name.c_str();
+	const char* output_names[2] = {container->output_name.c_str(), container->proto_name.c_str()};
+	const int64_t input_shape[4] = {batch, 3, input_h, input_w};
+	Ort::Value input_tensor = Ort::Value::CreateTensor<float>(container->memory_info, blob, static_cast<size_t>(batch) * 3 * input_h * input_w, input_shape, 4);
 
-	std::vector<int64_t> input_shape = {1, 3, INPUT_HEIGHT, INPUT_WIDTH};
+	return container->session->Run(Ort::RunOptions{nullptr}, &input_name, &input_tensor, 1, output_names, with_protos ? 2 : 1);
+}
 
-	Ort::MemoryInfo memory_info = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
-	Ort::Value input_tensor = Ort::Value::CreateTensor<float>(memory_info, blob.ptr<float>(), blob.total(), input_shape.data(), input_shape.size());
+// Prototypes of frame `index` of an ORT allocated [N, masks, H, W] tensor.
+static MaskPrototypes proto_planes(const Ort::Value& value, int index) {
+	auto shape = value.GetTensorTypeAndShapeInfo().GetShape();
+	MaskPrototypes protos;
+	protos.count = static_cast<int>(shape[1]);
+	protos.height = static_cast<int>(shape[2]);
+	protos.width = static_cast<int>(shape[3]);
+	protos.plane_stride = static_cast<size_t>(protos.height) * protos.width;
+	protos.data = value.GetTensorData<float>() + static_cast<size_t>(index) * protos.count * protos.plane_stride;
+	return protos;
+}
 
-	// Run session
-	std::vector<Ort::Value> output_tensors = container->session->Run(Ort::RunOptions{nullptr}, &input_name, &input_tensor, 1, &output_name, 1);
-	toc = high_resolution_clock::now();
-	auto infer_elapsed = duration_cast<milliseconds>(toc - tic);
+// Runs the session on the normalized [1, 3, H, W] blob in `container->input`, decodes
+// the output and records the frame, whose preprocessing is already in `stats`.
+static void infer_and_decode(OrtSessionContainer* container, const InputGeometry& geometry, float conf_threshold, float nms_threshold, const DetectSettings& settings, std::vector<Detection>& detections, YoloFrameStats& stats) {
+	// Bind the input blob and run session
+	int64_t tic = stats_now_ns();
+	bind_input(container, container->input.data(), geometry.input_w, geometry.input_h);
+	int num_classes = 0;
+	int num_detections = 0;
+	const float* raw_output = run_bound(container, num_classes, num_detections);
+	MaskPrototypes protos;
+	protos.count = container->mask_count;
+	if (settings.masks && container->mask_count > 0) {
+		// The head is the first bound output, the prototypes the second.
+		container->proto_output = std::move(container->binding->GetOutputValues()[1]);
+		protos = proto_planes(container->proto_output, 0);
+	}
+	stats.stage_ns[YOLO_STAGE_INFERENCE] = stats_now_ns() - tic;
 
 	// Post-processing
-	tic = high_resolution_clock::now();
-	const float* raw_output = output_tensors[0].GetTensorData<float>();
-	auto output_shape = output_tensors[0].GetTensorTypeAndShapeInfo().GetShape();  // Should be [1, 84, N]
-	const int num_classes = static_cast<int>(output_shape[1]);
-	const int num_detections = static_cast<int>(output_shape[2]);
 
 	// Transpose [1, 84, N] to [1, N, 84]
 	// std::vector<float> transposed_output(1 * num_detections * num_classes);
@@ -129,65 +348,184 @@ std::vector<Detection> run_inference(OrtSessionContainer* container, cv::InputAr
 	// }
 	// cv::Mat1f transposed_output = cv::Mat1f(num_classes, num_detections, const_cast<float*>(raw_output)).t();
 
-	std::vector<cv::Rect> boxes;
-	std::vector<float> confidences;
-	std::vector<int> class_ids;
-
-	for (int i = 0; i < num_detections; ++i) {
-		const float* detection = raw_output + i;
-		const float* class_scores = detection + 4 * num_detections;
-
-		int class_id = -1;
-		float max_score = 0.0f;
-		for (int j = 0; j < num_classes - 4; ++j) {
-			int idx = j * num_detections;
-			if (class_scores[idx] > max_score) {
-				max_score = class_scores[idx];
-				class_id = j;
-			}
-		}
+	postprocess_output(raw_output, num_classes, num_detections, geometry, conf_threshold, nms_threshold, settings, container->scratch, detections, &stats, container->mask_count > 0 ? &protos : nullptr);
+
+	stats.stage_ns[YOLO_STAGE_TOTAL] = stats_now_ns() - stats.timestamp_ns;
+	stats_record(stats);
+}
+
+// Writes an RGBA image into one [3, H, W] slice of the input blob.
+static void preprocess_image(const cv::Mat& img, const InputGeometry& geometry, float* dst) {
+	preprocess_frame(make_rgba_view(img.data, img.cols, img.rows, static_cast<int>(img.step)), false, geometry, dst, static_cast<size_t>(geometry.input_h) * geometry.input_w);
+}
+
+void run_inference(OrtSessionContainer* container, cv::InputArray image, float conf_threshold, float nms_threshold, const DetectSettings& settings, std::vector<Detection>& detections) {
+	detections.clear();
+	if (!container || !container->session) {
+		return;
+	}
+	// Preprocessing
+	YoloFrameStats stats{};
+	stats.timestamp_ns = stats_now_ns();
+	cv::Mat img = image.getMat();
+	InputGeometry geometry = input_geometry(container, img.cols, img.rows, settings.resize_mode, settings.input_size);
+
+	container->input.resize(3 * geometry.input_h * geometry.input_w);
+	preprocess_image(img, geometry, container->input.data());
+
+	stats.stage_ns[YOLO_STAGE_PREPROCESS] = stats_now_ns() - stats.timestamp_ns;
+	infer_and_decode(container, geometry, conf_threshold, nms_threshold, settings, detections, stats);
+}
+
+void run_inference(OrtSessionContainer* container, const FrameView& frame, bool rotate_cw, float conf_threshold, float nms_threshold, const DetectSettings& settings, std::vector<Detection>& detections) {
+	detections.clear();
+	if (!container || !container->session) {
+		return;
+	}
+	// Preprocessing straight from the camera planes into the input blob.
+	YoloFrameStats stats{};
+	stats.timestamp_ns = stats_now_ns();
+	int image_w = rotate_cw ? frame.height : frame.width;
+	int image_h = rotate_cw ? frame.width : frame.height;
+	InputGeometry geometry = input_geometry(container, image_w, image_h, settings.resize_mode, settings.input_size);
+	container->input.resize(3 * geometry.input_h * geometry.input_w);
+	preprocess_frame(frame, rotate_cw, geometry, container->input.data(), geometry.input_h * geometry.input_w);
+
+	stats.stage_ns[YOLO_STAGE_PREPROCESS] = stats_now_ns() - stats.timestamp_ns;
+	infer_and_decode(container, geometry, conf_threshold, nms_threshold, settings, detections, stats);
+}
 
-		if (max_score > conf_threshold) {
-			float cx = detection[0 * num_detections];
-			float cy = detection[1 * num_detections];
-			float w = detection[2 * num_detections];
-			float h = detection[3 * num_detections];
+bool infer_session(OrtSessionContainer* container, float* input, const InputGeometry& geometry, std::vector<float>& output, int& num_channels, int& num_anchors, int& num_masks) {
+	if (!container || !container->session) {
+		return false;
+	}
 
-			int left = static_cast<int>(std::round(cx - 0.5 * w));
-			int top = static_cast<int>(std::round(cy - 0.5 * h));
-			int width = static_cast<int>(std::round(w));
-			int height = static_cast<int>(std::round(h));
+	try {
+		// Pipeline frames bring their own input buffers. Rebinding one only wraps it, nothing is copied.
+		bind_input(container, input, geometry.input_w, geometry.input_h);
+		const float* raw_output = run_bound(container, num_channels, num_anchors);
+		output.assign(raw_output, raw_output + static_cast<size_t>(num_channels) * num_anchors);
+		num_masks = container->mask_count;
+	} catch (const Ort::Exception& e) {
+		log_message(YOLO_LOG_ERROR, "%s", e.what());
+		return false;
+	}
+	return true;
+}
+
+std::vector<std::vector<Detection>> run_inference_batch(OrtSessionContainer* container, const std::vector<cv::Mat>& images, float conf_threshold, float nms_threshold, const DetectSettings& settings) {
+	std::vector<std::vector<Detection>> results(images.size());
+	if (!container || !container->session) {
+		return results;
+	}
+
+	const int count = static_cast<int>(images.size());
+	int batch_size = std::max(settings.batch_size, 1);
+	if (container->batch_limit > 0) {
+		batch_size = container->batch_limit;
+	}
+	std::vector<InputGeometry> geometries(count);
+	for (int i = 0; i < count; ++i) {
+		geometries[i] = input_geometry(container, images[i].cols, images[i].rows, settings.resize_mode, settings.input_size);
+	}
 
-			boxes.emplace_back(left, top, width, height);
-			confidences.emplace_back(max_score);
-			class_ids.emplace_back(class_id);
+	std::vector<float> blob;
+	for (int start = 0; start < count;) {
+		// Frames share a tensor only if they have the same input size.
+		int n = 1;
+		while (n < batch_size && start + n < count && geometries[start + n].input_w == geometries[start].input_w && geometries[start + n].input_h == geometries[start].input_h) {
+			++n;
 		}
+		const int input_w = geometries[start].input_w;
+		const int input_h = geometries[start].input_h;
+		const size_t frame_size = static_cast<size_t>(3) * input_h * input_w;
+		// A model with a fixed batch dimension always gets a full batch, the tail is left blank.
+		const int tensor_batch = container->batch_limit > 0 ? container->batch_limit : n;
+
+		const int64_t tic = stats_now_ns();
+		blob.assign(tensor_batch * frame_size, 0.f);
+		cv::parallel_for_(cv::Range(0, n), [&](const cv::Range& range) {
+			for (int i = range.start; i < range.end; ++i) {
+				preprocess_image(images[start + i], geometries[start + i], blob.data() + i * frame_size);
+			}
+		});
+		const int64_t preprocessed = stats_now_ns();
+
+		const bool with_protos = settings.masks && container->mask_count > 0;
+		std::vector<Ort::Value> outputs = run_session(container, blob.data(), tensor_batch, input_w, input_h, with_protos);
+		const int64_t inferred = stats_now_ns();
+
+		// Output is [batch, 84, N], every frame is decoded on its own core.
+		const float* raw_output = outputs[0].GetTensorData<float>();
+		auto output_shape = outputs[0].GetTensorTypeAndShapeInfo().GetShape();
+		const int num_classes = static_cast<int>(output_shape[1]);
+		const int num_detections = static_cast<int>(output_shape[2]);
+		cv::parallel_for_(cv::Range(0, n), [&](const cv::Range& range) {
+			PostprocessScratch scratch;
+			for (int i = range.start; i < range.end; ++i) {
+				const float* frame_output = raw_output + static_cast<size_t>(i) * num_classes * num_detections;
+				MaskPrototypes protos;
+				protos.count = container->mask_count;
+				if (with_protos) {
+					protos = proto_planes(outputs[1], i);
+				}
+				YoloFrameStats stats{};
+				stats.timestamp_ns = tic;
+				stats.stage_ns[YOLO_STAGE_PREPROCESS] = (preprocessed - tic) / n;
+				stats.stage_ns[YOLO_STAGE_INFERENCE] = (inferred - preprocessed) / n;
+				postprocess_output(frame_output, num_classes, num_detections, geometries[start + i], conf_threshold, nms_threshold, settings, scratch, results[start + i], &stats, container->mask_count > 0 ? &protos : nullptr);
+				stats.stage_ns[YOLO_STAGE_TOTAL] = stats.stage_ns[YOLO_STAGE_PREPROCESS] + stats.stage_ns[YOLO_STAGE_INFERENCE] + stats.stage_ns[YOLO_STAGE_DECODE] + stats.stage_ns[YOLO_STAGE_NMS] + stats.stage_ns[YOLO_STAGE_MASK];
+				stats_record(stats);
+			}
+		});
+
+		start += n;
 	}
 
-	std::vector<int> nms_indices;
-	cv::dnn::NMSBoxes(boxes, confidences, conf_threshold, nms_threshold, nms_indices);
+	return results;
+}
 
-	std::vector<Detection> detections;
-	for (int idx : nms_indices) {
-		Detection result;
-		result.box = boxes[idx];
-		result.confidence = confidences[idx];
-		result.class_id = class_ids[idx];
-		detections.push_back(result);
+bool classify_session(OrtSessionContainer* container, float* input, int count, int size, std::vector<float>& scores, int& num_classes) {
+	if (!container || !container->session) {
+		return false;
 	}
-	toc = high_resolution_clock::now();
-	auto post_elapsed = duration_cast<milliseconds>(toc - tic);
-	char buffer[1024];
-	auto total = pre_elapsed + infer_elapsed + post_elapsed;
-	sprintf(buffer, "Elapsed Time(%lld ms): preprocess: %lld ms, inference: %lld ms, postprocess: %lld ms", total.count(), pre_elapsed.count(), infer_elapsed.count(), post_elapsed.count());
-	print_message(buffer);
 
-	return detections;
+	const size_t crop_size = static_cast<size_t>(3) * size * size;
+	// A model with a fixed batch dimension runs full batches, the tail padded with blanks.
+	const int batch_size = container->batch_limit > 0 ? container->batch_limit : count;
+	num_classes = 0;
+	try {
+		for (int start = 0; start < count; start += batch_size) {
+			const int n = std::min(batch_size, count - start);
+			float* blob = input + start * crop_size;
+			if (n < batch_size) {
+				container->input.assign(batch_size * crop_size, 0.f);
+				std::copy(blob, blob + n * crop_size, container->input.begin());
+				blob = container->input.data();
+			}
+			std::vector<Ort::Value> outputs = run_session(container, blob, batch_size, size, size, false);
+			auto output_shape = outputs[0].GetTensorTypeAndShapeInfo().GetShape();
+			const int classes = static_cast<int>(output_shape.back());
+			if (start == 0) {
+				num_classes = classes;
+				scores.resize(static_cast<size_t>(count) * num_classes);
+			} else if (classes != num_classes) {
+				return false;
+			}
+			const float* raw_output = outputs[0].GetTensorData<float>();
+			std::copy(raw_output, raw_output + static_cast<size_t>(n) * num_classes, scores.begin() + static_cast<size_t>(start) * num_classes);
+		}
+	} catch (const Ort::Exception& e) {
+		log_message(YOLO_LOG_ERROR, "%s", e.what());
+		return false;
+	}
+	return true;
 }
 
 // Closes the session and frees the container and its contents.
 void close_session(OrtSessionContainer* container) {
 	if (container) {
+		delete container->binding;
 		delete container->session;
 		delete container->env;
 		delete container;
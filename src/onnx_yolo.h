@@ -1,25 +1,92 @@
 #ifndef YOLO_ONNX_H
 #define YOLO_ONNX_H
 
+#include "yolo_ffi.h"
+
 #ifdef __cplusplus
 #include <onnxruntime_cxx_api.h>
 #include <opencv2/core.hpp>
+#include <string>
 #include <vector>
+#include "detect_settings.h"
+#include "detection.h"
+#include "model_source.h"
+#include "postprocess.h"
+#include "preprocess.h"
 
 // A struct to hold the ONNX Runtime session and environment objects.
 // This helps manage their lifecycle together.
 struct OrtSessionContainer {
 	Ort::Session* session;
 	Ort::Env* env;
-};
+	// The model file when the session uses its bytes in place (ORT format),
+	// kept alive as long as the session.
+	std::shared_ptr<const ModelBuffer> model_bytes;
+	// Whether the model accepts inputs other than `input_w x input_h`.
+	bool dynamic_input;
+	// The fixed input size, or for dynamic models the size recorded in the
+	// Ultralytics "imgsz" metadata, 640x640 without it.
+	int input_w;
+	int input_h;
+	// Fixed batch dimension of the model, 0 if any batch size is accepted.
+	int batch_limit;
+	// Resolved once when the session is created.
+	std::string input_name;
+	std::string output_name;
+	// Second output of segmentation models, the [N, masks, H, W] prototypes,
+	// empty without. `mask_count` is 0 then.
+	std::string proto_name;
+	int mask_count;
+	Ort::MemoryInfo memory_info{nullptr};
 
-struct Detection {
-	cv::Rect box;
-	int class_id;
-	float confidence;
+	// Single frames run through `binding`. Input and output tensors wrap the
+	// buffers below and are only rebound when the input size or buffer changes.
+	Ort::IoBinding* binding;
+	Ort::Value input_tensor{nullptr};
+	const float* bound_input;
+	int bound_w;
+	int bound_h;
+	// Set once `output` is bound. Until then ORT allocates the output, which
+	// is how the output shape of a new input size is learned.
+	bool output_bound;
+	std::vector<int64_t> output_shape;
+	Ort::Value output_tensor{nullptr};
+	// Allocated by ORT on every run, fetched only when masks are wanted.
+	Ort::Value proto_output{nullptr};
+
+	std::vector<float> input;
+	std::vector<float> output;
+	PostprocessScratch scratch;
 };
 
-std::vector<Detection> run_inference(OrtSessionContainer* container, cv::InputArray image, float conf_threshold, float nms_threshold);
+// Detects on an RGBA image, `detections` is overwritten.
+void run_inference(OrtSessionContainer* container, cv::InputArray image, float conf_threshold, float nms_threshold, const DetectSettings& settings, std::vector<Detection>& detections);
+// Detects on camera planes, rotating them 90 degrees clockwise first if asked.
+void run_inference(OrtSessionContainer* container, const FrameView& frame, bool rotate_cw, float conf_threshold, float nms_threshold, const DetectSettings& settings, std::vector<Detection>& detections);
+// Detects on several RGBA images, packing up to `settings.batch_size` of them
+// into one [N, 3, H, W] tensor. Returns one list of detections per image, in order.
+std::vector<std::vector<Detection>> run_inference_batch(OrtSessionContainer* container, const std::vector<cv::Mat>& images, float conf_threshold, float nms_threshold, const DetectSettings& settings = DetectSettings());
+// Runs a classification model on `count` crops packed as [count, 3, size, size]
+// in as few runs as the batch dimension allows, and copies the [count, classes]
+// scores to `scores`.
+bool classify_session(OrtSessionContainer* container, float* input, int count, int size, std::vector<float>& scores, int& num_classes);
+
+
+// Loads `source.path` through a shared read-only mapping, or the in-memory
+// model in `source.weights`. `options` may be NULL to use the defaults.
+OrtSessionContainer* create_session(const ModelSource& source, const yolo_options* options);
+
+// MARK: - Stages of run_inference, used by the async pipeline
+
+// Chooses the input size and the placement of an image of the given size,
+// `input_size` on the long side (0 for the model's own size) if the model
+// accepts other sizes.
+InputGeometry input_geometry(OrtSessionContainer* container, int image_w, int image_h, ResizeMode mode, int input_size);
+
+// Runs the session on a [1, 3, H, W] normalized blob and copies the raw
+// [channels, anchors] head to `output`. `num_masks` of the channels are mask
+// coefficients of a segmentation model.
+bool infer_session(OrtSessionContainer* container, float* input, const InputGeometry& geometry, std::vector<float>& output, int& num_channels, int& num_anchors, int& num_masks);
 
 #else
 // Forward declare the struct for C code.
@@ -31,7 +98,8 @@ extern "C" {
 #endif
 
 // Functions to be called from C FFI layer.
-struct OrtSessionContainer* create_session(const char* model_path);
+// `options` may be NULL to use the defaults.
+struct OrtSessionContainer* create_session(const char* model_path, const yolo_options* options);
 const char* get_input_name(struct OrtSessionContainer* container);
 void close_session(struct OrtSessionContainer* container);
 
@@ -0,0 +1,82 @@
+#include "postprocess.h"
+#include <algorithm>
+#include "yolo_nms.h"
+#include "yolo_stats.h"
+
+OutputLayout resolve_output_layout(OutputLayout layout, int num_rows, int row_size) {
+	if (layout != OUTPUT_LAYOUT_AUTO) {
+		return layout;
+	}
+	// Anchor heads have far more anchors (columns) than channels, end-to-end
+	// heads a few hundred rows of six or so values.
+	return row_size >= END_TO_END_ROW && row_size < num_rows ? OUTPUT_LAYOUT_END_TO_END : OUTPUT_LAYOUT_ANCHORS;
+}
+
+// End-to-end heads already hold the final boxes: keep the best ones in score order.
+static void select_end_to_end(const Candidates& candidates, int max_detections, std::vector<int>& keep) {
+	keep.resize(candidates.size());
+	for (size_t i = 0; i < keep.size(); ++i) {
+		keep[i] = static_cast<int>(i);
+	}
+	std::stable_sort(keep.begin(), keep.end(), [&](int a, int b) { return candidates.scores[a] > candidates.scores[b]; });
+	if (max_detections > 0 && static_cast<int>(keep.size()) > max_detections) {
+		keep.resize(max_detections);
+	}
+}
+
+void postprocess_output(const float* output, int num_channels, int num_anchors, const InputGeometry& geometry, float conf_threshold, float nms_threshold, const DetectSettings& settings, PostprocessScratch& scratch, std::vector<Detection>& detections, YoloFrameStats* stats, const MaskPrototypes* protos) {
+	int64_t tic = stats_now_ns();
+	Candidates& candidates = scratch.candidates;
+	// Mask coefficients follow the class scores of an anchor head and the box
+	// of an end-to-end row, and are no classes.
+	const int num_masks = protos ? protos->count : 0;
+	const bool end_to_end = resolve_output_layout(settings.output_layout, num_channels, num_anchors) == OUTPUT_LAYOUT_END_TO_END;
+	if (end_to_end) {
+		decode_end_to_end(output, num_channels, num_anchors, conf_threshold, settings.class_thresholds, geometry, candidates);
+	} else {
+		decode_yolo(output, num_channels - num_masks, num_anchors, conf_threshold, settings.class_thresholds, geometry, candidates);
+	}
+	int64_t decoded = stats_now_ns();
+
+	std::vector<int>& keep = scratch.keep;
+	if (end_to_end) {
+		select_end_to_end(candidates, settings.max_detections, keep);
+	} else {
+		nms_boxes(candidates, nms_threshold, settings.nms_top_k, settings.max_detections, keep);
+	}
+	int64_t selected = stats_now_ns();
+
+	detections.resize(keep.size());
+	for (size_t i = 0; i < keep.size(); ++i) {
+		const int idx = keep[i];
+		Detection& result = detections[i];
+		result.box = cv::Rect2f(candidates.x1[idx], candidates.y1[idx], candidates.x2[idx] - candidates.x1[idx], candidates.y2[idx] - candidates.y1[idx]);
+		result.confidence = candidates.scores[idx];
+		result.class_id = candidates.class_ids[idx];
+		result.track_id = -1;
+		result.mask_rect = cv::Rect();
+		result.mask.clear();
+		result.crop_class_id = -1;
+		result.crop_confidence = 0.f;
+	}
+
+	// Masks only for the detections that are kept, never for candidates.
+	if (settings.masks && protos && protos->data) {
+		for (size_t i = 0; i < keep.size(); ++i) {
+			const int source = candidates.sources[keep[i]];
+			if (end_to_end) {
+				decode_mask(*protos, output + static_cast<size_t>(source) * num_anchors + END_TO_END_ROW, 1, geometry, detections[i], scratch.masks);
+			} else {
+				decode_mask(*protos, output + static_cast<size_t>(num_channels - num_masks) * num_anchors + source, num_anchors, geometry, detections[i], scratch.masks);
+			}
+		}
+	}
+
+	if (stats) {
+		stats->stage_ns[YOLO_STAGE_DECODE] = decoded - tic;
+		stats->stage_ns[YOLO_STAGE_NMS] = selected - decoded;
+		stats->stage_ns[YOLO_STAGE_MASK] = stats_now_ns() - selected;
+		stats->candidates = static_cast<int32_t>(candidates.size());
+		stats->detections = static_cast<int32_t>(detections.size());
+	}
+}
@@ -0,0 +1,34 @@
+#ifndef POSTPROCESS_H
+#define POSTPROCESS_H
+
+#include <vector>
+#include "detect_settings.h"
+#include "detection.h"
+#include "preprocess.h"
+#include "yolo_decode.h"
+#include "yolo_mask.h"
+
+// Buffers postprocessing keeps between frames.
+struct PostprocessScratch {
+	Candidates candidates;
+	std::vector<int> keep;
+	MaskScratch masks;
+};
+
+// The layout of a [num_rows, row_size] head, `layout` unless that is
+// OUTPUT_LAYOUT_AUTO, in which case it is guessed from the shape.
+OutputLayout resolve_output_layout(OutputLayout layout, int num_rows, int row_size);
+
+// Turns a raw head into the final detections. A YOLOv8/11 head of shape
+// [4 + classes, anchors] is decoded and run through class-aware NMS, an
+// end-to-end head of shape [detections, 6] only filtered by score; either way
+// the boxes are mapped through `geometry`. The layout comes from
+// `settings.output_layout`. Shared by every backend and the async pipeline.
+//
+// Segmentation models pass their `protos`: the mask coefficients are then
+// told apart from the class scores, and with `settings.masks` every kept
+// detection gets its mask. Prototypes without data only give their count.
+// Fills the decode, NMS and mask timings and counts of `stats` if given.
+void postprocess_output(const float* output, int num_channels, int num_anchors, const InputGeometry& geometry, float conf_threshold, float nms_threshold, const DetectSettings& settings, PostprocessScratch& scratch, std::vector<Detection>& detections, YoloFrameStats* stats = nullptr, const MaskPrototypes* protos = nullptr);
+
+#endif  // POSTPROCESS_H
@@ -0,0 +1,351 @@
+#include "preprocess.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "simd.h"
+
+namespace {
+
+using namespace simd;
+
+// Output pixels handled per gather/convert step.
+constexpr int LANES = 8;
+
+// Two neighbouring source samples along one axis and the weight of the second.
+struct Tap {
+	int i0;
+	int i1;
+	float w;
+};
+
+// Same half-pixel mapping as cv::resize with INTER_LINEAR.
+void compute_taps(int src_len, int dst_len, bool reverse, std::vector<Tap>& taps) {
+	taps.resize(dst_len);
+	const float scale = static_cast<float>(src_len) / dst_len;
+	for (int i = 0; i < dst_len; ++i) {
+		float s = std::max((i + 0.5f) * scale - 0.5f, 0.f);
+		int i0 = std::min(static_cast<int>(s), src_len - 1);
+		int i1 = std::min(i0 + 1, src_len - 1);
+		float w = i1 == i0 ? 0.f : s - i0;
+		if (reverse) {
+			i0 = src_len - 1 - i0;
+			i1 = src_len - 1 - i1;
+		}
+		taps[i] = {i0, i1, w};
+	}
+}
+
+// Bilinear blend of four gathered samples, LANES at a time.
+inline vfloat bilerp(const float* a00, const float* a01, const float* a10, const float* a11, const float* wx, vfloat wy, int k) {
+	vfloat t0 = vload(a00 + k);
+	vfloat t1 = vload(a10 + k);
+	vfloat w = vload(wx + k);
+	t0 = vadd(t0, vmul(vsub(vload(a01 + k), t0), w));
+	t1 = vadd(t1, vmul(vsub(vload(a11 + k), t1), w));
+	return vadd(t0, vmul(vsub(t1, t0), wy));
+}
+
+// BT.601 video range YUV -> RGB with the 1/255 normalization folded into the
+// coefficients, the same conversion cv::COLOR_YUV2RGBA_* performs.
+void yuv_lanes(const float* y00, const float* y01, const float* y10, const float* y11, const float* wx, float wy, const float* u, const float* v, float* r, float* g, float* b) {
+	const vfloat vwy = vdup(wy);
+	const vfloat k_y = vdup(1.164f / 255.f);
+	const vfloat k_rv = vdup(1.596f / 255.f);
+	const vfloat k_gu = vdup(0.391f / 255.f);
+	const vfloat k_gv = vdup(0.813f / 255.f);
+	const vfloat k_bu = vdup(2.018f / 255.f);
+	const vfloat c16 = vdup(16.f);
+	const vfloat c128 = vdup(128.f);
+	for (int k = 0; k < LANES; k += VW) {
+		vfloat c = vmul(vsub(bilerp(y00, y01, y10, y11, wx, vwy, k), c16), k_y);
+		vfloat d = vsub(vload(u + k), c128);
+		vfloat e = vsub(vload(v + k), c128);
+		vstore(r + k, vclamp01(vadd(c, vmul(e, k_rv))));
+		vstore(g + k, vclamp01(vsub(c, vadd(vmul(d, k_gu), vmul(e, k_gv)))));
+		vstore(b + k, vclamp01(vadd(c, vmul(d, k_bu))));
+	}
+}
+
+void rgb_lanes(const float (*s)[4][LANES], const float* wx, float wy, float* r, float* g, float* b) {
+	const vfloat vwy = vdup(wy);
+	const vfloat norm = vdup(1.f / 255.f);
+	float* out[3] = {r, g, b};
+	for (int c = 0; c < 3; ++c) {
+		for (int k = 0; k < LANES; k += VW) {
+			vstore(out[c] + k, vmul(bilerp(s[c][0], s[c][1], s[c][2], s[c][3], wx, vwy, k), norm));
+		}
+	}
+}
+
+}  // namespace
+
+FrameView make_frame_view(
+    ImageFormat format,
+    const uint8_t* plane0,
+    const uint8_t* plane1,
+    const uint8_t* plane2,
+    int bytesPerRow0,
+    int bytesPerRow1,
+    int bytesPerRow2,
+    int bytesPerPixel1,
+    int bytesPerPixel2,
+    int width,
+    int height) {
+	FrameView frame{};
+	frame.width = width;
+	frame.height = height;
+	frame.planes[0] = plane0;
+	frame.row_strides[0] = bytesPerRow0 > 0 ? bytesPerRow0 : width;
+	frame.pixel_strides[0] = 1;
+
+	switch (format) {
+		case YUV420: {
+			frame.layout = LAYOUT_I420;
+			frame.planes[1] = plane1;
+			frame.planes[2] = plane2;
+			frame.row_strides[1] = bytesPerRow1 > 0 ? bytesPerRow1 : width / 2;
+			frame.row_strides[2] = bytesPerRow2 > 0 ? bytesPerRow2 : width / 2;
+			frame.pixel_strides[1] = bytesPerPixel1 > 0 ? bytesPerPixel1 : 1;
+			frame.pixel_strides[2] = bytesPerPixel2 > 0 ? bytesPerPixel2 : 1;
+			break;
+		}
+		case NV21: {
+			// The VU plane either comes separately or directly follows the Y plane.
+			const uint8_t* vu = plane1 ? plane1 : plane0 + static_cast<size_t>(frame.row_strides[0]) * height;
+			frame.layout = LAYOUT_NV21;
+			frame.planes[1] = vu + 1;
+			frame.planes[2] = vu;
+			frame.row_strides[1] = frame.row_strides[2] = bytesPerRow1 > 0 ? bytesPerRow1 : frame.row_strides[0];
+			frame.pixel_strides[1] = frame.pixel_strides[2] = 2;
+			break;
+		}
+		case BGRA8888: {
+			frame.layout = LAYOUT_BGRA;
+			frame.row_strides[0] = bytesPerRow0 > 0 ? bytesPerRow0 : width * 4;
+			frame.pixel_strides[0] = 4;
+			break;
+		}
+	}
+	return frame;
+}
+
+FrameView make_rgba_view(const uint8_t* data, int width, int height, int row_stride) {
+	FrameView frame{};
+	frame.layout = LAYOUT_RGBA;
+	frame.planes[0] = data;
+	frame.row_strides[0] = row_stride > 0 ? row_stride : width * 4;
+	frame.pixel_strides[0] = 4;
+	frame.width = width;
+	frame.height = height;
+	return frame;
+}
+
+// Bytes from the first to the last sample read by preprocess_frame, which is
+// shorter than rows * row_stride on Android where the last row is cut. The
+// interleaved chroma of NV21 is one extent, planes[1] points into it.
+static size_t plane_extents(const FrameView& frame, size_t extents[3]) {
+	const bool packed = frame.layout == LAYOUT_BGRA || frame.layout == LAYOUT_RGBA;
+	const int num_planes = packed ? 1 : 3;
+	size_t total = 0;
+	for (int p = 0; p < 3; ++p) {
+		extents[p] = 0;
+		if (p >= num_planes || (frame.layout == LAYOUT_NV21 && p == 1)) {
+			continue;
+		}
+		const int rows = p == 0 ? frame.height : (frame.height + 1) / 2;
+		const int cols = p == 0 ? frame.width : (frame.width + 1) / 2;
+		const int sample_size = packed ? 4 : frame.layout == LAYOUT_NV21 && p == 2 ? 2 : 1;
+		extents[p] = static_cast<size_t>(frame.row_strides[p]) * (rows - 1) + static_cast<size_t>(frame.pixel_strides[p]) * (cols - 1) + sample_size;
+		total += extents[p];
+	}
+	return total;
+}
+
+size_t frame_size(const FrameView& frame) {
+	size_t extents[3];
+	return plane_extents(frame, extents);
+}
+
+FrameView copy_frame(const FrameView& frame, uint8_t* dst) {
+	size_t extents[3];
+	plane_extents(frame, extents);
+	FrameView copy = frame;
+	for (int p = 0; p < 3; ++p) {
+		if (extents[p] == 0) {
+			continue;
+		}
+		memcpy(dst, frame.planes[p], extents[p]);
+		copy.planes[p] = dst;
+		dst += extents[p];
+	}
+	if (frame.layout == LAYOUT_NV21) {
+		copy.planes[1] = copy.planes[2] + 1;
+	}
+	return copy;
+}
+
+FrameView copy_frame(const FrameView& frame, std::vector<uint8_t>& storage) {
+	storage.resize(frame_size(frame));
+	return copy_frame(frame, storage.data());
+}
+
+FrameView crop_frame(const FrameView& frame, int x, int y, int width, int height) {
+	FrameView crop = frame;
+	if (frame.layout == LAYOUT_I420 || frame.layout == LAYOUT_NV21) {
+		width += x & 1;
+		height += y & 1;
+		x &= ~1;
+		y &= ~1;
+		for (int p = 1; p < 3; ++p) {
+			crop.planes[p] += static_cast<size_t>(y / 2) * frame.row_strides[p] + static_cast<size_t>(x / 2) * frame.pixel_strides[p];
+		}
+	}
+	crop.planes[0] += static_cast<size_t>(y) * frame.row_strides[0] + static_cast<size_t>(x) * frame.pixel_strides[0];
+	crop.width = width;
+	crop.height = height;
+	return crop;
+}
+
+InputGeometry stretch_geometry(int input_w, int input_h) {
+	return {input_w, input_h, 0, 0, input_w, input_h, 1.f, 1.f};
+}
+
+InputGeometry model_input_geometry(int image_w, int image_h, ResizeMode mode, int model_w, int model_h, int input_size, int stride, bool resizable) {
+	const int model_size = std::max(model_w, model_h);
+	if (!resizable) {
+		return mode == RESIZE_LETTERBOX ? letterbox_geometry(image_w, image_h, model_size, stride, true) : stretch_geometry(model_w, model_h);
+	}
+
+	const int size = input_size > 0 ? input_size : model_size;
+	if (mode == RESIZE_LETTERBOX) {
+		return letterbox_geometry(image_w, image_h, size, stride, false);
+	}
+	// The model's aspect ratio at the new size, rounded to the stride.
+	const int input_w = std::max(stride, static_cast<int>(std::lround(static_cast<float>(model_w) * size / model_size / stride)) * stride);
+	const int input_h = std::max(stride, static_cast<int>(std::lround(static_cast<float>(model_h) * size / model_size / stride)) * stride);
+	InputGeometry geometry = stretch_geometry(input_w, input_h);
+	geometry.box_scale_x = static_cast<float>(model_w) / input_w;
+	geometry.box_scale_y = static_cast<float>(model_h) / input_h;
+	return geometry;
+}
+
+InputGeometry letterbox_geometry(int src_w, int src_h, int target_size, int stride, bool square) {
+	const float scale = static_cast<float>(target_size) / std::max(src_w, src_h);
+	const int content_w = std::max(1, std::min(target_size, static_cast<int>(std::lround(src_w * scale))));
+	const int content_h = std::max(1, std::min(target_size, static_cast<int>(std::lround(src_h * scale))));
+	const int input_w = square ? target_size : (content_w + stride - 1) / stride * stride;
+	const int input_h = square ? target_size : (content_h + stride - 1) / stride * stride;
+
+	InputGeometry geometry;
+	geometry.input_w = input_w;
+	geometry.input_h = input_h;
+	geometry.content_x = (input_w - content_w) / 2;
+	geometry.content_y = (input_h - content_h) / 2;
+	geometry.content_w = content_w;
+	geometry.content_h = content_h;
+	geometry.box_scale_x = static_cast<float>(src_w) / content_w;
+	geometry.box_scale_y = static_cast<float>(src_h) / content_h;
+	return geometry;
+}
+
+void preprocess_frame(const FrameView& frame, bool rotate_cw, const InputGeometry& geometry, float* dst, size_t plane_stride) {
+	const int dst_w = geometry.content_w;
+	const int dst_h = geometry.content_h;
+	const int input_w = geometry.input_w;
+
+	// Fill the letterbox border first, the content is written over it below.
+	if (dst_w != input_w || dst_h != geometry.input_h) {
+		const float pad = LETTERBOX_PAD_VALUE / 255.f;
+		for (int c = 0; c < 3; ++c) {
+			std::fill(dst + c * plane_stride, dst + c * plane_stride + static_cast<size_t>(input_w) * geometry.input_h, pad);
+		}
+	}
+
+	// After a clockwise rotation, dst columns walk the source rows bottom-up and
+	// dst rows walk the source columns, so only the roles of the strides swap.
+	const int along_x_len = rotate_cw ? frame.height : frame.width;
+	const int along_y_len = rotate_cw ? frame.width : frame.height;
+
+	thread_local std::vector<Tap> x_taps;
+	thread_local std::vector<Tap> y_taps;
+	compute_taps(along_x_len, dst_w, rotate_cw, x_taps);
+	compute_taps(along_y_len, dst_h, false, y_taps);
+
+	const bool is_yuv = frame.layout == LAYOUT_I420 || frame.layout == LAYOUT_NV21;
+	const int luma_row = frame.row_strides[0];
+	const int luma_px = frame.pixel_strides[0];
+	const int x_step = rotate_cw ? luma_row : luma_px;
+	const int y_step = rotate_cw ? luma_px : luma_row;
+	const int r_off = frame.layout == LAYOUT_BGRA ? 2 : 0;
+	const int b_off = frame.layout == LAYOUT_BGRA ? 0 : 2;
+
+	const size_t content_offset = static_cast<size_t>(geometry.content_y) * input_w + geometry.content_x;
+	float* const r_plane = dst + content_offset;
+	float* const g_plane = dst + plane_stride + content_offset;
+	float* const b_plane = dst + 2 * plane_stride + content_offset;
+
+	alignas(32) float wx[LANES];
+	alignas(32) float taps[3][4][LANES];
+	alignas(32) float u[LANES];
+	alignas(32) float v[LANES];
+	alignas(32) float r[LANES];
+	alignas(32) float g[LANES];
+	alignas(32) float b[LANES];
+
+	for (int dy = 0; dy < dst_h; ++dy) {
+		const Tap& ty = y_taps[dy];
+		const uint8_t* row0 = frame.planes[0] + static_cast<size_t>(ty.i0) * y_step;
+		const uint8_t* row1 = frame.planes[0] + static_cast<size_t>(ty.i1) * y_step;
+		// Chroma is sampled at the nearest 2x2 block, it carries little detail anyway.
+		const int cy = (ty.w < 0.5f ? ty.i0 : ty.i1) >> 1;
+		const uint8_t* u_row = nullptr;
+		const uint8_t* v_row = nullptr;
+		int u_x_step = 0;
+		int v_x_step = 0;
+		if (is_yuv) {
+			u_row = frame.planes[1] + static_cast<size_t>(cy) * (rotate_cw ? frame.pixel_strides[1] : frame.row_strides[1]);
+			v_row = frame.planes[2] + static_cast<size_t>(cy) * (rotate_cw ? frame.pixel_strides[2] : frame.row_strides[2]);
+			u_x_step = rotate_cw ? frame.row_strides[1] : frame.pixel_strides[1];
+			v_x_step = rotate_cw ? frame.row_strides[2] : frame.pixel_strides[2];
+		}
+
+		const size_t row_offset = static_cast<size_t>(dy) * input_w;
+		for (int dx = 0; dx < dst_w; dx += LANES) {
+			const int n = std::min(LANES, dst_w - dx);
+			for (int k = 0; k < LANES; ++k) {
+				const Tap& tx = x_taps[dx + std::min(k, n - 1)];
+				const size_t o0 = static_cast<size_t>(tx.i0) * x_step;
+				const size_t o1 = static_cast<size_t>(tx.i1) * x_step;
+				wx[k] = tx.w;
+				if (is_yuv) {
+					taps[0][0][k] = row0[o0];
+					taps[0][1][k] = row0[o1];
+					taps[0][2][k] = row1[o0];
+					taps[0][3][k] = row1[o1];
+					const int cx = (tx.w < 0.5f ? tx.i0 : tx.i1) >> 1;
+					u[k] = u_row[static_cast<size_t>(cx) * u_x_step];
+					v[k] = v_row[static_cast<size_t>(cx) * v_x_step];
+				} else {
+					const int offs[3] = {r_off, 1, b_off};
+					for (int c = 0; c < 3; ++c) {
+						taps[c][0][k] = row0[o0 + offs[c]];
+						taps[c][1][k] = row0[o1 + offs[c]];
+						taps[c][2][k] = row1[o0 + offs[c]];
+						taps[c][3][k] = row1[o1 + offs[c]];
+					}
+				}
+			}
+
+			if (is_yuv) {
+				yuv_lanes(taps[0][0], taps[0][1], taps[0][2], taps[0][3], wx, ty.w, u, v, r, g, b);
+			} else {
+				rgb_lanes(taps, wx, ty.w, r, g, b);
+			}
+
+			memcpy(r_plane + row_offset + dx, r, n * sizeof(float));
+			memcpy(g_plane + row_offset + dx, g, n * sizeof(float));
+			memcpy(b_plane + row_offset + dx, b, n * sizeof(float));
+		}
+	}
+}
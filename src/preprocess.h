@@ -0,0 +1,106 @@
+#ifndef PREPROCESS_H
+#define PREPROCESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "yolo_ffi.h"
+
+// Memory layout of the source pixels referenced by a FrameView.
+enum PixelLayout {
+	LAYOUT_I420,  // Y plane + U plane + V plane, chroma pixel stride may be 1 or 2
+	LAYOUT_NV21,  // Y plane + interleaved VU plane
+	LAYOUT_BGRA,
+	LAYOUT_RGBA,
+};
+
+// A camera frame as handed over by the platform. Nothing is copied, the
+// planes are read in place with their row and pixel strides.
+struct FrameView {
+	PixelLayout layout;
+	const uint8_t* planes[3];
+	int row_strides[3];
+	int pixel_strides[3];
+	int width;
+	int height;
+};
+
+// Builds a FrameView from the arguments `convert_image` receives from Dart.
+FrameView make_frame_view(
+    ImageFormat format,
+    const uint8_t* plane0,
+    const uint8_t* plane1,
+    const uint8_t* plane2,
+    int bytesPerRow0,
+    int bytesPerRow1,
+    int bytesPerRow2,
+    int bytesPerPixel1,
+    int bytesPerPixel2,
+    int width,
+    int height);
+
+// Wraps a packed RGBA buffer, the input format of `yolo_detect`. Rows are
+// `width * 4` bytes apart unless `row_stride` says otherwise.
+FrameView make_rgba_view(const uint8_t* data, int width, int height, int row_stride = 0);
+
+// Copies the pixels `frame` references into `storage` and returns a view of
+// the copy, so the caller's buffers can be released right away. `storage`
+// keeps its capacity and stops allocating once it is reused.
+FrameView copy_frame(const FrameView& frame, std::vector<uint8_t>& storage);
+
+// Bytes `copy_frame` needs for the pixels of `frame`.
+size_t frame_size(const FrameView& frame);
+
+// Same as above into `dst`, which holds at least `frame_size(frame)` bytes.
+FrameView copy_frame(const FrameView& frame, uint8_t* dst);
+
+// View of the `width x height` region at (x, y) of `frame`, in unrotated frame
+// pixels and inside the frame. Nothing is copied. YUV regions are widened to
+// even coordinates so the chroma planes stay aligned with the luma plane.
+FrameView crop_frame(const FrameView& frame, int x, int y, int width, int height);
+
+// Where the (rotated) frame lands inside the network input.
+struct InputGeometry {
+	int input_w;
+	int input_h;
+	int content_x;
+	int content_y;
+	int content_w;
+	int content_h;
+	// Converts input pixels to the space the boxes are reported in.
+	float box_scale_x;
+	float box_scale_y;
+};
+
+// Gray level the letterbox border is filled with, as in Ultralytics.
+#define LETTERBOX_PAD_VALUE 114
+
+// The frame is stretched over the whole input, boxes stay in input space.
+InputGeometry stretch_geometry(int input_w, int input_h);
+
+// The frame keeps its aspect ratio: the long side is resized to `target_size`
+// and the short side is padded up to the next multiple of `stride`, or up to
+// `target_size` when the model only accepts square inputs. Boxes are mapped
+// back to frame space.
+InputGeometry letterbox_geometry(int src_w, int src_h, int target_size, int stride, bool square);
+
+// Geometry for a model made for `model_w x model_h` inputs. Models that accept
+// other sizes run with the long side at `input_size` (0 for the model's own
+// size); stretched boxes are still reported in model input space, so they keep
+// their scale when the size changes. Fixed-size models letterbox into a square.
+InputGeometry model_input_geometry(int image_w, int image_h, ResizeMode mode, int model_w, int model_h, int input_size, int stride, bool resizable);
+
+// Maps a point from input space to the space the boxes are reported in.
+inline void map_to_source(const InputGeometry& geometry, float& x, float& y) {
+	x = (x - geometry.content_x) * geometry.box_scale_x;
+	y = (y - geometry.content_y) * geometry.box_scale_y;
+}
+
+// Single pass from the raw frame to the network input: samples the source
+// bilinearly, converts to RGB, optionally rotates 90 degrees clockwise and
+// writes normalized [0, 1] floats as three planes of `input_w x input_h`,
+// each `plane_stride` floats apart (ncnn pads its channels, ONNX does not).
+// Everything outside the content rectangle is filled with the letterbox gray.
+void preprocess_frame(const FrameView& frame, bool rotate_cw, const InputGeometry& geometry, float* dst, size_t plane_stride);
+
+#endif  // PREPROCESS_H
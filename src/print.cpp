@@ -1,100 +1,118 @@
 #include "print.h"
 
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Guards the sink: the callback below and the platform references. Only the
+// logging thread and the setters take it, never a thread that logs.
+static std::mutex sink_mutex;
+static yolo_log_callback sink_callback = NULL;
+static void* sink_user_data = NULL;
+
 #ifdef __APPLE__
 
 #include <objc/message.h>
 #include <objc/runtime.h>
 
-#include <stdio.h>
-
 // Defines the function pointer type for the Objective-C method call.
 typedef void (*IMP_printMessage)(Class, SEL, const char* message);
 
+// Exported by the Objective-C runtime. The logging thread is long-lived, so
+// each message drains its own pool instead of piling up until thread exit.
+extern "C" void* objc_autoreleasePoolPush(void);
+extern "C" void objc_autoreleasePoolPop(void* pool);
+
+static Class g_plugin_class = Nil;
+static SEL g_print_selector = NULL;
+
 /**
  * @brief Sends a message to the iOS platform via the Objective-C runtime.
  *
  * This function calls a class method `printMessage:` on the `YoloFfiPlugin`
  * class. The Objective-C implementation of this method is expected to forward
- * the message to Dart using an FlutterEventChannel.
+ * the message to Dart using an FlutterEventChannel. The class and selector
+ * are looked up once.
  *
  * Note: The class name "YoloFfiPlugin" is assumed. You may need to change this
  * to match your actual iOS plugin class name.
  *
  * @param message The string message to send.
  */
-void print_message(const char* message) {
-	Class pluginClass = objc_getClass("YoloFfiPlugin");
-
-	SEL selector = sel_registerName("printMessage:");
-
-	// IMP_printMessage imp = (IMP_printMessage)method_getImplementation(class_getClassMethod(pluginClass, selector));
-	// imp(pluginClass, selector, message);
+static void platform_sink(const char* message) {
+	if (!g_plugin_class) {
+		g_plugin_class = objc_getClass("YoloFfiPlugin");
+		g_print_selector = sel_registerName("printMessage:");
+		if (!g_plugin_class) {
+			return;
+		}
+	}
 
 	// ((void (*)(Class, SEL, const char*))objc_msgSend)(pluginClass, selector, message);
+	void* pool = objc_autoreleasePoolPush();
 	IMP_printMessage imp = (IMP_printMessage)objc_msgSend;
-	imp(pluginClass, selector, message);
+	imp(g_plugin_class, g_print_selector, message);
+	objc_autoreleasePoolPop(pool);
 }
 
-#else  //__ANDROID__
+static void platform_sink_detach() {}
+
+#elif defined(__ANDROID__)
 
 #include <jni.h>
 
 // Global JavaVM pointer, initialized on library load.
 static JavaVM* g_vm = NULL;
-// Global JNI class reference for the plugin, set via the `setup` function.
+// Global JNI class reference for the plugin and its `printMessage` method,
+// set via the `setup` function.
 static jclass g_plugin_class = NULL;
+static jmethodID g_print_method = NULL;
+// The logging thread attaches itself once, on its first message.
+static JNIEnv* g_sink_env = NULL;
 
 /**
  * @brief Sends a message to the Android platform via JNI.
  *
- * This function calls a static Java method `sendMessage` on the registered
+ * This function calls a static Java method `printMessage` on the registered
  * plugin class. The Java implementation of this method is expected to forward
- * the message to Dart using an EventChannel.
+ * the message to Dart using an EventChannel. Only ever runs on the logging
+ * thread, which stays attached to the JVM.
  *
  * @param message The string message to send.
  */
-void print_message(const char* message) {
-	if (!g_vm || !g_plugin_class) {
+static void platform_sink(const char* message) {
+	if (!g_vm || !g_plugin_class || !g_print_method) {
 		return;
 	}
-
-	JNIEnv* env = NULL;
-	bool thread_attached_by_us = false;
-
-	// Check if the current thread is already attached to the JVM.
-	jint get_env_result = g_vm->GetEnv((void**)&env, JNI_VERSION_1_6);
-
-	if (get_env_result == JNI_EDETACHED) {
-		// The thread is not attached, so we need to attach it.
-		if (g_vm->AttachCurrentThread(&env, NULL) != 0) {
-			// Failed to attach the thread.
-			return;
-		}
-		thread_attached_by_us = true;
-	} else if (get_env_result != JNI_OK) {
-		// An error occurred trying to get the JNI environment.
+	if (!g_sink_env && g_vm->AttachCurrentThread(&g_sink_env, NULL) != 0) {
+		// Failed to attach the thread.
+		g_sink_env = NULL;
 		return;
 	}
 
-	// At this point, `env` should be valid.
-	if (env) {
-		// Find the static method `printMessage` with the signature `(Ljava/lang/String;)V`.
-		jmethodID method = env->GetStaticMethodID(g_plugin_class, "printMessage", "(Ljava/lang/String;)V");
-		if (method) {
-			jstring jmessage = env->NewStringUTF(message);
-			env->CallStaticVoidMethod(g_plugin_class, method, jmessage);
-			env->DeleteLocalRef(jmessage);
-
-			if (env->ExceptionCheck()) {
-				env->ExceptionDescribe();
-			}
-		}
+	JNIEnv* env = g_sink_env;
+	jstring jmessage = env->NewStringUTF(message);
+	env->CallStaticVoidMethod(g_plugin_class, g_print_method, jmessage);
+	env->DeleteLocalRef(jmessage);
+
+	if (env->ExceptionCheck()) {
+		env->ExceptionDescribe();
+		env->ExceptionClear();
 	}
+}
 
-	// Only detach the thread if we attached it in this function call.
-	if (thread_attached_by_us) {
+// Called on the logging thread before it exits.
+static void platform_sink_detach() {
+	if (g_sink_env && g_vm) {
 		g_vm->DetachCurrentThread();
 	}
+	g_sink_env = NULL;
 }
 
 extern "C" {
@@ -129,15 +147,223 @@ void JNI_OnUnload(JavaVM* vm, void* reserved) {
  */
 JNIEXPORT void JNICALL
 Java_com_cia1099_yolo_1ffi_YoloFfiPlugin_setup(JNIEnv* env, jobject /* thiz */, jclass plugin) {
+	std::lock_guard<std::mutex> lock(sink_mutex);
 	if (g_plugin_class) {
 		env->DeleteGlobalRef(g_plugin_class);
 		g_plugin_class = NULL;
+		g_print_method = NULL;
 	}
 	if (plugin) {
 		g_plugin_class = (jclass)env->NewGlobalRef(plugin);
+		// Find the static method `printMessage` with the signature `(Ljava/lang/String;)V`.
+		g_print_method = env->GetStaticMethodID(g_plugin_class, "printMessage", "(Ljava/lang/String;)V");
+		if (!g_print_method && env->ExceptionCheck()) {
+			env->ExceptionClear();
+		}
 	}
 }
 
 }  // extern "C"
 
-#endif
\ No newline at end of file
+#else  // desktop builds, e.g. the benchmarks
+
+static void platform_sink(const char* message) {
+	fprintf(stderr, "%s\n", message);
+}
+
+static void platform_sink_detach() {}
+
+#endif
+
+// MARK: - Queue
+
+// Longer messages are truncated.
+static const int LOG_MESSAGE_SIZE = 256;
+// Must be a power of two.
+static const uint64_t LOG_QUEUE_SIZE = 128;
+
+struct LogSlot {
+	// Equals the slot's push position when it is free and one past it once
+	// the message is written, as in Vyukov's bounded queue.
+	std::atomic<uint64_t> sequence;
+	YoloLogLevel level;
+	char text[LOG_MESSAGE_SIZE];
+};
+
+// Bounded queue with any number of producers and the logging thread as its
+// only consumer.
+class Logger {
+public:
+	Logger() {
+		for (uint64_t i = 0; i < LOG_QUEUE_SIZE; ++i) {
+			slots_[i].sequence.store(i, std::memory_order_relaxed);
+		}
+		thread_ = std::thread(&Logger::run, this);
+	}
+
+	~Logger() {
+		stopping_.store(true);
+		wake_.notify_one();
+		thread_.join();
+	}
+
+	std::atomic<int> min_level{YOLO_LOG_INFO};
+	std::atomic<int> rate_limit{50};
+
+	void log(YoloLogLevel level, const char* format, va_list args) {
+		if (!allow()) {
+			dropped_.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		uint64_t position = tail_.load(std::memory_order_relaxed);
+		LogSlot* slot;
+		for (;;) {
+			slot = &slots_[position & (LOG_QUEUE_SIZE - 1)];
+			const int64_t lag = static_cast<int64_t>(slot->sequence.load(std::memory_order_acquire) - position);
+			if (lag == 0 && tail_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+				break;
+			}
+			if (lag < 0) {
+				// Full, the logging thread is behind.
+				dropped_.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			if (lag > 0) {
+				position = tail_.load(std::memory_order_relaxed);
+			}
+		}
+
+		slot->level = level;
+		vsnprintf(slot->text, sizeof(slot->text), format, args);
+		slot->sequence.store(position + 1, std::memory_order_release);
+		// Without the mutex a wakeup can be missed, the thread then picks the
+		// message up on its next timeout.
+		wake_.notify_one();
+	}
+
+	void flush() {
+		const uint64_t target = tail_.load(std::memory_order_acquire);
+		wake_.notify_one();
+		std::unique_lock<std::mutex> lock(drained_mutex_);
+		drained_.wait(lock, [&] { return head_.load(std::memory_order_acquire) >= target; });
+	}
+
+private:
+	// Fixed one-second window shared by all threads; a race at the window
+	// boundary lets a few extra messages through, which is fine.
+	bool allow() {
+		const int limit = rate_limit.load(std::memory_order_relaxed);
+		if (limit <= 0) {
+			return true;
+		}
+		using namespace std::chrono;
+		const int64_t second = duration_cast<seconds>(steady_clock::now().time_since_epoch()).count();
+		int64_t window = window_.load(std::memory_order_relaxed);
+		if (window != second && window_.compare_exchange_strong(window, second, std::memory_order_relaxed)) {
+			window_count_.store(0, std::memory_order_relaxed);
+		}
+		return window_count_.fetch_add(1, std::memory_order_relaxed) < limit;
+	}
+
+	bool pop(YoloLogLevel& level, char* text) {
+		const uint64_t position = head_.load(std::memory_order_relaxed);
+		LogSlot& slot = slots_[position & (LOG_QUEUE_SIZE - 1)];
+		if (slot.sequence.load(std::memory_order_acquire) != position + 1) {
+			return false;
+		}
+		level = slot.level;
+		memcpy(text, slot.text, LOG_MESSAGE_SIZE);
+		slot.sequence.store(position + LOG_QUEUE_SIZE, std::memory_order_release);
+		head_.store(position + 1, std::memory_order_release);
+		return true;
+	}
+
+	void deliver(YoloLogLevel level, const char* text) {
+		std::lock_guard<std::mutex> lock(sink_mutex);
+		if (sink_callback) {
+			sink_callback(level, text, sink_user_data);
+		} else {
+			platform_sink(text);
+		}
+	}
+
+	void run() {
+		YoloLogLevel level;
+		char text[LOG_MESSAGE_SIZE];
+		for (;;) {
+			while (pop(level, text)) {
+				deliver(level, text);
+			}
+			const int64_t dropped = dropped_.exchange(0, std::memory_order_relaxed);
+			if (dropped > 0) {
+				snprintf(text, sizeof(text), "%lld log messages dropped", static_cast<long long>(dropped));
+				deliver(YOLO_LOG_WARN, text);
+			}
+			{
+				std::lock_guard<std::mutex> lock(drained_mutex_);
+			}
+			drained_.notify_all();
+
+			std::unique_lock<std::mutex> lock(wake_mutex_);
+			if (stopping_.load() && head_.load() == tail_.load()) {
+				break;
+			}
+			wake_.wait_for(lock, std::chrono::milliseconds(100), [&] { return stopping_.load() || head_.load() != tail_.load(); });
+		}
+		platform_sink_detach();
+	}
+
+	LogSlot slots_[LOG_QUEUE_SIZE];
+	std::atomic<uint64_t> tail_{0};
+	std::atomic<uint64_t> head_{0};
+	std::atomic<int64_t> dropped_{0};
+	std::atomic<int64_t> window_{0};
+	std::atomic<int> window_count_{0};
+	std::atomic<bool> stopping_{false};
+	std::mutex wake_mutex_;
+	std::condition_variable wake_;
+	std::mutex drained_mutex_;
+	std::condition_variable drained_;
+	std::thread thread_;
+};
+
+// Started on first use, so libraries that never log spawn no thread.
+static Logger& logger() {
+	static Logger instance;
+	return instance;
+}
+
+void log_message(YoloLogLevel level, const char* format, ...) {
+	Logger& log = logger();
+	if (level < log.min_level.load(std::memory_order_relaxed)) {
+		return;
+	}
+	va_list args;
+	va_start(args, format);
+	log.log(level, format, args);
+	va_end(args);
+}
+
+void print_message(const char* message) {
+	log_message(YOLO_LOG_INFO, "%s", message);
+}
+
+extern "C" {
+FFI_PLUGIN_EXPORT void yolo_set_log_level(YoloLogLevel level) {
+	logger().min_level.store(level, std::memory_order_relaxed);
+}
+
+FFI_PLUGIN_EXPORT void yolo_set_log_callback(yolo_log_callback callback, void* user_data) {
+	std::lock_guard<std::mutex> lock(sink_mutex);
+	sink_callback = callback;
+	sink_user_data = user_data;
+}
+
+FFI_PLUGIN_EXPORT void yolo_set_log_rate_limit(int messages_per_second) {
+	logger().rate_limit.store(messages_per_second, std::memory_order_relaxed);
+}
+
+FFI_PLUGIN_EXPORT void yolo_flush_log() {
+	logger().flush();
+}
+}
@@ -1,13 +1,31 @@
 #ifndef PRINT_H
 #define PRINT_H
 
+#include "yolo_ffi.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 /**
- * @brief Sends a message string to the native side (Android/iOS), which should
- * then forward it to Dart via an EventChannel.
+ * @brief Queues a printf-style message for the native side (Android/iOS),
+ * which should then forward it to Dart via an EventChannel.
+ *
+ * Formats into a fixed-size queue slot on the calling thread, longer messages
+ * are truncated. Never blocks and never allocates.
+ *
+ * @param level Messages below the level set with `yolo_set_log_level` are
+ * dropped before formatting.
+ * @param format The printf format string.
+ */
+void log_message(YoloLogLevel level, const char* format, ...)
+#if defined(__GNUC__) || defined(__clang__)
+    __attribute__((format(printf, 2, 3)))
+#endif
+    ;
+
+/**
+ * @brief Queues an informational message string, see `log_message`.
  *
  * @param message The C-style string message to send.
  */
@@ -17,4 +35,4 @@ void print_message(const char* message);
 }
 #endif
 
-#endif // PRINT_H
\ No newline at end of file
+#endif // PRINT_H
@@ -0,0 +1,65 @@
+#include "resolution_controller.h"
+#include <algorithm>
+
+// Weight of the newest frame in the smoothed latency.
+static const double SMOOTHING = 0.2;
+// Frames at a size before it may be left downwards and upwards. Stepping up
+// waits longer, a throttled device should not bounce back after a few cool frames.
+static const int DOWN_FRAMES = 5;
+static const int UP_FRAMES = 30;
+// Fraction of the budget the next size up has to be predicted to fit in.
+static const double UP_HEADROOM = 0.9;
+
+// Latency at `to` predicted from the one at `from`, which scales with the pixel count.
+static double predict_ms(double latency_ms, int from, int to) {
+	const double ratio = static_cast<double>(to) / from;
+	return latency_ms * ratio * ratio;
+}
+
+static void move_to(ResolutionController& controller, const std::vector<int>& sizes, int level) {
+	controller.smoothed_ms = predict_ms(controller.smoothed_ms, sizes[controller.level], sizes[level]);
+	controller.level = level;
+	controller.frames_at_level = 0;
+}
+
+int resolution_start(ResolutionController& controller, const std::vector<int>& sizes, const std::vector<double>& latencies_ms, float budget_ms) {
+	controller.level = 0;
+	for (size_t i = 0; i < sizes.size(); ++i) {
+		if (latencies_ms[i] <= budget_ms) {
+			controller.level = static_cast<int>(i);
+		}
+	}
+	controller.smoothed_ms = latencies_ms.empty() ? 0 : latencies_ms[controller.level];
+	controller.frames_at_level = 0;
+	return sizes.empty() ? 0 : sizes[controller.level];
+}
+
+int resolution_update(ResolutionController& controller, const std::vector<int>& sizes, float budget_ms, int input_size, double latency_ms) {
+	if (sizes.empty() || budget_ms <= 0) {
+		return input_size;
+	}
+	const int count = static_cast<int>(sizes.size());
+	if (controller.level < 0 || controller.level >= count) {
+		// Not started by resolution_start: continue from the size in use if
+		// it is on the ladder, from the top otherwise.
+		auto it = std::find(sizes.begin(), sizes.end(), input_size);
+		controller.level = it != sizes.end() ? static_cast<int>(it - sizes.begin()) : count - 1;
+		controller.smoothed_ms = latency_ms;
+		controller.frames_at_level = 0;
+		return sizes[controller.level];
+	}
+	const int current = sizes[controller.level];
+	if (input_size != current) {
+		return current;
+	}
+
+	controller.smoothed_ms += SMOOTHING * (latency_ms - controller.smoothed_ms);
+	++controller.frames_at_level;
+	if (controller.level > 0 && controller.frames_at_level >= DOWN_FRAMES && controller.smoothed_ms > budget_ms) {
+		move_to(controller, sizes, controller.level - 1);
+	} else if (controller.level + 1 < count && controller.frames_at_level >= UP_FRAMES &&
+	           predict_ms(controller.smoothed_ms, current, sizes[controller.level + 1]) < budget_ms * UP_HEADROOM) {
+		move_to(controller, sizes, controller.level + 1);
+	}
+	return sizes[controller.level];
+}
@@ -0,0 +1,27 @@
+#ifndef RESOLUTION_CONTROLLER_H
+#define RESOLUTION_CONTROLLER_H
+
+#include <vector>
+
+// Holds detection latency within a budget by moving between a ladder of input
+// sizes: down as soon as the smoothed latency exceeds the budget (thermal
+// throttling, other load), up again once the next size is predicted to fit
+// with headroom.
+struct ResolutionController {
+	// Index into the ladder of the size in use, -1 before the first frame.
+	int level = -1;
+	// Smoothed latency at that size, in milliseconds.
+	double smoothed_ms = 0;
+	int frames_at_level = 0;
+};
+
+// Starts the controller at the largest size whose measured latency,
+// `latencies_ms[i]` for `sizes[i]`, fits the budget. Returns that size.
+int resolution_start(ResolutionController& controller, const std::vector<int>& sizes, const std::vector<double>& latencies_ms, float budget_ms);
+
+// Feeds the latency of a detection that ran at `input_size` and returns the
+// input size for the next one. Latencies measured at a size the controller
+// already left are ignored.
+int resolution_update(ResolutionController& controller, const std::vector<int>& sizes, float budget_ms, int input_size, double latency_ms);
+
+#endif  // RESOLUTION_CONTROLLER_H
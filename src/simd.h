@@ -0,0 +1,125 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// Minimal float vector wrappers so kernels are written once for AVX2, SSE2,
+// NEON and plain C++, plus a few byte kernels. The ISA is picked at compile
+// time from the target flags, nothing is dispatched at runtime.
+
+#include <algorithm>
+#include <stdint.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace simd {
+
+#if defined(__AVX2__)
+typedef __m256 vfloat;
+constexpr int VW = 8;
+inline vfloat vload(const float* p) { return _mm256_loadu_ps(p); }
+inline void vstore(float* p, vfloat v) { _mm256_storeu_ps(p, v); }
+inline vfloat vdup(float s) { return _mm256_set1_ps(s); }
+inline vfloat vadd(vfloat a, vfloat b) { return _mm256_add_ps(a, b); }
+inline vfloat vsub(vfloat a, vfloat b) { return _mm256_sub_ps(a, b); }
+inline vfloat vmul(vfloat a, vfloat b) { return _mm256_mul_ps(a, b); }
+inline vfloat vmin(vfloat a, vfloat b) { return _mm256_min_ps(a, b); }
+inline vfloat vmax(vfloat a, vfloat b) { return _mm256_max_ps(a, b); }
+// Comparisons return all-ones lanes where true.
+inline vfloat vgt(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+inline vfloat vselect(vfloat mask, vfloat a, vfloat b) { return _mm256_blendv_ps(b, a, mask); }
+inline bool vany(vfloat mask) { return _mm256_movemask_ps(mask) != 0; }
+#elif defined(__SSE2__)
+typedef __m128 vfloat;
+constexpr int VW = 4;
+inline vfloat vload(const float* p) { return _mm_loadu_ps(p); }
+inline void vstore(float* p, vfloat v) { _mm_storeu_ps(p, v); }
+inline vfloat vdup(float s) { return _mm_set1_ps(s); }
+inline vfloat vadd(vfloat a, vfloat b) { return _mm_add_ps(a, b); }
+inline vfloat vsub(vfloat a, vfloat b) { return _mm_sub_ps(a, b); }
+inline vfloat vmul(vfloat a, vfloat b) { return _mm_mul_ps(a, b); }
+inline vfloat vmin(vfloat a, vfloat b) { return _mm_min_ps(a, b); }
+inline vfloat vmax(vfloat a, vfloat b) { return _mm_max_ps(a, b); }
+inline vfloat vgt(vfloat a, vfloat b) { return _mm_cmpgt_ps(a, b); }
+inline vfloat vselect(vfloat mask, vfloat a, vfloat b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+inline bool vany(vfloat mask) { return _mm_movemask_ps(mask) != 0; }
+#elif defined(__ARM_NEON)
+typedef float32x4_t vfloat;
+constexpr int VW = 4;
+inline vfloat vload(const float* p) { return vld1q_f32(p); }
+inline void vstore(float* p, vfloat v) { vst1q_f32(p, v); }
+inline vfloat vdup(float s) { return vdupq_n_f32(s); }
+inline vfloat vadd(vfloat a, vfloat b) { return vaddq_f32(a, b); }
+inline vfloat vsub(vfloat a, vfloat b) { return vsubq_f32(a, b); }
+inline vfloat vmul(vfloat a, vfloat b) { return vmulq_f32(a, b); }
+inline vfloat vmin(vfloat a, vfloat b) { return vminq_f32(a, b); }
+inline vfloat vmax(vfloat a, vfloat b) { return vmaxq_f32(a, b); }
+inline vfloat vgt(vfloat a, vfloat b) { return vreinterpretq_f32_u32(vcgtq_f32(a, b)); }
+inline vfloat vselect(vfloat mask, vfloat a, vfloat b) { return vbslq_f32(vreinterpretq_u32_f32(mask), a, b); }
+#if defined(__aarch64__)
+inline bool vany(vfloat mask) { return vmaxvq_u32(vreinterpretq_u32_f32(mask)) != 0; }
+#else
+inline bool vany(vfloat mask) {
+	uint32x2_t m = vorr_u32(vget_low_u32(vreinterpretq_u32_f32(mask)), vget_high_u32(vreinterpretq_u32_f32(mask)));
+	return (vget_lane_u32(m, 0) | vget_lane_u32(m, 1)) != 0;
+}
+#endif
+#else
+typedef float vfloat;
+constexpr int VW = 1;
+inline vfloat vload(const float* p) { return *p; }
+inline void vstore(float* p, vfloat v) { *p = v; }
+inline vfloat vdup(float s) { return s; }
+inline vfloat vadd(vfloat a, vfloat b) { return a + b; }
+inline vfloat vsub(vfloat a, vfloat b) { return a - b; }
+inline vfloat vmul(vfloat a, vfloat b) { return a * b; }
+inline vfloat vmin(vfloat a, vfloat b) { return std::min(a, b); }
+inline vfloat vmax(vfloat a, vfloat b) { return std::max(a, b); }
+// The scalar fallback keeps masks as 1.0 / 0.0.
+inline vfloat vgt(vfloat a, vfloat b) { return a > b ? 1.f : 0.f; }
+inline vfloat vselect(vfloat mask, vfloat a, vfloat b) { return mask != 0.f ? a : b; }
+inline bool vany(vfloat mask) { return mask != 0.f; }
+#endif
+
+inline vfloat vclamp01(vfloat a) { return vmin(vmax(a, vdup(0.f)), vdup(1.f)); }
+
+// Sum of absolute differences of `n` bytes.
+inline uint32_t sad_u8(const uint8_t* a, const uint8_t* b, int n) {
+	uint32_t sum = 0;
+	int i = 0;
+#if defined(__AVX2__)
+	__m256i acc = _mm256_setzero_si256();
+	for (; i + 32 <= n; i += 32) {
+		acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i))));
+	}
+	alignas(32) uint64_t lanes[4];
+	_mm256_store_si256((__m256i*)lanes, acc);
+	sum = static_cast<uint32_t>(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+#elif defined(__SSE2__)
+	__m128i acc = _mm_setzero_si128();
+	for (; i + 16 <= n; i += 16) {
+		acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i))));
+	}
+	sum = static_cast<uint32_t>(_mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8)));
+#elif defined(__ARM_NEON)
+	uint32x4_t acc = vdupq_n_u32(0);
+	for (; i + 16 <= n; i += 16) {
+		uint8x16_t diff = vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+		acc = vpadalq_u16(acc, vpaddlq_u8(diff));
+	}
+	uint64x2_t pairs = vpaddlq_u32(acc);
+	sum = static_cast<uint32_t>(vgetq_lane_u64(pairs, 0) + vgetq_lane_u64(pairs, 1));
+#endif
+	for (; i < n; ++i) {
+		sum += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+	}
+	return sum;
+}
+
+}  // namespace simd
+
+#endif  // SIMD_H
@@ -0,0 +1,46 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+
+// Bounded lock-free queue between exactly one producer thread and one
+// consumer thread. Holds up to `Capacity` elements, neither side ever blocks.
+template <typename T, size_t Capacity>
+class SpscRing {
+public:
+	// Returns false if the ring is full.
+	bool try_push(const T& value) {
+		const size_t tail = tail_.load(std::memory_order_relaxed);
+		if (tail - head_.load(std::memory_order_acquire) == Capacity) {
+			return false;
+		}
+		slots_[tail % Capacity] = value;
+		tail_.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Returns false if the ring is empty.
+	bool try_pop(T& value) {
+		const size_t head = head_.load(std::memory_order_relaxed);
+		if (tail_.load(std::memory_order_acquire) == head) {
+			return false;
+		}
+		value = slots_[head % Capacity];
+		head_.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Only meaningful on the producer side, the consumer may free a slot any time.
+	bool full() const { return tail_.load(std::memory_order_relaxed) - head_.load(std::memory_order_acquire) == Capacity; }
+
+	bool empty() const { return tail_.load(std::memory_order_acquire) == head_.load(std::memory_order_acquire); }
+
+private:
+	T slots_[Capacity];
+	// Producer and consumer counters on separate cache lines.
+	alignas(64) std::atomic<size_t> head_{0};
+	alignas(64) std::atomic<size_t> tail_{0};
+};
+
+#endif  // SPSC_RING_H
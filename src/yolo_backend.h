@@ -0,0 +1,74 @@
+#ifndef YOLO_BACKEND_H
+#define YOLO_BACKEND_H
+
+#include <opencv2/core.hpp>
+#include <vector>
+#include "detect_settings.h"
+#include "detection.h"
+#include "model_source.h"
+#include "preprocess.h"
+
+// The inference backend behind the handle API. ncnn_ffi.cpp, onnx_ffi.cpp and
+// coreml_ffi.mm each implement these functions; exactly one of them is linked.
+struct BackendModel;
+
+// Returns nullptr when the model cannot be loaded. Backends ignore the
+// options they have no equivalent for, and may only support loading from a path.
+BackendModel* backend_open(const ModelSource& source, const yolo_options& options);
+void backend_close(BackendModel* model);
+
+// Whether backend_open applies any of yolo_options. Auto-tuning is skipped if not.
+bool backend_has_options(BackendModel* model);
+
+// Detects on a packed RGBA image. `detections` is overwritten and keeps its
+// capacity, the backend reuses its own buffers across calls.
+void backend_detect(BackendModel* model, cv::InputArray image, float conf_threshold, float nms_threshold, const DetectSettings& settings, std::vector<Detection>& detections);
+
+// Detects directly on camera planes, rotating them 90 degrees clockwise first if asked.
+void backend_detect_frame(BackendModel* model, const FrameView& frame, bool rotate_cw, float conf_threshold, float nms_threshold, const DetectSettings& settings, std::vector<Detection>& detections);
+
+// Detects on several RGBA images, batching them where the backend can.
+// Returns one list of detections per image, in order.
+std::vector<std::vector<Detection>> backend_detect_batch(BackendModel* model, const std::vector<cv::Mat>& images, float conf_threshold, float nms_threshold, const DetectSettings& settings);
+
+// The input the model was made for, as far as the model says.
+struct ModelInput {
+	int width;
+	int height;
+	// Whether the model also runs at other input sizes, see DetectSettings::input_size.
+	bool resizable;
+};
+
+ModelInput backend_model_input(BackendModel* model);
+
+// Returns a copy of the model's input name to be released with free_string,
+// or nullptr if the backend does not know it.
+const char* backend_input_name(BackendModel* model);
+
+// MARK: - Stages used by the async pipeline
+
+// Whether the backend can run preprocessing and inference as separate steps.
+// If not (CoreML feeds Vision an image), the pipeline runs
+// backend_detect_frame in its inference stage instead.
+bool backend_has_stages(BackendModel* model);
+
+// Where a frame of the given (rotated) size lands in the network input, with
+// `input_size` on its long side (0 for the model's own size).
+InputGeometry backend_input_geometry(BackendModel* model, int image_w, int image_h, ResizeMode mode, int input_size);
+
+// Runs the network on three planes of `input_w x input_h` normalized floats
+// and copies the raw head to `output`, [channels, anchors] for YOLOv8/11 or
+// [detections, 6] for end-to-end models. `num_masks` of the values per anchor
+// or row are mask coefficients of a segmentation model, whose masks the
+// pipeline does not compute.
+bool backend_infer(BackendModel* model, float* input, const InputGeometry& geometry, std::vector<float>& output, int& num_channels, int& num_anchors, int& num_masks);
+
+// MARK: - Classifiers for the cascade stage
+
+// Runs a classification model on `count` crops of `size x size`, packed as
+// [count, 3, size, size] normalized floats, and copies the [count, classes]
+// scores to `scores`. Backends without a batch dimension run the crops one by
+// one on the same session. Only backends with stages can run classifiers.
+bool backend_classify(BackendModel* model, float* input, int count, int size, std::vector<float>& scores, int& num_classes);
+
+#endif  // YOLO_BACKEND_H
@@ -0,0 +1,69 @@
+#include "yolo_cascade.h"
+#include <algorithm>
+#include <cmath>
+
+void classify_detections(Cascade& cascade, const FrameView& frame, bool rotate_cw, const InputGeometry& geometry, std::vector<Detection>& detections) {
+	for (Detection& detection : detections) {
+		detection.crop_class_id = -1;
+		detection.crop_confidence = 0.f;
+	}
+	if (!cascade.classifier || cascade.crop_size <= 0 || detections.empty()) {
+		return;
+	}
+
+	// Letterboxed boxes are in frame space already, stretched ones in input space.
+	const int image_w = rotate_cw ? frame.height : frame.width;
+	const int image_h = rotate_cw ? frame.width : frame.height;
+	const float scale_x = image_w / (geometry.content_w * geometry.box_scale_x);
+	const float scale_y = image_h / (geometry.content_h * geometry.box_scale_y);
+
+	const int limit = cascade.max_crops > 0 ? std::min(cascade.max_crops, static_cast<int>(detections.size())) : static_cast<int>(detections.size());
+	cascade.crops.clear();
+	cascade.crop_detections.clear();
+	for (int i = 0; i < limit; ++i) {
+		const cv::Rect2f& box = detections[i].box;
+		const int left = std::max(0, static_cast<int>(std::floor(box.x * scale_x)));
+		const int top = std::max(0, static_cast<int>(std::floor(box.y * scale_y)));
+		const int right = std::min(image_w, static_cast<int>(std::ceil((box.x + box.width) * scale_x)));
+		const int bottom = std::min(image_h, static_cast<int>(std::ceil((box.y + box.height) * scale_y)));
+		if (right <= left || bottom <= top) {
+			continue;
+		}
+		// A clockwise rotation takes source pixel (x, y) to (height - 1 - y, x),
+		// so box columns are source rows counted from the bottom.
+		if (rotate_cw) {
+			cascade.crops.push_back(crop_frame(frame, top, frame.height - right, bottom - top, right - left));
+		} else {
+			cascade.crops.push_back(crop_frame(frame, left, top, right - left, bottom - top));
+		}
+		cascade.crop_detections.push_back(i);
+	}
+	const int count = static_cast<int>(cascade.crops.size());
+	if (count == 0) {
+		return;
+	}
+
+	// Crops are stretched over the square input, so the classifier sees the
+	// whole box. Each one is sampled, converted and normalized in one pass.
+	const int size = cascade.crop_size;
+	const size_t plane_size = static_cast<size_t>(size) * size;
+	const InputGeometry crop_geometry = stretch_geometry(size, size);
+	cascade.input.resize(count * 3 * plane_size);
+	cv::parallel_for_(cv::Range(0, count), [&](const cv::Range& range) {
+		for (int i = range.start; i < range.end; ++i) {
+			preprocess_frame(cascade.crops[i], rotate_cw, crop_geometry, cascade.input.data() + i * 3 * plane_size, plane_size);
+		}
+	});
+
+	int num_classes = 0;
+	if (!backend_classify(cascade.classifier, cascade.input.data(), count, size, cascade.scores, num_classes) || num_classes <= 0) {
+		return;
+	}
+	for (int i = 0; i < count; ++i) {
+		const float* scores = cascade.scores.data() + static_cast<size_t>(i) * num_classes;
+		const float* best = std::max_element(scores, scores + num_classes);
+		Detection& detection = detections[cascade.crop_detections[i]];
+		detection.crop_class_id = static_cast<int>(best - scores);
+		detection.crop_confidence = *best;
+	}
+}
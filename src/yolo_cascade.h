@@ -0,0 +1,33 @@
+#ifndef YOLO_CASCADE_H
+#define YOLO_CASCADE_H
+
+#include <vector>
+#include "detection.h"
+#include "preprocess.h"
+#include "yolo_backend.h"
+
+// Second stage run on the detections of a frame: a classification model,
+// such as product type or plate readability, labels the crop of every box.
+struct Cascade {
+	// nullptr while no classifier is set.
+	BackendModel* classifier = nullptr;
+	// Side of the square classifier input.
+	int crop_size = 0;
+	// Detections classified per frame, best first, 0 for all of them.
+	int max_crops = 0;
+	// Scratch of `classify_detections`.
+	std::vector<float> input;
+	std::vector<float> scores;
+	std::vector<FrameView> crops;
+	std::vector<int> crop_detections;
+};
+
+// Sets `crop_class_id` and `crop_confidence` of `detections`, whose boxes are
+// in the space `geometry` reports them in, from the classifier run on crops
+// of `frame`. Every crop goes straight from the camera planes to its slice of
+// one [crops, 3, size, size] input in a single resize pass, and the
+// classifier runs once for all of them. Detections beyond `max_crops` or
+// with an empty box keep -1.
+void classify_detections(Cascade& cascade, const FrameView& frame, bool rotate_cw, const InputGeometry& geometry, std::vector<Detection>& detections);
+
+#endif  // YOLO_CASCADE_H
@@ -0,0 +1,176 @@
+#include "yolo_decode.h"
+#include <algorithm>
+#include "simd.h"
+
+using namespace simd;
+
+// Anchors scanned per class row before moving to the next class. 80 rows of
+// 256 floats stay in L2 while the running maxima live in L1.
+static const int TILE = 256;
+
+void Candidates::clear() {
+	x1.clear();
+	y1.clear();
+	x2.clear();
+	y2.clear();
+	scores.clear();
+	class_ids.clear();
+	sources.clear();
+}
+
+void Candidates::push_back(float left, float top, float right, float bottom, float score, int class_id, int source) {
+	x1.push_back(left);
+	y1.push_back(top);
+	x2.push_back(right);
+	y2.push_back(bottom);
+	scores.push_back(score);
+	class_ids.push_back(class_id);
+	sources.push_back(source);
+}
+
+void decode_yolo(const float* output, int num_channels, int num_anchors, float conf_threshold, const std::vector<float>& class_thresholds, const InputGeometry& geometry, Candidates& candidates) {
+	candidates.clear();
+	const int num_classes = num_channels - 4;
+	if (!output || num_classes <= 0 || num_anchors <= 0) {
+		return;
+	}
+
+	// Resolve the class filter once per frame. Disabled classes are never loaded.
+	thread_local std::vector<int> active_classes;
+	thread_local std::vector<float> thresholds;
+	active_classes.clear();
+	thresholds.clear();
+	bool uniform = true;
+	for (int c = 0; c < num_classes; ++c) {
+		float threshold = conf_threshold;
+		if (c < static_cast<int>(class_thresholds.size())) {
+			if (class_thresholds[c] < 0) {
+				continue;
+			}
+			if (class_thresholds[c] > 0) {
+				threshold = class_thresholds[c];
+			}
+		}
+		uniform = uniform && threshold == conf_threshold;
+		active_classes.push_back(c);
+		thresholds.push_back(threshold);
+	}
+	if (active_classes.empty()) {
+		return;
+	}
+
+	// With per-class thresholds, scores that miss their own threshold are
+	// zeroed before the max, so any positive maximum already passed.
+	const float cutoff = uniform ? conf_threshold : 0.f;
+
+	alignas(32) float best[TILE];
+	alignas(32) float best_class[TILE];
+
+	for (int base = 0; base < num_anchors; base += TILE) {
+		const int n = std::min(TILE, num_anchors - base);
+		const int n_vec = n / VW * VW;
+		std::fill(best, best + n, 0.f);
+		std::fill(best_class, best_class + n, -1.f);
+
+		for (size_t k = 0; k < active_classes.size(); ++k) {
+			const int c = active_classes[k];
+			const float* row = output + static_cast<size_t>(4 + c) * num_anchors + base;
+			const float threshold = uniform ? 0.f : thresholds[k];
+			const vfloat v_class = vdup(static_cast<float>(c));
+			const vfloat v_threshold = vdup(threshold);
+			const vfloat v_zero = vdup(0.f);
+
+			int i = 0;
+			for (; i < n_vec; i += VW) {
+				vfloat score = vload(row + i);
+				if (!uniform) {
+					score = vselect(vgt(score, v_threshold), score, v_zero);
+				}
+				vfloat current = vload(best + i);
+				vfloat better = vgt(score, current);
+				vstore(best + i, vselect(better, score, current));
+				vstore(best_class + i, vselect(better, v_class, vload(best_class + i)));
+			}
+			for (; i < n; ++i) {
+				float score = row[i];
+				if (!uniform && !(score > threshold)) {
+					score = 0.f;
+				}
+				if (score > best[i]) {
+					best[i] = score;
+					best_class[i] = static_cast<float>(c);
+				}
+			}
+		}
+
+		// Early exit: background tiles are the common case, skip the box rows.
+		vfloat v_max = vdup(0.f);
+		int i = 0;
+		for (; i < n_vec; i += VW) {
+			v_max = vmax(v_max, vload(best + i));
+		}
+		bool any = vany(vgt(v_max, vdup(cutoff)));
+		for (; i < n && !any; ++i) {
+			any = best[i] > cutoff;
+		}
+		if (!any) {
+			continue;
+		}
+
+		for (int j = 0; j < n; ++j) {
+			if (!(best[j] > cutoff)) {
+				continue;
+			}
+			const float* anchor = output + base + j;
+			float cx = anchor[0 * static_cast<size_t>(num_anchors)];
+			float cy = anchor[1 * static_cast<size_t>(num_anchors)];
+			float w = anchor[2 * static_cast<size_t>(num_anchors)];
+			float h = anchor[3 * static_cast<size_t>(num_anchors)];
+
+			float x1 = cx - 0.5f * w;
+			float y1 = cy - 0.5f * h;
+			float x2 = cx + 0.5f * w;
+			float y2 = cy + 0.5f * h;
+			map_to_source(geometry, x1, y1);
+			map_to_source(geometry, x2, y2);
+			candidates.push_back(x1, y1, x2, y2, best[j], static_cast<int>(best_class[j]), base + j);
+		}
+	}
+}
+
+void decode_end_to_end(const float* output, int num_rows, int row_size, float conf_threshold, const std::vector<float>& class_thresholds, const InputGeometry& geometry, Candidates& candidates) {
+	candidates.clear();
+	if (!output || num_rows <= 0 || row_size < END_TO_END_ROW) {
+		return;
+	}
+	const int num_thresholds = static_cast<int>(class_thresholds.size());
+	for (int r = 0; r < num_rows; ++r) {
+		const float* row = output + static_cast<size_t>(r) * row_size;
+		const float score = row[4];
+		// Padding rows of a head with fewer boxes than rows score 0.
+		if (!(score > 0.f)) {
+			continue;
+		}
+		const int class_id = static_cast<int>(row[5]);
+		float threshold = conf_threshold;
+		if (class_id >= 0 && class_id < num_thresholds) {
+			if (class_thresholds[class_id] < 0) {
+				continue;
+			}
+			if (class_thresholds[class_id] > 0) {
+				threshold = class_thresholds[class_id];
+			}
+		}
+		if (!(score > threshold)) {
+			continue;
+		}
+
+		float x1 = row[0];
+		float y1 = row[1];
+		float x2 = row[2];
+		float y2 = row[3];
+		map_to_source(geometry, x1, y1);
+		map_to_source(geometry, x2, y2);
+		candidates.push_back(x1, y1, x2, y2, score, class_id, r);
+	}
+}
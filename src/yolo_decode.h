@@ -0,0 +1,45 @@
+#ifndef YOLO_DECODE_H
+#define YOLO_DECODE_H
+
+#include <stddef.h>
+#include <vector>
+#include "preprocess.h"
+
+// Boxes that passed their class threshold, one array per field so that the
+// following NMS can stream through them.
+struct Candidates {
+	std::vector<float> x1;
+	std::vector<float> y1;
+	std::vector<float> x2;
+	std::vector<float> y2;
+	std::vector<float> scores;
+	std::vector<int> class_ids;
+	// Anchor or row of the head each candidate came from, where its mask
+	// coefficients are.
+	std::vector<int> sources;
+
+	size_t size() const { return scores.size(); }
+	void clear();
+	void push_back(float left, float top, float right, float bottom, float score, int class_id, int source);
+};
+
+// Decodes a YOLOv8/11 head laid out as [4 + num_classes, num_anchors]: rows of
+// cx, cy, w, h followed by one row of scores per class. Anchors are processed
+// in SIMD lanes along the contiguous anchor dimension and whole tiles without
+// a passing score are dropped before any box is read.
+//
+// `class_thresholds` is indexed by class id: a negative value disables the
+// class, 0 keeps `conf_threshold` and a positive value replaces it. Classes
+// past its end use `conf_threshold`. Boxes are mapped with `geometry`.
+void decode_yolo(const float* output, int num_channels, int num_anchors, float conf_threshold, const std::vector<float>& class_thresholds, const InputGeometry& geometry, Candidates& candidates);
+
+// Values per row of an end-to-end head: x1, y1, x2, y2, score, class id.
+static const int END_TO_END_ROW = 6;
+
+// Decodes an NMS-free head laid out as [num_rows, row_size], each row holding
+// an already selected box as x1, y1, x2, y2, score and class id, possibly
+// followed by more values. Rows are filtered by score with the same
+// `class_thresholds` as decode_yolo and mapped with `geometry`.
+void decode_end_to_end(const float* output, int num_rows, int row_size, float conf_threshold, const std::vector<float>& class_thresholds, const InputGeometry& geometry, Candidates& candidates);
+
+#endif  // YOLO_DECODE_H
@@ -28,34 +28,40 @@ FFI_PLUGIN_EXPORT uint8_t* convert_image(
     int width,
     int height,
     bool isAndroid) {
-	cv::Mat rgba_image = cv::Mat4b::zeros(height, width);
+	uint8_t* data = new uint8_t[static_cast<size_t>(width) * height * 4];
+
+	// Without rotation the conversion writes into the result directly,
+	// otherwise into a per-thread image that is rotated into it.
+	thread_local cv::Mat upright;
+	cv::Mat rgba_image = isAndroid ? upright : cv::Mat(height, width, CV_8UC4, data);
 
 	switch (format) {
 		case YUV420: {
 			// For YUV420, we have 3 planes (Y, U, V).
-			// We need to construct the YUV image before converting to RGBA.
+			// I420 format has Y plane first, then U, then V, each contiguous, so
+			// the planes are merged into a single Mat before converting to RGBA.
 			cv::Mat y(height, width, CV_8UC1, plane0, bytesPerRow0);
 			cv::Mat u(height / 2, width / 2, CV_8UC1, plane1, bytesPerRow1);
 			cv::Mat v(height / 2, width / 2, CV_8UC1, plane2, bytesPerRow2);
 
-			cv::Mat yuv_image;
-			// This is a bit tricky. We need to merge the planes.
-			// I420 format has Y plane first, then U, then V.
-			// Let's create a single Mat for YUV data.
-			cv::Mat yuv_mat(height * 3 / 2, width, CV_8UC1);
-			// Copy Y plane
+			thread_local cv::Mat yuv_mat;
+			yuv_mat.create(height * 3 / 2, width, CV_8UC1);
 			y.copyTo(yuv_mat(cv::Rect(0, 0, width, height)));
-			// Copy U plane
-			u.copyTo(yuv_mat(cv::Rect(0, height, width / 2, height / 2)));
-			// Copy V plane
-			v.copyTo(yuv_mat(cv::Rect(width / 2, height, width / 2, height / 2)));
+			// The chroma planes fill the rows below Y without row padding, U's
+			// w * h / 4 bytes first and V's right after.
+			uint8_t* chroma = yuv_mat.ptr<uint8_t>(height);
+			cv::Mat u_plane(height / 2, width / 2, CV_8UC1, chroma);
+			cv::Mat v_plane(height / 2, width / 2, CV_8UC1, chroma + static_cast<size_t>(width / 2) * (height / 2));
+			u.copyTo(u_plane);
+			v.copyTo(v_plane);
 
 			cv::cvtColor(yuv_mat, rgba_image, cv::COLOR_YUV2RGBA_I420);
 			break;
 		}
 		case NV21: {
-			// For NV21, we have 2 planes (Y, UV).
-			cv::Mat yuv_image(height + height / 2, width, CV_8UC1, plane0);
+			// For NV21, we have 2 planes (Y, UV), with the VU rows following the
+			// Y rows at the same, possibly padded, stride.
+			cv::Mat yuv_image(height + height / 2, width, CV_8UC1, plane0, bytesPerRow0 > 0 ? bytesPerRow0 : width);
 			cv::cvtColor(yuv_image, rgba_image, cv::COLOR_YUV2RGBA_NV21);
 			break;
 		}
@@ -67,13 +73,10 @@ FFI_PLUGIN_EXPORT uint8_t* convert_image(
 	}
 
 	if (isAndroid) {
-		cv::rotate(rgba_image, rgba_image, cv::ROTATE_90_CLOCKWISE);
+		upright = rgba_image;
+		cv::Mat rotated(width, height, CV_8UC4, data);
+		cv::rotate(upright, rotated, cv::ROTATE_90_CLOCKWISE);
 	}
-
-	int size = rgba_image.total() * rgba_image.elemSize();
-	uint8_t* data = new uint8_t[size];
-	memcpy(data, rgba_image.data, size);
-
 	return data;
 }
 
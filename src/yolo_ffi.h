@@ -2,6 +2,7 @@
 #define YOLO_FFI_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #if defined(_WIN32)
@@ -21,22 +22,320 @@ typedef enum {
 	NV21 = 4,
 } ImageFormat;
 
+// How a frame is fitted into the network input.
+typedef enum {
+	// Stretch to the model input (usually 640x640), boxes are reported in
+	// model input space.
+	RESIZE_STRETCH = 0,
+	// Keep the aspect ratio and pad the short side up to a multiple of 32
+	// (e.g. 640x384 for 16:9), boxes are reported in frame space.
+	RESIZE_LETTERBOX = 1,
+} ResizeMode;
+
+// How the network's output head is laid out.
+typedef enum {
+	// End-to-end when the output has more rows than values per row, anchors otherwise.
+	OUTPUT_LAYOUT_AUTO = 0,
+	// YOLOv8/11: [4 + classes, anchors] of cx, cy, w, h and class scores,
+	// decoded and filtered with NMS.
+	OUTPUT_LAYOUT_ANCHORS = 1,
+	// YOLOv10/26 and other NMS-free heads: [detections, 6] rows of x1, y1,
+	// x2, y2, score and class id, used as they are.
+	OUTPUT_LAYOUT_END_TO_END = 2,
+} OutputLayout;
+
+// Graph optimizations ONNX Runtime applies when a model is loaded, same values
+// as its GraphOptimizationLevel.
+typedef enum {
+	GRAPH_OPTIMIZATION_DISABLE = 0,
+	GRAPH_OPTIMIZATION_BASIC = 1,
+	GRAPH_OPTIMIZATION_EXTENDED = 2,
+	GRAPH_OPTIMIZATION_ALL = 99,
+} GraphOptimization;
+
+// Cores the inference threads run on.
+typedef enum {
+	CPU_AFFINITY_ALL = 0,
+	CPU_AFFINITY_LITTLE = 1,
+	CPU_AFFINITY_BIG = 2,
+	// Only the cores set in `cpu_mask`.
+	CPU_AFFINITY_MASK = 3,
+} CpuAffinity;
+
+// Engine options fixed when a model is loaded. Start from `yolo_default_options`.
+typedef struct {
+	// Threads used inside one inference. 0 keeps the backend's default: one
+	// thread for ONNX Runtime, the big cores for ncnn (or the selected ones).
+	int num_threads;
+	// ncnn pins the threads of each inference to the model's cores, whichever
+	// thread runs it. ONNX Runtime only supports CPU_AFFINITY_MASK.
+	CpuAffinity cpu_affinity;
+	// Bit i selects core i, used with CPU_AFFINITY_MASK.
+	uint64_t cpu_mask;
+	// Idle inference threads spin for new work instead of sleeping: lower
+	// latency, more power.
+	bool spin_wait;
+	// Only used by ONNX Runtime.
+	GraphOptimization graph_optimization;
+	// ncnn math paths. Turning one off can help where its kernels are slow or
+	// lose precision on a given CPU.
+	bool use_winograd;
+	bool use_sgemm;
+	bool use_fp16;
+	bool use_bf16;
+	// Lets ncnn run the quantized layers of an int8 model, made with the
+	// yolo_int8_model build target, with int8 kernels. Float models are
+	// unaffected.
+	bool use_int8;
+	// Times candidate thread counts, affinities and math flags on synthetic
+	// frames while loading and keeps the fastest. Makes loading take several
+	// times longer, read the result back with `yolo_handle_get_options` to
+	// reuse it without tuning.
+	bool auto_tune;
+	// Detections run on synthetic frames before loading returns, so lazy
+	// engine setup and buffer growth do not land on the first real frame.
+	// Frames are `warmup_width x warmup_height`, 0 for the model input size;
+	// pass the camera's frame size when letterboxing. 0 frames skips warmup.
+	int warmup_frames;
+	int warmup_width;
+	int warmup_height;
+} yolo_options;
+
+// Where the time went while loading a model, see `yolo_handle_get_load_stats`.
+typedef struct {
+	// Reading the model and building the engine, ONNX graph optimization
+	// included. With `auto_tune`, loading is part of `tune_ns` instead.
+	int64_t open_ns;
+	int64_t tune_ns;
+	// All warmup frames.
+	int64_t warmup_ns;
+	// The first warmup frame, what the first real frame would have cost, and
+	// the last one, close to steady state.
+	int64_t first_frame_ns;
+	int64_t last_frame_ns;
+} YoloLoadStats;
+
+// Instance mask of one detection, see `get_masks`.
+typedef struct {
+	// Pixels the mask covers, the detection's box rounded out to whole pixels
+	// and clipped to the frame, in the same space as the box.
+	int x;
+	int y;
+	int width;
+	int height;
+	// One bit per pixel, row by row, each row starting on a new byte:
+	// pixel (x, y) is bit x % 8 of byte y * ((width + 7) / 8) + x / 8.
+	// NULL for an empty mask.
+	const uint8_t* bits;
+} YoloMask;
+
+// Counters of the motion gate, see `set_motion_gate`.
+typedef struct {
+	// Frames the network ran on.
+	int64_t inferred;
+	// Frames answered with the previous detections.
+	int64_t skipped;
+	// Change metric of the last frame, compare it with the threshold.
+	float last_change;
+} YoloMotionStats;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 FFI_PLUGIN_EXPORT void load_model(const char* model_path);
 
+// Same as `load_model` with engine options, NULL uses the defaults.
+FFI_PLUGIN_EXPORT void load_model_with_options(const char* model_path, const yolo_options* options);
+
+// Same as `load_model_with_options` with the model passed as bytes, see
+// `yolo_create_from_memory`.
+FFI_PLUGIN_EXPORT void load_model_from_memory(const uint8_t* param, size_t param_size, const uint8_t* weights, size_t weights_size, const yolo_options* options);
+
+// Caches what backends derive from a model in `dir` across app starts,
+// currently ONNX Runtime's optimized graph, which then loads without being
+// optimized again. Entries are keyed by a hash of the model, so updated
+// models never pick up stale ones. Affects models loaded afterwards; NULL or
+// "" turns caching off, the default.
+FFI_PLUGIN_EXPORT void yolo_set_cache_dir(const char* dir);
+
+FFI_PLUGIN_EXPORT YoloLoadStats get_model_load_stats();
+
+// Engine options of the loaded model, after auto-tuning.
+FFI_PLUGIN_EXPORT yolo_options get_model_options();
+
 FFI_PLUGIN_EXPORT const char* get_model_input_name();
 
 FFI_PLUGIN_EXPORT void free_string(const char* str);
 
 FFI_PLUGIN_EXPORT void close_model();
 
+// Selects how subsequent detections fit frames into the network input.
+FFI_PLUGIN_EXPORT void set_resize_mode(ResizeMode mode);
+
+// Sets per-class score thresholds, indexed by class id. A negative value drops
+// the class entirely, 0 keeps the `conf_threshold` passed to detection and a
+// positive value replaces it. Classes beyond `count` use `conf_threshold`.
+// Pass NULL or a count of 0 to detect every class with `conf_threshold` again.
+FFI_PLUGIN_EXPORT void set_class_thresholds(const float* thresholds, int count);
+
+// Caps the number of detections returned per frame (300 by default).
+// Pass 0 to return every box that survives NMS.
+FFI_PLUGIN_EXPORT void set_max_detections(int max_detections);
+
+// Selects how the model's output is decoded. The default, OUTPUT_LAYOUT_AUTO,
+// tells the two layouts apart by their shape; set it explicitly for models
+// where that guess can be wrong, such as end-to-end heads with very few rows.
+// NMS is skipped for end-to-end models, `nms_threshold` has no effect on them.
+FFI_PLUGIN_EXPORT void set_output_layout(OutputLayout layout);
+
+// Computes instance masks for segmentation (YOLO-seg) models, off by default.
+// Masks are made only for the detections that survive NMS, and only inside
+// their boxes, which costs far less than full-frame masks but still adds
+// around a millisecond per frame with many objects. Other models ignore it.
+// Tiled detection does not produce masks.
+FFI_PLUGIN_EXPORT void set_masks(bool enabled);
+
+// Copies up to `capacity` masks of the last detection into `masks`, in the
+// same order as its boxes, and returns how many were written. The bits stay
+// valid until the next detection or model load. The `track` functions and the
+// async pipeline do not return masks.
+FFI_PLUGIN_EXPORT int get_masks(YoloMask* masks, int capacity);
+
+// Skips the network on frames that barely changed, for fixed cameras on
+// mostly static scenes. Each frame's luma is reduced to a small thumbnail and
+// compared with the one of the last detected frame block by block, on an 8x6
+// grid; while the most changed block stays below `threshold` (its mean
+// absolute difference on the 0-255 scale, around 4-8 ignores sensor noise and
+// still catches an object a few percent of the frame wide) the detect
+// functions return the previous detections again. After
+// `max_skipped_frames` skips in a row (0 for no limit) the network runs
+// anyway, so slow changes are not missed. 0 turns the gate off, the default.
+FFI_PLUGIN_EXPORT void set_motion_gate(float threshold, int max_skipped_frames);
+
+FFI_PLUGIN_EXPORT YoloMotionStats get_motion_stats();
+
+// Detects RGBA images wider or taller than `tile_size` pixels tile by tile,
+// e.g. 640 for high resolution stills with small objects. Tiles overlap by
+// `overlap` of their size (0.2 is a good start), tiles of flat color are
+// skipped, and the whole image is detected once more at model size for
+// objects larger than a tile. Costs roughly one inference per tile.
+// 0 turns tiling off, the default.
+FFI_PLUGIN_EXPORT void set_tiling(int tile_size, float overlap);
+
+// Runs the network with `input_size` pixels on the long side of its input,
+// rounded to a multiple of 32, instead of the size the model was made for
+// (read from the model, 640 if it does not say). Smaller is faster and misses
+// more small objects. Only models exported with a dynamic input shape accept
+// other sizes. 0 goes back to the model's size.
+FFI_PLUGIN_EXPORT void set_input_size(int input_size);
+
+// Long side of the network input in use.
+FFI_PLUGIN_EXPORT int get_input_size();
+
+// Keeps detections within `budget_ms` by switching between the `count` input
+// sizes in `input_sizes` (e.g. 320, 416, 512, 640) at runtime: a smaller size
+// as soon as detections run over budget, e.g. under thermal throttling, and a
+// larger one once it fits with headroom again. Each size is run once up front,
+// which takes a few detections' time, and the controller starts from the
+// largest one that fits. Stretched boxes stay in model input space whatever
+// the size. A budget of 0 turns the controller off and goes back to the
+// model's size.
+FFI_PLUGIN_EXPORT void set_latency_budget(const int* input_sizes, int count, float budget_ms);
+
 FFI_PLUGIN_EXPORT DetectionResult yolo_detect(uint8_t* image_data, int height, int width, float conf_threshold, float nms_threshold);
 
 FFI_PLUGIN_EXPORT void free_result(DetectionResult result);
 
+// Detects objects on `count` RGBA images in one call, e.g. when re-processing
+// recorded footage. Frames go through the network `set_batch_size` at a time
+// and are decoded in parallel. `results` must hold `count` entries, each one
+// released with `free_result`. Returns the number of frames processed, 0 if no
+// model is loaded.
+FFI_PLUGIN_EXPORT int yolo_detect_batch(uint8_t** images, const int* heights, const int* widths, int count, float conf_threshold, float nms_threshold, DetectionResult* results);
+
+// Sets how many frames `yolo_detect_batch` runs through the network together
+// (8 by default). ONNX models exported with a fixed batch size use that instead.
+FFI_PLUGIN_EXPORT void set_batch_size(int batch_size);
+
+// Detects objects directly on a camera frame. Takes the same plane arguments as
+// `convert_image` and feeds the model without building an intermediate RGBA image.
+FFI_PLUGIN_EXPORT DetectionResult yolo_detect_yuv(
+    ImageFormat format,
+    uint8_t* plane0,
+    uint8_t* plane1,
+    uint8_t* plane2,
+    int bytesPerRow0,
+    int bytesPerRow1,
+    int bytesPerRow2,
+    int bytesPerPixel1,
+    int bytesPerPixel2,
+    int width,
+    int height,
+    bool isAndroid,
+    float conf_threshold,
+    float nms_threshold);
+
+// Same as `yolo_detect`, but writes up to `capacity` detections of 6 floats
+// [x1, y1, x2, y2, class_id, conf] into the caller's `out`, best first, and
+// returns how many were written. Buffers are reused across frames, so once the
+// frame size is stable no memory is allocated besides the inference engine's own.
+FFI_PLUGIN_EXPORT int yolo_detect_into(uint8_t* image_data, int height, int width, float conf_threshold, float nms_threshold, float* out, int capacity);
+
+// Same as `yolo_detect_yuv`, writing into `out` like `yolo_detect_into`.
+FFI_PLUGIN_EXPORT int yolo_detect_yuv_into(
+    ImageFormat format,
+    uint8_t* plane0,
+    uint8_t* plane1,
+    uint8_t* plane2,
+    int bytesPerRow0,
+    int bytesPerRow1,
+    int bytesPerRow2,
+    int bytesPerPixel1,
+    int bytesPerPixel2,
+    int width,
+    int height,
+    bool isAndroid,
+    float conf_threshold,
+    float nms_threshold,
+    float* out,
+    int capacity);
+
+// Detects with tracking, for consecutive frames of one video stream. The
+// detector runs every `set_tracking` interval; on the frames in between a
+// Kalman tracker moves the last detections along. Writes up to `capacity`
+// tracks of 7 floats [x1, y1, x2, y2, class_id, conf, track_id] into `out`,
+// best first, and returns how many were written. A track keeps its id for
+// as long as it is followed. Confidences fade while tracks are only predicted.
+FFI_PLUGIN_EXPORT int yolo_track_into(uint8_t* image_data, int height, int width, float conf_threshold, float nms_threshold, float* out, int capacity);
+
+// Same as `yolo_track_into` on camera planes, see `yolo_detect_yuv`.
+FFI_PLUGIN_EXPORT int yolo_track_yuv_into(
+    ImageFormat format,
+    uint8_t* plane0,
+    uint8_t* plane1,
+    uint8_t* plane2,
+    int bytesPerRow0,
+    int bytesPerRow1,
+    int bytesPerRow2,
+    int bytesPerPixel1,
+    int bytesPerPixel2,
+    int width,
+    int height,
+    bool isAndroid,
+    float conf_threshold,
+    float nms_threshold,
+    float* out,
+    int capacity);
+
+// Runs the detector of the `track` functions on every `detect_interval`-th
+// frame (1 by default, every frame) and sooner whenever the mean confidence
+// of the tracks falls below `min_confidence` (0 by default, never).
+FFI_PLUGIN_EXPORT void set_tracking(int detect_interval, float min_confidence);
+
+// Forgets every track, e.g. on a scene cut. Ids start over.
+FFI_PLUGIN_EXPORT void reset_tracks();
+
 FFI_PLUGIN_EXPORT uint8_t* convert_image(
     ImageFormat format,
     uint8_t* plane0,
@@ -53,6 +352,339 @@ FFI_PLUGIN_EXPORT uint8_t* convert_image(
 
 FFI_PLUGIN_EXPORT void free_rgba_buffer(uint8_t* buffer);
 
+// MARK: - Handles
+// Every handle owns its model and settings, so several models can be loaded at
+// once and different handles can detect concurrently from different threads.
+// Calls on the same handle are serialized. The functions above act on a
+// default handle created by `load_model`.
+
+typedef struct YoloHandle* yolo_handle_t;
+
+// Loads a model, returns NULL on failure. Release with `yolo_destroy`.
+// Model files are memory-mapped rather than read, and handles loading the
+// same file share one read-only mapping of its weights.
+FFI_PLUGIN_EXPORT yolo_handle_t yolo_create(const char* model_path);
+
+FFI_PLUGIN_EXPORT yolo_options yolo_default_options();
+
+// Same as `yolo_create` with engine options, NULL uses the defaults.
+FFI_PLUGIN_EXPORT yolo_handle_t yolo_create_with_options(const char* model_path, const yolo_options* options);
+
+// Loads a model from bytes already in memory, such as Flutter asset bytes,
+// without writing them to a file first. ncnn takes the .param text in `param`
+// and the .bin in `weights`, ONNX the whole model in `weights` and NULL in
+// `param`; CoreML only loads from a path. The bytes are copied, so the caller
+// may free them on return. Returns NULL on failure.
+FFI_PLUGIN_EXPORT yolo_handle_t yolo_create_from_memory(const uint8_t* param, size_t param_size, const uint8_t* weights, size_t weights_size, const yolo_options* options);
+
+FFI_PLUGIN_EXPORT yolo_options yolo_handle_get_options(yolo_handle_t handle);
+
+FFI_PLUGIN_EXPORT YoloLoadStats yolo_handle_get_load_stats(yolo_handle_t handle);
+
+// Waits for a detection in progress on the handle, then frees it.
+FFI_PLUGIN_EXPORT void yolo_destroy(yolo_handle_t handle);
+
+FFI_PLUGIN_EXPORT DetectionResult yolo_handle_detect(yolo_handle_t handle, uint8_t* image_data, int height, int width, float conf_threshold, float nms_threshold);
+
+FFI_PLUGIN_EXPORT DetectionResult yolo_handle_detect_yuv(
+    yolo_handle_t handle,
+    ImageFormat format,
+    uint8_t* plane0,
+    uint8_t* plane1,
+    uint8_t* plane2,
+    int bytesPerRow0,
+    int bytesPerRow1,
+    int bytesPerRow2,
+    int bytesPerPixel1,
+    int bytesPerPixel2,
+    int width,
+    int height,
+    bool isAndroid,
+    float conf_threshold,
+    float nms_threshold);
+
+FFI_PLUGIN_EXPORT int yolo_handle_detect_into(yolo_handle_t handle, uint8_t* image_data, int height, int width, float conf_threshold, float nms_threshold, float* out, int capacity);
+
+FFI_PLUGIN_EXPORT int yolo_handle_detect_yuv_into(
+    yolo_handle_t handle,
+    ImageFormat format,
+    uint8_t* plane0,
+    uint8_t* plane1,
+    uint8_t* plane2,
+    int bytesPerRow0,
+    int bytesPerRow1,
+    int bytesPerRow2,
+    int bytesPerPixel1,
+    int bytesPerPixel2,
+    int width,
+    int height,
+    bool isAndroid,
+    float conf_threshold,
+    float nms_threshold,
+    float* out,
+    int capacity);
+
+FFI_PLUGIN_EXPORT int yolo_handle_detect_batch(yolo_handle_t handle, uint8_t** images, const int* heights, const int* widths, int count, float conf_threshold, float nms_threshold, DetectionResult* results);
+
+FFI_PLUGIN_EXPORT void yolo_handle_set_batch_size(yolo_handle_t handle, int batch_size);
+
+FFI_PLUGIN_EXPORT void yolo_handle_set_resize_mode(yolo_handle_t handle, ResizeMode mode);
+
+FFI_PLUGIN_EXPORT void yolo_handle_set_class_thresholds(yolo_handle_t handle, const float* thresholds, int count);
+
+FFI_PLUGIN_EXPORT void yolo_handle_set_max_detections(yolo_handle_t handle, int max_detections);
+
+FFI_PLUGIN_EXPORT void yolo_handle_set_output_layout(yolo_handle_t handle, OutputLayout layout);
+
+FFI_PLUGIN_EXPORT void yolo_handle_set_masks(yolo_handle_t handle, bool enabled);
+
+FFI_PLUGIN_EXPORT int yolo_handle_get_masks(yolo_handle_t handle, YoloMask* masks, int capacity);
+
+// Adds a second stage that classifies the crop of every detected box after
+// NMS, e.g. with an Ultralytics -cls export for product type or plate
+// readability. All crops of a frame are resized straight from the camera
+// planes into one batched input and classified in a single call, instead of
+// a round trip through Dart per box. `crop_size` is the classifier's input
+// side, 0 for the size the model states; `max_crops` caps the detections
+// classified per frame, best first, 0 for all. The classifier is loaded with
+// the handle's options, and NULL removes it. Returns false if it cannot be
+// loaded. Not available with CoreML.
+FFI_PLUGIN_EXPORT bool yolo_handle_set_classifier(yolo_handle_t handle, const char* model_path, int crop_size, int max_crops);
+
+// Classes the crop classifier gave the detections returned last, in the same
+// order: the class id and score of detection i in `class_ids[i]` and
+// `confidences[i]`, -1 and 0 for detections it did not see. Returns the
+// number written.
+FFI_PLUGIN_EXPORT int yolo_handle_get_crop_classes(yolo_handle_t handle, int* class_ids, float* confidences, int capacity);
+
+FFI_PLUGIN_EXPORT int yolo_handle_track_into(yolo_handle_t handle, uint8_t* image_data, int height, int width, float conf_threshold, float nms_threshold, float* out, int capacity);
+
+FFI_PLUGIN_EXPORT int yolo_handle_track_yuv_into(
+    yolo_handle_t handle,
+    ImageFormat format,
+    uint8_t* plane0,
+    uint8_t* plane1,
+    uint8_t* plane2,
+    int bytesPerRow0,
+    int bytesPerRow1,
+    int bytesPerRow2,
+    int bytesPerPixel1,
+    int bytesPerPixel2,
+    int width,
+    int height,
+    bool isAndroid,
+    float conf_threshold,
+    float nms_threshold,
+    float* out,
+    int capacity);
+
+FFI_PLUGIN_EXPORT void yolo_handle_set_tracking(yolo_handle_t handle, int detect_interval, float min_confidence);
+
+FFI_PLUGIN_EXPORT void yolo_handle_reset_tracks(yolo_handle_t handle);
+
+FFI_PLUGIN_EXPORT void yolo_handle_set_tiling(yolo_handle_t handle, int tile_size, float overlap);
+
+FFI_PLUGIN_EXPORT void yolo_handle_set_input_size(yolo_handle_t handle, int input_size);
+
+FFI_PLUGIN_EXPORT int yolo_handle_get_input_size(yolo_handle_t handle);
+
+FFI_PLUGIN_EXPORT void yolo_handle_set_latency_budget(yolo_handle_t handle, const int* input_sizes, int count, float budget_ms);
+
+FFI_PLUGIN_EXPORT void yolo_handle_set_motion_gate(yolo_handle_t handle, float threshold, int max_skipped_frames);
+
+FFI_PLUGIN_EXPORT YoloMotionStats yolo_handle_get_motion_stats(yolo_handle_t handle);
+
+// MARK: - Async pipeline
+// Runs preprocessing, inference and decode/NMS of a handle on three worker
+// threads, so the next frame is prepared while the current one is inferred.
+// Frames are copied on submit, except for frame pool slots, which are read in
+// place. When inference falls behind, a newer frame replaces the one still
+// waiting and the stale frame is dropped.
+
+typedef struct YoloPipeline* yolo_pipeline_t;
+
+// Receives the detections of one frame on the pipeline's decode thread.
+// Release `result` with `free_result`. From Dart, pass a
+// `NativeCallable.listener` so the call is forwarded to the owning isolate.
+typedef void (*yolo_result_callback)(int64_t frame_id, DetectionResult result, void* user_data);
+
+// Starts the worker threads. The handle must outlive the pipeline.
+FFI_PLUGIN_EXPORT yolo_pipeline_t yolo_pipeline_create(yolo_handle_t handle, yolo_result_callback callback, void* user_data);
+
+// Queues an RGBA frame and returns immediately. Returns false if the frame was
+// dropped because every buffer is in flight. Submit from one thread at a time.
+FFI_PLUGIN_EXPORT bool yolo_pipeline_submit(yolo_pipeline_t pipeline, uint8_t* image_data, int height, int width, float conf_threshold, float nms_threshold, int64_t frame_id);
+
+// Same as `yolo_pipeline_submit` for camera planes, see `yolo_detect_yuv`.
+FFI_PLUGIN_EXPORT bool yolo_pipeline_submit_yuv(
+    yolo_pipeline_t pipeline,
+    ImageFormat format,
+    uint8_t* plane0,
+    uint8_t* plane1,
+    uint8_t* plane2,
+    int bytesPerRow0,
+    int bytesPerRow1,
+    int bytesPerRow2,
+    int bytesPerPixel1,
+    int bytesPerPixel2,
+    int width,
+    int height,
+    bool isAndroid,
+    float conf_threshold,
+    float nms_threshold,
+    int64_t frame_id);
+
+// Number of submitted frames that never produced a result.
+FFI_PLUGIN_EXPORT int64_t yolo_pipeline_dropped(yolo_pipeline_t pipeline);
+
+// Stops the worker threads. Frames still in flight are discarded without a callback.
+FFI_PLUGIN_EXPORT void yolo_pipeline_destroy(yolo_pipeline_t pipeline);
+
+// MARK: - Frame pool
+// A fixed set of aligned native frame buffers, so camera frames reach the
+// pipeline without per-frame allocations or copies. Fill a slot, either with
+// RGBA through `yolo_frame_pool_data` (e.g. as a Dart `asTypedList` view) or
+// with camera planes through `yolo_frame_pool_write_yuv`, then hand it to
+// `yolo_pipeline_submit_slot`; RGBA slots can also be detected in place with
+// `yolo_detect_into`. Slots are
+// reference counted: the pipeline holds its own reference until it has
+// preprocessed the frame, so the owner may release right after submitting.
+// Slot indexes are plain ints and can be sent across isolates.
+
+typedef struct YoloFramePool* yolo_frame_pool_t;
+
+// Allocates `slot_count` slots of `slot_size` bytes, e.g. width * height * 4
+// for RGBA frames or bytesPerRow0 * height * 3 / 2 for camera planes.
+// Returns nullptr on invalid sizes.
+FFI_PLUGIN_EXPORT yolo_frame_pool_t yolo_frame_pool_create(int slot_count, size_t slot_size);
+
+// Frees the pool. Destroy the pipelines slots were submitted to first.
+FFI_PLUGIN_EXPORT void yolo_frame_pool_destroy(yolo_frame_pool_t pool);
+
+// Takes a free slot for the caller, or returns -1 if every slot is in use.
+// Thread-safe and lock-free.
+FFI_PLUGIN_EXPORT int yolo_frame_pool_acquire(yolo_frame_pool_t pool);
+
+// Memory of a slot the caller holds, `yolo_frame_pool_slot_size` bytes, or
+// nullptr for a free slot.
+FFI_PLUGIN_EXPORT uint8_t* yolo_frame_pool_data(yolo_frame_pool_t pool, int slot);
+
+FFI_PLUGIN_EXPORT size_t yolo_frame_pool_slot_size(yolo_frame_pool_t pool);
+
+// Copies camera planes into a held slot as they are, with their strides and
+// chroma pixel strides, and records their layout for
+// `yolo_pipeline_submit_slot`. Conversion and rotation happen once, when the
+// pipeline preprocesses the frame. Returns false if the frame does not fit.
+FFI_PLUGIN_EXPORT bool yolo_frame_pool_write_yuv(
+    yolo_frame_pool_t pool,
+    int slot,
+    ImageFormat format,
+    uint8_t* plane0,
+    uint8_t* plane1,
+    uint8_t* plane2,
+    int bytesPerRow0,
+    int bytesPerRow1,
+    int bytesPerRow2,
+    int bytesPerPixel1,
+    int bytesPerPixel2,
+    int width,
+    int height,
+    bool isAndroid);
+
+// Gives a slot back. It is free again once every reference is released.
+FFI_PLUGIN_EXPORT void yolo_frame_pool_release(yolo_frame_pool_t pool, int slot);
+
+// Queues the frame in a held slot like `yolo_pipeline_submit`, without
+// copying it. `height` and `width` describe RGBA written through
+// `yolo_frame_pool_data` and are ignored for slots filled with
+// `yolo_frame_pool_write_yuv`. The pipeline takes its own reference, the
+// caller still releases theirs. Returns false if the frame was dropped.
+FFI_PLUGIN_EXPORT bool yolo_pipeline_submit_slot(yolo_pipeline_t pipeline, yolo_frame_pool_t pool, int slot, int height, int width, float conf_threshold, float nms_threshold, int64_t frame_id);
+
+// MARK: - Stats
+// Every detection records nanosecond stage timings into a fixed-size
+// lock-free ring shared by all models in the process. Nothing is formatted
+// or logged per frame, query the numbers with `yolo_get_stats`.
+
+typedef enum {
+	YOLO_STAGE_PREPROCESS = 0,
+	YOLO_STAGE_INFERENCE = 1,
+	YOLO_STAGE_DECODE = 2,
+	YOLO_STAGE_NMS = 3,
+	// Whole frame. In the async pipeline this runs from submit to result and
+	// includes the time spent waiting between stages.
+	YOLO_STAGE_TOTAL = 4,
+	// Instance masks of segmentation models, 0 without `set_masks`.
+	YOLO_STAGE_MASK = 5,
+	YOLO_STAGE_COUNT = 6,
+} YoloStage;
+
+#define YOLO_STATS_BUCKETS 32
+// Number of frame records kept, older ones are overwritten.
+#define YOLO_STATS_RECORDS 1024
+
+typedef struct {
+	// Steady clock when the frame started, in nanoseconds.
+	int64_t timestamp_ns;
+	// Indexed by YoloStage. Batched frames share the preprocessing and
+	// inference time of their batch evenly.
+	int64_t stage_ns[YOLO_STAGE_COUNT];
+	// Boxes above the confidence threshold that entered NMS.
+	int32_t candidates;
+	int32_t detections;
+} YoloFrameStats;
+
+typedef struct {
+	int64_t frames;
+	// Indexed by YoloStage, for the mean.
+	int64_t sum_ns[YOLO_STAGE_COUNT];
+	// histogram[stage][0] counts frames under 1 us, histogram[stage][i] frames
+	// from 2^(i-1) up to 2^i us. The last bucket takes everything slower.
+	int64_t histogram[YOLO_STAGE_COUNT][YOLO_STATS_BUCKETS];
+} YoloStats;
+
+// Copies the aggregated histograms into `stats` (may be NULL) and the last
+// `capacity` frame records, oldest first, into `records`. Returns the number
+// of records written.
+FFI_PLUGIN_EXPORT int yolo_get_stats(YoloStats* stats, YoloFrameStats* records, int capacity);
+
+// Clears the histograms and forgets the records so far.
+FFI_PLUGIN_EXPORT void yolo_reset_stats();
+
+// MARK: - Logging
+// Library messages go through a bounded queue to a background thread, which
+// hands them to the sink: the plugin's `printMessage` on Android and iOS,
+// stderr elsewhere, or the callback set below. Logging never blocks the
+// caller; messages that do not fit, or exceed the rate limit, are dropped and
+// counted in a later message.
+
+typedef enum {
+	YOLO_LOG_DEBUG = 0,
+	YOLO_LOG_INFO = 1,
+	YOLO_LOG_WARN = 2,
+	YOLO_LOG_ERROR = 3,
+	// Only as a minimum level, turns logging off.
+	YOLO_LOG_OFF = 4,
+} YoloLogLevel;
+
+// Called on the logging thread, one message at a time. `message` is only
+// valid during the call.
+typedef void (*yolo_log_callback)(YoloLogLevel level, const char* message, void* user_data);
+
+// Drops messages below `level`, YOLO_LOG_INFO by default.
+FFI_PLUGIN_EXPORT void yolo_set_log_level(YoloLogLevel level);
+
+// Sends messages to `callback` instead of the platform sink, NULL restores
+// it. Once this returns the previous callback is no longer running.
+FFI_PLUGIN_EXPORT void yolo_set_log_callback(yolo_log_callback callback, void* user_data);
+
+// Caps messages per second, 0 for no limit. 50 by default.
+FFI_PLUGIN_EXPORT void yolo_set_log_rate_limit(int messages_per_second);
+
+// Waits until the messages logged so far reached the sink. Must not be
+// called from the log callback.
+FFI_PLUGIN_EXPORT void yolo_flush_log();
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,963 @@
+#include "yolo_handle.h"
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+#include "print.h"
+#include "yolo_ffi.h"
+#include "yolo_stats.h"
+#include "yolo_tiling.h"
+#include "yolo_tune.h"
+
+// Input sizes are multiples of the largest YOLO stride.
+static const int INPUT_STRIDE = 32;
+
+// Settings of the default handle, kept across model reloads.
+static DetectSettings default_settings;
+// The handle behind the handle-less API. Detections hold their own reference,
+// so close_model or a reload never frees a model that is still running.
+static std::shared_ptr<YoloHandle> default_handle;
+static std::mutex default_mutex;
+// Set by yolo_set_cache_dir, read by every load.
+static std::string cache_dir;
+static std::mutex cache_dir_mutex;
+
+static std::shared_ptr<YoloHandle> get_default_handle() {
+	std::lock_guard<std::mutex> lock(default_mutex);
+	return default_handle;
+}
+
+DetectionResult to_result(const std::vector<Detection>& detections) {
+	int num_detections = detections.size();
+	if (num_detections == 0) {
+		return {nullptr, 0};
+	}
+
+	// Allocate memory for the flat array of detection results.
+	// Each detection has 6 floats: [x, y, w, h, class_id, conf]
+	float* const bboxes = new float[num_detections * 6];
+
+	for (int i = 0; i < num_detections; ++i) {
+		bboxes[i * 6 + 0] = detections[i].box.x;
+		bboxes[i * 6 + 1] = detections[i].box.y;
+		bboxes[i * 6 + 2] = detections[i].box.br().x;
+		bboxes[i * 6 + 3] = detections[i].box.br().y;
+		bboxes[i * 6 + 4] = static_cast<float>(detections[i].class_id);
+		bboxes[i * 6 + 5] = detections[i].confidence;
+	}
+
+	return {bboxes, num_detections};
+}
+
+int write_detections(const std::vector<Detection>& detections, float* out, int capacity) {
+	if (!out || capacity <= 0) {
+		return 0;
+	}
+
+	// Detections come out of NMS sorted by score, so truncating keeps the best ones.
+	int count = std::min(static_cast<int>(detections.size()), capacity);
+	for (int i = 0; i < count; ++i) {
+		out[i * 6 + 0] = detections[i].box.x;
+		out[i * 6 + 1] = detections[i].box.y;
+		out[i * 6 + 2] = detections[i].box.br().x;
+		out[i * 6 + 3] = detections[i].box.br().y;
+		out[i * 6 + 4] = static_cast<float>(detections[i].class_id);
+		out[i * 6 + 5] = detections[i].confidence;
+	}
+	return count;
+}
+
+int write_tracks(const std::vector<Detection>& detections, float* out, int capacity) {
+	if (!out || capacity <= 0) {
+		return 0;
+	}
+
+	int count = std::min(static_cast<int>(detections.size()), capacity);
+	for (int i = 0; i < count; ++i) {
+		out[i * 7 + 0] = detections[i].box.x;
+		out[i * 7 + 1] = detections[i].box.y;
+		out[i * 7 + 2] = detections[i].box.br().x;
+		out[i * 7 + 3] = detections[i].box.br().y;
+		out[i * 7 + 4] = static_cast<float>(detections[i].class_id);
+		out[i * 7 + 5] = detections[i].confidence;
+		out[i * 7 + 6] = static_cast<float>(detections[i].track_id);
+	}
+	return count;
+}
+
+// Whether the motion gate lets the last detections stand for `frame`.
+// Called with `handle->mutex` held.
+static bool gate_skips(YoloHandle* handle, const FrameView& frame, bool rotate_cw, float conf_threshold, float nms_threshold) {
+	const DetectSettings& settings = handle->settings;
+	return settings.motion_threshold > 0 && motion_gate_skip(handle->gate, frame, rotate_cw, conf_threshold, nms_threshold, settings.motion_threshold, settings.motion_max_skipped);
+}
+
+void adapt_resolution(YoloHandle* handle, int input_size, int64_t elapsed_ns) {
+	const DetectSettings& settings = handle->settings;
+	if (settings.latency_budget_ms <= 0 || settings.input_sizes.empty() || !handle->model_input.resizable) {
+		return;
+	}
+	const int next = resolution_update(handle->resolution, settings.input_sizes, settings.latency_budget_ms, input_size, elapsed_ns / 1e6);
+	if (next != settings.input_size) {
+		std::lock_guard<std::mutex> settings_lock(handle->settings_mutex);
+		handle->settings.input_size = next;
+	}
+}
+
+// Runs `detect` and lets the resolution controller see how long it took.
+// Returns the input size the detections were made at. Called with
+// `handle->mutex` held.
+template <typename Detect>
+static int detect_adaptive(YoloHandle* handle, Detect&& detect) {
+	const int input_size = handle->settings.input_size;
+	const int64_t start = stats_now_ns();
+	detect();
+	adapt_resolution(handle, input_size, stats_now_ns() - start);
+	return input_size;
+}
+
+// Classifies the crops of the detections just made on `frame` at
+// `input_size`, if the handle has a classifier. Called with `handle->mutex` held.
+static void classify_crops(YoloHandle* handle, const FrameView& frame, bool rotate_cw, int input_size) {
+	if (!handle->cascade.classifier) {
+		return;
+	}
+	const int image_w = rotate_cw ? frame.height : frame.width;
+	const int image_h = rotate_cw ? frame.width : frame.height;
+	const InputGeometry geometry = backend_input_geometry(handle->model, image_w, image_h, handle->settings.resize_mode, input_size);
+	classify_detections(handle->cascade, frame, rotate_cw, geometry, handle->detections);
+}
+
+// Runs the detector through `detect` when the tracker asks for it, else only
+// moves the tracks along. Called with `handle->mutex` held.
+template <typename Detect>
+static int track_frame(YoloHandle* handle, float* out, int capacity, Detect&& detect) {
+	const DetectSettings& settings = handle->settings;
+	if (handle->tracker.needs_detection(settings.detect_interval, settings.track_min_confidence)) {
+		detect_adaptive(handle, detect);
+		// The gate's reference no longer matches the detections.
+		handle->gate.valid = false;
+		handle->tracker.update(handle->detections, handle->tracked);
+	} else {
+		handle->tracker.predict(handle->tracked);
+	}
+	return write_tracks(handle->tracked, out, capacity);
+}
+
+// Noise at the warmup size, which keeps every anchor busy like a real scene would.
+static cv::Mat warmup_frame(YoloHandle* handle) {
+	const yolo_options& options = handle->options;
+	const int width = options.warmup_width > 0 ? options.warmup_width : handle->model_input.width;
+	const int height = options.warmup_height > 0 ? options.warmup_height : handle->model_input.height;
+	cv::Mat frame(height, width, CV_8UC4);
+	std::mt19937 rng(42);
+	for (size_t i = 0; i < frame.total() * 4; ++i) {
+		frame.data[i] = static_cast<uint8_t>(rng());
+	}
+	return frame;
+}
+
+// Runs `options.warmup_frames` detections before the handle is handed out.
+static void warm_up(YoloHandle* handle) {
+	const yolo_options& options = handle->options;
+	YoloLoadStats& stats = handle->load_stats;
+	if (options.warmup_frames <= 0) {
+		return;
+	}
+	cv::Mat frame = warmup_frame(handle);
+
+	const int64_t start = stats_now_ns();
+	for (int i = 0; i < options.warmup_frames; ++i) {
+		const int64_t tic = stats_now_ns();
+		backend_detect(handle->model, frame, 0.25f, 0.45f, handle->settings, handle->detections);
+		const int64_t elapsed = stats_now_ns() - tic;
+		if (i == 0) {
+			stats.first_frame_ns = elapsed;
+		}
+		stats.last_frame_ns = elapsed;
+	}
+	stats.warmup_ns = stats_now_ns() - start;
+	handle->detections.clear();
+}
+
+// Loads `source` and warms it up with `settings`, which the handle starts with.
+static yolo_handle_t create_handle(ModelSource source, const yolo_options* options, const DetectSettings& settings) {
+	{
+		std::lock_guard<std::mutex> lock(cache_dir_mutex);
+		source.cache_dir = cache_dir;
+	}
+	yolo_options resolved = options ? *options : yolo_default_options();
+	const int64_t start = stats_now_ns();
+	BackendModel* model = resolved.auto_tune ? tune_backend(source, resolved) : backend_open(source, resolved);
+	if (!model) {
+		return nullptr;
+	}
+	auto* handle = new YoloHandle;
+	handle->model = model;
+	handle->options = resolved;
+	handle->settings = settings;
+	handle->model_input = backend_model_input(model);
+	handle->load_stats = YoloLoadStats{};
+	(resolved.auto_tune ? handle->load_stats.tune_ns : handle->load_stats.open_ns) = stats_now_ns() - start;
+	warm_up(handle);
+
+	const YoloLoadStats& stats = handle->load_stats;
+	log_message(YOLO_LOG_INFO, "Model loaded in %.1f ms: open %.1f, tune %.1f, warmup %.1f (first frame %.1f, last %.1f)", (stats_now_ns() - start) / 1e6, stats.open_ns / 1e6, stats.tune_ns / 1e6, stats.warmup_ns / 1e6, stats.first_frame_ns / 1e6, stats.last_frame_ns / 1e6);
+	return handle;
+}
+
+// Makes `handle` the default handle.
+static void set_default_handle(yolo_handle_t handle) {
+	std::shared_ptr<YoloHandle> previous;
+	{
+		std::lock_guard<std::mutex> lock(default_mutex);
+		// Settings may have changed while the model was loading.
+		if (handle) {
+			handle->settings = default_settings;
+		}
+		previous = default_handle;
+		default_handle = handle ? std::shared_ptr<YoloHandle>(handle, yolo_destroy) : nullptr;
+	}
+	// The previous model is released here, or by the last detection still using it.
+}
+
+extern "C" {
+FFI_PLUGIN_EXPORT yolo_options yolo_default_options() {
+	yolo_options options;
+	options.num_threads = 0;
+	options.cpu_affinity = CPU_AFFINITY_ALL;
+	options.cpu_mask = 0;
+	options.spin_wait = true;
+	options.graph_optimization = GRAPH_OPTIMIZATION_ALL;
+	options.use_winograd = true;
+	options.use_sgemm = true;
+	options.use_fp16 = true;
+	options.use_bf16 = true;
+	options.use_int8 = true;
+	options.auto_tune = false;
+	options.warmup_frames = 1;
+	options.warmup_width = 0;
+	options.warmup_height = 0;
+	return options;
+}
+
+FFI_PLUGIN_EXPORT yolo_handle_t yolo_create_with_options(const char* model_path, const yolo_options* options) {
+	ModelSource source;
+	source.path = model_path ? model_path : "";
+	return create_handle(source, options, DetectSettings());
+}
+
+FFI_PLUGIN_EXPORT yolo_handle_t yolo_create_from_memory(const uint8_t* param, size_t param_size, const uint8_t* weights, size_t weights_size, const yolo_options* options) {
+	ModelSource source;
+	source.param = copy_model_bytes(param, param_size);
+	source.weights = copy_model_bytes(weights, weights_size);
+	if (!source.weights) {
+		log_message(YOLO_LOG_ERROR, "No model bytes given.");
+		return nullptr;
+	}
+	return create_handle(source, options, DetectSettings());
+}
+
+FFI_PLUGIN_EXPORT YoloLoadStats yolo_handle_get_load_stats(yolo_handle_t handle) {
+	return handle ? handle->load_stats : YoloLoadStats{};
+}
+
+FFI_PLUGIN_EXPORT void yolo_set_cache_dir(const char* dir) {
+	std::lock_guard<std::mutex> lock(cache_dir_mutex);
+	cache_dir = dir ? dir : "";
+}
+
+FFI_PLUGIN_EXPORT yolo_options yolo_handle_get_options(yolo_handle_t handle) {
+	return handle ? handle->options : yolo_default_options();
+}
+
+FFI_PLUGIN_EXPORT yolo_handle_t yolo_create(const char* model_path) {
+	return yolo_create_with_options(model_path, nullptr);
+}
+
+FFI_PLUGIN_EXPORT void yolo_destroy(yolo_handle_t handle) {
+	if (handle) {
+		{
+			// Wait for a detection still running on another thread.
+			std::lock_guard<std::mutex> lock(handle->mutex);
+			backend_close(handle->model);
+			handle->model = nullptr;
+			backend_close(handle->cascade.classifier);
+			handle->cascade.classifier = nullptr;
+		}
+		delete handle;
+	}
+}
+
+FFI_PLUGIN_EXPORT DetectionResult yolo_handle_detect(yolo_handle_t handle, uint8_t* image_data, int height, int width, float conf_threshold, float nms_threshold) {
+	if (!handle) {
+		return {nullptr, 0};
+	}
+
+	// Create a cv::Mat from the raw image data without copying.
+	// The data is expected to be in RGBA format.
+	cv::Mat image(height, width, CV_8UC4, image_data);
+
+	std::lock_guard<std::mutex> lock(handle->mutex);
+	if (!handle->model) {
+		return {nullptr, 0};
+	}
+	const FrameView frame = make_rgba_view(image_data, width, height);
+	if (!gate_skips(handle, frame, false, conf_threshold, nms_threshold)) {
+		const int input_size = detect_adaptive(handle, [&] { detect_tiled(handle->model, image, conf_threshold, nms_threshold, handle->settings, handle->detections); });
+		classify_crops(handle, frame, false, input_size);
+	}
+
+	return to_result(handle->detections);
+}
+
+FFI_PLUGIN_EXPORT int yolo_handle_detect_into(yolo_handle_t handle, uint8_t* image_data, int height, int width, float conf_threshold, float nms_threshold, float* out, int capacity) {
+	if (!handle) {
+		return 0;
+	}
+
+	cv::Mat image(height, width, CV_8UC4, image_data);
+
+	std::lock_guard<std::mutex> lock(handle->mutex);
+	if (!handle->model) {
+		return 0;
+	}
+	const FrameView frame = make_rgba_view(image_data, width, height);
+	if (!gate_skips(handle, frame, false, conf_threshold, nms_threshold)) {
+		const int input_size = detect_adaptive(handle, [&] { detect_tiled(handle->model, image, conf_threshold, nms_threshold, handle->settings, handle->detections); });
+		classify_crops(handle, frame, false, input_size);
+	}
+
+	return write_detections(handle->detections, out, capacity);
+}
+
+FFI_PLUGIN_EXPORT DetectionResult yolo_handle_detect_yuv(
+    yolo_handle_t handle,
+    ImageFormat format,
+    uint8_t* plane0,
+    uint8_t* plane1,
+    uint8_t* plane2,
+    int bytesPerRow0,
+    int bytesPerRow1,
+    int bytesPerRow2,
+    int bytesPerPixel1,
+    int bytesPerPixel2,
+    int width,
+    int height,
+    bool isAndroid,
+    float conf_threshold,
+    float nms_threshold) {
+	if (!handle) {
+		return {nullptr, 0};
+	}
+
+	FrameView frame = make_frame_view(format, plane0, plane1, plane2, bytesPerRow0, bytesPerRow1, bytesPerRow2, bytesPerPixel1, bytesPerPixel2, width, height);
+
+	std::lock_guard<std::mutex> lock(handle->mutex);
+	if (!handle->model) {
+		return {nullptr, 0};
+	}
+	// on Android the raw camera data is rotated 90 clockwise, same as convert_image
+	if (!gate_skips(handle, frame, isAndroid, conf_threshold, nms_threshold)) {
+		const int input_size = detect_adaptive(handle, [&] { backend_detect_frame(handle->model, frame, isAndroid, conf_threshold, nms_threshold, handle->settings, handle->detections); });
+		classify_crops(handle, frame, isAndroid, input_size);
+	}
+
+	return to_result(handle->detections);
+}
+
+FFI_PLUGIN_EXPORT int yolo_handle_detect_yuv_into(
+    yolo_handle_t handle,
+    ImageFormat format,
+    uint8_t* plane0,
+    uint8_t* plane1,
+    uint8_t* plane2,
+    int bytesPerRow0,
+    int bytesPerRow1,
+    int bytesPerRow2,
+    int bytesPerPixel1,
+    int bytesPerPixel2,
+    int width,
+    int height,
+    bool isAndroid,
+    float conf_threshold,
+    float nms_threshold,
+    float* out,
+    int capacity) {
+	if (!handle) {
+		return 0;
+	}
+
+	FrameView frame = make_frame_view(format, plane0, plane1, plane2, bytesPerRow0, bytesPerRow1, bytesPerRow2, bytesPerPixel1, bytesPerPixel2, width, height);
+
+	std::lock_guard<std::mutex> lock(handle->mutex);
+	if (!handle->model) {
+		return 0;
+	}
+	if (!gate_skips(handle, frame, isAndroid, conf_threshold, nms_threshold)) {
+		const int input_size = detect_adaptive(handle, [&] { backend_detect_frame(handle->model, frame, isAndroid, conf_threshold, nms_threshold, handle->settings, handle->detections); });
+		classify_crops(handle, frame, isAndroid, input_size);
+	}
+
+	return write_detections(handle->detections, out, capacity);
+}
+
+FFI_PLUGIN_EXPORT int yolo_handle_track_into(yolo_handle_t handle, uint8_t* image_data, int height, int width, float conf_threshold, float nms_threshold, float* out, int capacity) {
+	if (!handle) {
+		return 0;
+	}
+
+	cv::Mat image(height, width, CV_8UC4, image_data);
+
+	std::lock_guard<std::mutex> lock(handle->mutex);
+	if (!handle->model) {
+		return 0;
+	}
+	return track_frame(handle, out, capacity, [&] { backend_detect(handle->model, image, conf_threshold, nms_threshold, handle->settings, handle->detections); });
+}
+
+FFI_PLUGIN_EXPORT int yolo_handle_track_yuv_into(
+    yolo_handle_t handle,
+    ImageFormat format,
+    uint8_t* plane0,
+    uint8_t* plane1,
+    uint8_t* plane2,
+    int bytesPerRow0,
+    int bytesPerRow1,
+    int bytesPerRow2,
+    int bytesPerPixel1,
+    int bytesPerPixel2,
+    int width,
+    int height,
+    bool isAndroid,
+    float conf_threshold,
+    float nms_threshold,
+    float* out,
+    int capacity) {
+	if (!handle) {
+		return 0;
+	}
+
+	FrameView frame = make_frame_view(format, plane0, plane1, plane2, bytesPerRow0, bytesPerRow1, bytesPerRow2, bytesPerPixel1, bytesPerPixel2, width, height);
+
+	std::lock_guard<std::mutex> lock(handle->mutex);
+	if (!handle->model) {
+		return 0;
+	}
+	return track_frame(handle, out, capacity, [&] { backend_detect_frame(handle->model, frame, isAndroid, conf_threshold, nms_threshold, handle->settings, handle->detections); });
+}
+
+FFI_PLUGIN_EXPORT int yolo_handle_detect_batch(yolo_handle_t handle, uint8_t** images, const int* heights, const int* widths, int count, float conf_threshold, float nms_threshold, DetectionResult* results) {
+	if (!results || count <= 0) {
+		return 0;
+	}
+	for (int i = 0; i < count; ++i) {
+		results[i] = {nullptr, 0};
+	}
+	if (!handle || !images || !heights || !widths) {
+		return 0;
+	}
+
+	// Wrap every RGBA frame without copying.
+	std::vector<cv::Mat> frames;
+	frames.reserve(count);
+	for (int i = 0; i < count; ++i) {
+		frames.emplace_back(heights[i], widths[i], CV_8UC4, images[i]);
+	}
+
+	std::lock_guard<std::mutex> lock(handle->mutex);
+	if (!handle->model) {
+		return 0;
+	}
+	std::vector<std::vector<Detection>> detections = backend_detect_batch(handle->model, frames, conf_threshold, nms_threshold, handle->settings);
+
+	for (int i = 0; i < count; ++i) {
+		results[i] = to_result(detections[i]);
+	}
+	return count;
+}
+
+FFI_PLUGIN_EXPORT void yolo_handle_set_batch_size(yolo_handle_t handle, int batch_size) {
+	if (handle) {
+		std::lock_guard<std::mutex> lock(handle->mutex);
+		std::lock_guard<std::mutex> settings_lock(handle->settings_mutex);
+		handle->settings.batch_size = batch_size > 0 ? batch_size : 1;
+	}
+}
+
+FFI_PLUGIN_EXPORT void yolo_handle_set_resize_mode(yolo_handle_t handle, ResizeMode mode) {
+	if (handle) {
+		std::lock_guard<std::mutex> lock(handle->mutex);
+		std::lock_guard<std::mutex> settings_lock(handle->settings_mutex);
+		handle->settings.resize_mode = mode;
+		handle->gate.valid = false;
+	}
+}
+
+FFI_PLUGIN_EXPORT void yolo_handle_set_class_thresholds(yolo_handle_t handle, const float* thresholds, int count) {
+	if (handle) {
+		std::lock_guard<std::mutex> lock(handle->mutex);
+		std::lock_guard<std::mutex> settings_lock(handle->settings_mutex);
+		if (!thresholds || count <= 0) {
+			handle->settings.class_thresholds.clear();
+		} else {
+			handle->settings.class_thresholds.assign(thresholds, thresholds + count);
+		}
+		handle->gate.valid = false;
+	}
+}
+
+FFI_PLUGIN_EXPORT void yolo_handle_set_max_detections(yolo_handle_t handle, int max_detections) {
+	if (handle) {
+		std::lock_guard<std::mutex> lock(handle->mutex);
+		std::lock_guard<std::mutex> settings_lock(handle->settings_mutex);
+		handle->settings.max_detections = max_detections > 0 ? max_detections : 0;
+		handle->gate.valid = false;
+	}
+}
+
+FFI_PLUGIN_EXPORT void yolo_handle_set_output_layout(yolo_handle_t handle, OutputLayout layout) {
+	if (handle) {
+		std::lock_guard<std::mutex> lock(handle->mutex);
+		std::lock_guard<std::mutex> settings_lock(handle->settings_mutex);
+		handle->settings.output_layout = layout;
+		handle->gate.valid = false;
+	}
+}
+
+FFI_PLUGIN_EXPORT void yolo_handle_set_masks(yolo_handle_t handle, bool enabled) {
+	if (handle) {
+		std::lock_guard<std::mutex> lock(handle->mutex);
+		std::lock_guard<std::mutex> settings_lock(handle->settings_mutex);
+		handle->settings.masks = enabled;
+		handle->gate.valid = false;
+	}
+}
+
+FFI_PLUGIN_EXPORT int yolo_handle_get_masks(yolo_handle_t handle, YoloMask* masks, int capacity) {
+	if (!handle || !masks || capacity <= 0) {
+		return 0;
+	}
+	std::lock_guard<std::mutex> lock(handle->mutex);
+	// Same order and truncation as write_detections.
+	int count = std::min(static_cast<int>(handle->detections.size()), capacity);
+	for (int i = 0; i < count; ++i) {
+		const Detection& detection = handle->detections[i];
+		masks[i].x = detection.mask_rect.x;
+		masks[i].y = detection.mask_rect.y;
+		masks[i].width = detection.mask_rect.width;
+		masks[i].height = detection.mask_rect.height;
+		masks[i].bits = detection.mask.empty() ? nullptr : detection.mask.data();
+	}
+	return count;
+}
+
+FFI_PLUGIN_EXPORT bool yolo_handle_set_classifier(yolo_handle_t handle, const char* model_path, int crop_size, int max_crops) {
+	if (!handle) {
+		return false;
+	}
+	BackendModel* classifier = nullptr;
+	if (model_path) {
+		ModelSource source;
+		source.path = model_path;
+		{
+			std::lock_guard<std::mutex> lock(cache_dir_mutex);
+			source.cache_dir = cache_dir;
+		}
+		classifier = backend_open(source, handle->options);
+		if (!classifier) {
+			return false;
+		}
+		// Crops go in as raw tensors, which needs a backend with separate stages.
+		if (!backend_has_stages(classifier)) {
+			log_message(YOLO_LOG_ERROR, "This backend cannot run crop classifiers.");
+			backend_close(classifier);
+			return false;
+		}
+		if (crop_size <= 0) {
+			crop_size = backend_model_input(classifier).width;
+		}
+	}
+
+	BackendModel* previous;
+	{
+		std::lock_guard<std::mutex> lock(handle->mutex);
+		Cascade& cascade = handle->cascade;
+		previous = cascade.classifier;
+		cascade.classifier = classifier;
+		cascade.crop_size = crop_size;
+		cascade.max_crops = max_crops > 0 ? max_crops : 0;
+		// The last detections were classified by the previous model, or not at all.
+		handle->gate.valid = false;
+	}
+	backend_close(previous);
+	return true;
+}
+
+FFI_PLUGIN_EXPORT int yolo_handle_get_crop_classes(yolo_handle_t handle, int* class_ids, float* confidences, int capacity) {
+	if (!handle || !class_ids || !confidences || capacity <= 0) {
+		return 0;
+	}
+	std::lock_guard<std::mutex> lock(handle->mutex);
+	// Same order and truncation as write_detections.
+	int count = std::min(static_cast<int>(handle->detections.size()), capacity);
+	for (int i = 0; i < count; ++i) {
+		class_ids[i] = handle->detections[i].crop_class_id;
+		confidences[i] = handle->detections[i].crop_confidence;
+	}
+	return count;
+}
+
+FFI_PLUGIN_EXPORT void yolo_handle_set_tracking(yolo_handle_t handle, int detect_interval, float min_confidence) {
+	if (handle) {
+		std::lock_guard<std::mutex> lock(handle->mutex);
+		std::lock_guard<std::mutex> settings_lock(handle->settings_mutex);
+		handle->settings.detect_interval = detect_interval > 0 ? detect_interval : 1;
+		handle->settings.track_min_confidence = min_confidence;
+	}
+}
+
+FFI_PLUGIN_EXPORT void yolo_handle_set_motion_gate(yolo_handle_t handle, float threshold, int max_skipped_frames) {
+	if (handle) {
+		std::lock_guard<std::mutex> lock(handle->mutex);
+		std::lock_guard<std::mutex> settings_lock(handle->settings_mutex);
+		handle->settings.motion_threshold = threshold > 0 ? threshold : 0.f;
+		handle->settings.motion_max_skipped = max_skipped_frames > 0 ? max_skipped_frames : 0;
+		handle->gate.valid = false;
+	}
+}
+
+FFI_PLUGIN_EXPORT YoloMotionStats yolo_handle_get_motion_stats(yolo_handle_t handle) {
+	YoloMotionStats stats = {0, 0, 0.f};
+	if (handle) {
+		std::lock_guard<std::mutex> lock(handle->mutex);
+		stats.inferred = handle->gate.inferred;
+		stats.skipped = handle->gate.skipped;
+		stats.last_change = handle->gate.last_change;
+	}
+	return stats;
+}
+
+FFI_PLUGIN_EXPORT void yolo_handle_set_tiling(yolo_handle_t handle, int tile_size, float overlap) {
+	if (handle) {
+		std::lock_guard<std::mutex> lock(handle->mutex);
+		std::lock_guard<std::mutex> settings_lock(handle->settings_mutex);
+		handle->settings.tile_size = tile_size > 0 ? tile_size : 0;
+		handle->settings.tile_overlap = overlap;
+		handle->gate.valid = false;
+	}
+}
+
+// Rounds sizes to the network stride and sorts them, dropping duplicates.
+static std::vector<int> input_ladder(const int* sizes, int count) {
+	std::vector<int> ladder;
+	for (int i = 0; sizes && i < count; ++i) {
+		if (sizes[i] > 0) {
+			ladder.push_back(std::max(INPUT_STRIDE, (sizes[i] + INPUT_STRIDE / 2) / INPUT_STRIDE * INPUT_STRIDE));
+		}
+	}
+	std::sort(ladder.begin(), ladder.end());
+	ladder.erase(std::unique(ladder.begin(), ladder.end()), ladder.end());
+	return ladder;
+}
+
+FFI_PLUGIN_EXPORT void yolo_handle_set_input_size(yolo_handle_t handle, int input_size) {
+	if (handle) {
+		std::lock_guard<std::mutex> lock(handle->mutex);
+		if (input_size > 0 && !handle->model_input.resizable) {
+			log_message(YOLO_LOG_WARN, "The model only accepts %dx%d inputs.", handle->model_input.width, handle->model_input.height);
+			return;
+		}
+		std::lock_guard<std::mutex> settings_lock(handle->settings_mutex);
+		handle->settings.input_size = input_size > 0 ? input_ladder(&input_size, 1)[0] : 0;
+		handle->gate.valid = false;
+	}
+}
+
+FFI_PLUGIN_EXPORT int yolo_handle_get_input_size(yolo_handle_t handle) {
+	if (!handle) {
+		return 0;
+	}
+	std::lock_guard<std::mutex> settings_lock(handle->settings_mutex);
+	return handle->settings.input_size > 0 ? handle->settings.input_size : std::max(handle->model_input.width, handle->model_input.height);
+}
+
+FFI_PLUGIN_EXPORT void yolo_handle_set_latency_budget(yolo_handle_t handle, const int* input_sizes, int count, float budget_ms) {
+	if (!handle) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(handle->mutex);
+	std::vector<int> ladder = input_ladder(input_sizes, count);
+	const bool enabled = budget_ms > 0 && !ladder.empty();
+	int start_size = 0;
+	handle->resolution = ResolutionController();
+	if (enabled && !handle->model_input.resizable) {
+		log_message(YOLO_LOG_WARN, "The model only accepts %dx%d inputs, the latency budget has no effect.", handle->model_input.width, handle->model_input.height);
+	} else if (enabled && handle->model) {
+		// Every size runs twice up front: the first run pays for buffers of the
+		// new size, the second one is what the controller starts from.
+		cv::Mat frame = warmup_frame(handle);
+		DetectSettings settings = handle->settings;
+		std::vector<double> latencies;
+		for (int size : ladder) {
+			settings.input_size = size;
+			backend_detect(handle->model, frame, 0.25f, 0.45f, settings, handle->detections);
+			const int64_t tic = stats_now_ns();
+			backend_detect(handle->model, frame, 0.25f, 0.45f, settings, handle->detections);
+			latencies.push_back((stats_now_ns() - tic) / 1e6);
+			log_message(YOLO_LOG_DEBUG, "Input size %d: %.2f ms", size, latencies.back());
+		}
+		handle->detections.clear();
+		start_size = resolution_start(handle->resolution, ladder, latencies, budget_ms);
+	}
+
+	std::lock_guard<std::mutex> settings_lock(handle->settings_mutex);
+	handle->settings.input_sizes = enabled ? ladder : std::vector<int>();
+	handle->settings.latency_budget_ms = enabled ? budget_ms : 0.f;
+	handle->settings.input_size = start_size;
+	handle->gate.valid = false;
+}
+
+FFI_PLUGIN_EXPORT void yolo_handle_reset_tracks(yolo_handle_t handle) {
+	if (handle) {
+		std::lock_guard<std::mutex> lock(handle->mutex);
+		handle->tracker.reset();
+	}
+}
+
+// MARK: - Default handle
+
+// Settings the default handle is warmed up with.
+static DetectSettings get_default_settings() {
+	std::lock_guard<std::mutex> lock(default_mutex);
+	return default_settings;
+}
+
+FFI_PLUGIN_EXPORT void load_model_with_options(const char* model_path, const yolo_options* options) {
+	ModelSource source;
+	source.path = model_path ? model_path : "";
+	set_default_handle(create_handle(source, options, get_default_settings()));
+}
+
+FFI_PLUGIN_EXPORT void load_model_from_memory(const uint8_t* param, size_t param_size, const uint8_t* weights, size_t weights_size, const yolo_options* options) {
+	ModelSource source;
+	source.param = copy_model_bytes(param, param_size);
+	source.weights = copy_model_bytes(weights, weights_size);
+	set_default_handle(source.weights ? create_handle(source, options, get_default_settings()) : nullptr);
+}
+
+FFI_PLUGIN_EXPORT YoloLoadStats get_model_load_stats() {
+	std::shared_ptr<YoloHandle> handle = get_default_handle();
+	return yolo_handle_get_load_stats(handle.get());
+}
+
+FFI_PLUGIN_EXPORT void load_model(const char* model_path) {
+	load_model_with_options(model_path, nullptr);
+}
+
+FFI_PLUGIN_EXPORT yolo_options get_model_options() {
+	std::shared_ptr<YoloHandle> handle = get_default_handle();
+	return yolo_handle_get_options(handle.get());
+}
+
+FFI_PLUGIN_EXPORT DetectionResult yolo_detect(uint8_t* image_data, int height, int width, float conf_threshold, float nms_threshold) {
+	std::shared_ptr<YoloHandle> handle = get_default_handle();
+	return yolo_handle_detect(handle.get(), image_data, height, width, conf_threshold, nms_threshold);
+}
+
+FFI_PLUGIN_EXPORT DetectionResult yolo_detect_yuv(
+    ImageFormat format,
+    uint8_t* plane0,
+    uint8_t* plane1,
+    uint8_t* plane2,
+    int bytesPerRow0,
+    int bytesPerRow1,
+    int bytesPerRow2,
+    int bytesPerPixel1,
+    int bytesPerPixel2,
+    int width,
+    int height,
+    bool isAndroid,
+    float conf_threshold,
+    float nms_threshold) {
+	std::shared_ptr<YoloHandle> handle = get_default_handle();
+	return yolo_handle_detect_yuv(handle.get(), format, plane0, plane1, plane2, bytesPerRow0, bytesPerRow1, bytesPerRow2, bytesPerPixel1, bytesPerPixel2, width, height, isAndroid, conf_threshold, nms_threshold);
+}
+
+FFI_PLUGIN_EXPORT int yolo_detect_into(uint8_t* image_data, int height, int width, float conf_threshold, float nms_threshold, float* out, int capacity) {
+	std::shared_ptr<YoloHandle> handle = get_default_handle();
+	return yolo_handle_detect_into(handle.get(), image_data, height, width, conf_threshold, nms_threshold, out, capacity);
+}
+
+FFI_PLUGIN_EXPORT int yolo_detect_yuv_into(
+    ImageFormat format,
+    uint8_t* plane0,
+    uint8_t* plane1,
+    uint8_t* plane2,
+    int bytesPerRow0,
+    int bytesPerRow1,
+    int bytesPerRow2,
+    int bytesPerPixel1,
+    int bytesPerPixel2,
+    int width,
+    int height,
+    bool isAndroid,
+    float conf_threshold,
+    float nms_threshold,
+    float* out,
+    int capacity) {
+	std::shared_ptr<YoloHandle> handle = get_default_handle();
+	return yolo_handle_detect_yuv_into(handle.get(), format, plane0, plane1, plane2, bytesPerRow0, bytesPerRow1, bytesPerRow2, bytesPerPixel1, bytesPerPixel2, width, height, isAndroid, conf_threshold, nms_threshold, out, capacity);
+}
+
+FFI_PLUGIN_EXPORT int yolo_track_into(uint8_t* image_data, int height, int width, float conf_threshold, float nms_threshold, float* out, int capacity) {
+	std::shared_ptr<YoloHandle> handle = get_default_handle();
+	return yolo_handle_track_into(handle.get(), image_data, height, width, conf_threshold, nms_threshold, out, capacity);
+}
+
+FFI_PLUGIN_EXPORT int yolo_track_yuv_into(
+    ImageFormat format,
+    uint8_t* plane0,
+    uint8_t* plane1,
+    uint8_t* plane2,
+    int bytesPerRow0,
+    int bytesPerRow1,
+    int bytesPerRow2,
+    int bytesPerPixel1,
+    int bytesPerPixel2,
+    int width,
+    int height,
+    bool isAndroid,
+    float conf_threshold,
+    float nms_threshold,
+    float* out,
+    int capacity) {
+	std::shared_ptr<YoloHandle> handle = get_default_handle();
+	return yolo_handle_track_yuv_into(handle.get(), format, plane0, plane1, plane2, bytesPerRow0, bytesPerRow1, bytesPerRow2, bytesPerPixel1, bytesPerPixel2, width, height, isAndroid, conf_threshold, nms_threshold, out, capacity);
+}
+
+FFI_PLUGIN_EXPORT int yolo_detect_batch(uint8_t** images, const int* heights, const int* widths, int count, float conf_threshold, float nms_threshold, DetectionResult* results) {
+	std::shared_ptr<YoloHandle> handle = get_default_handle();
+	return yolo_handle_detect_batch(handle.get(), images, heights, widths, count, conf_threshold, nms_threshold, results);
+}
+
+FFI_PLUGIN_EXPORT void set_batch_size(int batch_size) {
+	std::lock_guard<std::mutex> lock(default_mutex);
+	default_settings.batch_size = batch_size > 0 ? batch_size : 1;
+	yolo_handle_set_batch_size(default_handle.get(), batch_size);
+}
+
+FFI_PLUGIN_EXPORT void set_resize_mode(ResizeMode mode) {
+	std::lock_guard<std::mutex> lock(default_mutex);
+	default_settings.resize_mode = mode;
+	yolo_handle_set_resize_mode(default_handle.get(), mode);
+}
+
+FFI_PLUGIN_EXPORT void set_class_thresholds(const float* thresholds, int count) {
+	std::lock_guard<std::mutex> lock(default_mutex);
+	if (!thresholds || count <= 0) {
+		default_settings.class_thresholds.clear();
+	} else {
+		default_settings.class_thresholds.assign(thresholds, thresholds + count);
+	}
+	yolo_handle_set_class_thresholds(default_handle.get(), thresholds, count);
+}
+
+FFI_PLUGIN_EXPORT void set_max_detections(int max_detections) {
+	std::lock_guard<std::mutex> lock(default_mutex);
+	default_settings.max_detections = max_detections > 0 ? max_detections : 0;
+	yolo_handle_set_max_detections(default_handle.get(), max_detections);
+}
+
+FFI_PLUGIN_EXPORT void set_output_layout(OutputLayout layout) {
+	std::lock_guard<std::mutex> lock(default_mutex);
+	default_settings.output_layout = layout;
+	yolo_handle_set_output_layout(default_handle.get(), layout);
+}
+
+FFI_PLUGIN_EXPORT void set_masks(bool enabled) {
+	std::lock_guard<std::mutex> lock(default_mutex);
+	default_settings.masks = enabled;
+	yolo_handle_set_masks(default_handle.get(), enabled);
+}
+
+FFI_PLUGIN_EXPORT int get_masks(YoloMask* masks, int capacity) {
+	std::shared_ptr<YoloHandle> handle = get_default_handle();
+	return yolo_handle_get_masks(handle.get(), masks, capacity);
+}
+
+FFI_PLUGIN_EXPORT void set_tracking(int detect_interval, float min_confidence) {
+	std::lock_guard<std::mutex> lock(default_mutex);
+	default_settings.detect_interval = detect_interval > 0 ? detect_interval : 1;
+	default_settings.track_min_confidence = min_confidence;
+	yolo_handle_set_tracking(default_handle.get(), detect_interval, min_confidence);
+}
+
+FFI_PLUGIN_EXPORT void reset_tracks() {
+	std::shared_ptr<YoloHandle> handle = get_default_handle();
+	yolo_handle_reset_tracks(handle.get());
+}
+
+FFI_PLUGIN_EXPORT void set_motion_gate(float threshold, int max_skipped_frames) {
+	std::lock_guard<std::mutex> lock(default_mutex);
+	default_settings.motion_threshold = threshold > 0 ? threshold : 0.f;
+	default_settings.motion_max_skipped = max_skipped_frames > 0 ? max_skipped_frames : 0;
+	yolo_handle_set_motion_gate(default_handle.get(), threshold, max_skipped_frames);
+}
+
+FFI_PLUGIN_EXPORT YoloMotionStats get_motion_stats() {
+	std::shared_ptr<YoloHandle> handle = get_default_handle();
+	return yolo_handle_get_motion_stats(handle.get());
+}
+
+FFI_PLUGIN_EXPORT void set_tiling(int tile_size, float overlap) {
+	std::lock_guard<std::mutex> lock(default_mutex);
+	default_settings.tile_size = tile_size > 0 ? tile_size : 0;
+	default_settings.tile_overlap = overlap;
+	yolo_handle_set_tiling(default_handle.get(), tile_size, overlap);
+}
+
+FFI_PLUGIN_EXPORT void set_input_size(int input_size) {
+	std::lock_guard<std::mutex> lock(default_mutex);
+	default_settings.input_size = input_size > 0 ? input_ladder(&input_size, 1)[0] : 0;
+	yolo_handle_set_input_size(default_handle.get(), input_size);
+}
+
+FFI_PLUGIN_EXPORT int get_input_size() {
+	std::shared_ptr<YoloHandle> handle = get_default_handle();
+	return yolo_handle_get_input_size(handle.get());
+}
+
+FFI_PLUGIN_EXPORT void set_latency_budget(const int* input_sizes, int count, float budget_ms) {
+	std::shared_ptr<YoloHandle> handle;
+	{
+		std::lock_guard<std::mutex> lock(default_mutex);
+		std::vector<int> ladder = input_ladder(input_sizes, count);
+		const bool enabled = budget_ms > 0 && !ladder.empty();
+		default_settings.input_sizes = enabled ? ladder : std::vector<int>();
+		default_settings.latency_budget_ms = enabled ? budget_ms : 0.f;
+		default_settings.input_size = 0;
+		handle = default_handle;
+	}
+	// Measuring the sizes takes a few detections, default_mutex stays free meanwhile.
+	yolo_handle_set_latency_budget(handle.get(), input_sizes, count, budget_ms);
+}
+
+FFI_PLUGIN_EXPORT void close_model() {
+	std::shared_ptr<YoloHandle> previous;
+	{
+		std::lock_guard<std::mutex> lock(default_mutex);
+		previous = default_handle;
+		default_handle = nullptr;
+	}
+}
+
+const char* get_model_input_name() {
+	std::shared_ptr<YoloHandle> handle = get_default_handle();
+	if (!handle) {
+		return nullptr;
+	}
+	std::lock_guard<std::mutex> lock(handle->mutex);
+	return handle->model ? backend_input_name(handle->model) : nullptr;
+}
+}
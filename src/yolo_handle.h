@@ -0,0 +1,61 @@
+#ifndef YOLO_HANDLE_H
+#define YOLO_HANDLE_H
+
+#include <mutex>
+#include <vector>
+#include "detect_settings.h"
+#include "motion_gate.h"
+#include "resolution_controller.h"
+#include "yolo_backend.h"
+#include "yolo_cascade.h"
+#include "yolo_tracker.h"
+
+// Everything one loaded model needs. Handles share no state with each other,
+// so different handles can detect concurrently on different threads. The
+// handle owns its backend scratch, tracker, motion gate, resolution controller
+// and cascade, none of which is thread-safe by itself: they are only touched
+// while `mutex` is held, and keep their buffers across frames so steady-state
+// detection does not allocate.
+struct YoloHandle {
+	BackendModel* model;
+	// What the model was loaded with, after auto-tuning.
+	yolo_options options;
+	ModelInput model_input;
+	YoloLoadStats load_stats;
+	DetectSettings settings;
+	// Serializes calls on this handle.
+	std::mutex mutex;
+	// Also held while `settings` change, so the async pipeline can read them
+	// without waiting for a detection to finish.
+	std::mutex settings_mutex;
+	// Detections of the last frame, kept so their storage is reused by the
+	// next one.
+	std::vector<Detection> detections;
+	// Tracks across the frames passed to the `track` functions, and their
+	// output.
+	Tracker tracker;
+	std::vector<Detection> tracked;
+	// Reference frame of `detections` for the motion gate.
+	MotionGate gate;
+	// Picks `settings.input_size` when a latency budget is set.
+	ResolutionController resolution;
+	// Crop classifier run after the detector.
+	Cascade cascade;
+};
+
+// Flattens detections into the array handed to Dart, released by free_result.
+DetectionResult to_result(const std::vector<Detection>& detections);
+
+// Writes up to `capacity` detections as [x1, y1, x2, y2, class_id, conf] into
+// `out`, best first. Returns the number written.
+int write_detections(const std::vector<Detection>& detections, float* out, int capacity);
+
+// Feeds the time a detection at `input_size` took to the resolution
+// controller, which may pick another input size for the next frames. Called
+// with `handle->mutex` held.
+void adapt_resolution(YoloHandle* handle, int input_size, int64_t elapsed_ns);
+
+// Same as write_detections with the track id as a 7th float.
+int write_tracks(const std::vector<Detection>& detections, float* out, int capacity);
+
+#endif  // YOLO_HANDLE_H
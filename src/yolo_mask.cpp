@@ -0,0 +1,135 @@
+#include "yolo_mask.h"
+#include <algorithm>
+#include <cmath>
+#include "simd.h"
+
+using namespace simd;
+
+// Prototype coordinate of the center of pixel `pixel` of the space boxes are
+// reported in, along one axis.
+static float to_proto(int pixel, float box_scale, int content_offset, float proto_scale) {
+	return ((pixel + 0.5f) / box_scale + content_offset) * proto_scale - 0.5f;
+}
+
+// Sums `count` prototype rows weighted by `coefficients` into `out`, `n` floats each.
+static void combine_row(const float* const* rows, const float* coefficients, int count, int n, float* out) {
+	const int n_vec = n / VW * VW;
+	int i = 0;
+	for (; i < n_vec; i += VW) {
+		vfloat sum = vdup(0.f);
+		for (int k = 0; k < count; ++k) {
+			sum = vadd(sum, vmul(vdup(coefficients[k]), vload(rows[k] + i)));
+		}
+		vstore(out + i, sum);
+	}
+	for (; i < n; ++i) {
+		float sum = 0.f;
+		for (int k = 0; k < count; ++k) {
+			sum += coefficients[k] * rows[k][i];
+		}
+		out[i] = sum;
+	}
+}
+
+void decode_mask(const MaskPrototypes& protos, const float* coefficients, size_t stride, const InputGeometry& geometry, Detection& detection, MaskScratch& scratch) {
+	detection.mask_rect = cv::Rect();
+	detection.mask.clear();
+	if (!protos.data || protos.count <= 0 || protos.width <= 0 || protos.height <= 0) {
+		return;
+	}
+
+	// The box rounded out to whole pixels, inside the frame.
+	const int frame_w = static_cast<int>(std::lround(geometry.content_w * geometry.box_scale_x));
+	const int frame_h = static_cast<int>(std::lround(geometry.content_h * geometry.box_scale_y));
+	const cv::Rect2f& box = detection.box;
+	const int left = std::max(0, static_cast<int>(std::floor(box.x)));
+	const int top = std::max(0, static_cast<int>(std::floor(box.y)));
+	const int right = std::min(frame_w, static_cast<int>(std::ceil(box.x + box.width)));
+	const int bottom = std::min(frame_h, static_cast<int>(std::ceil(box.y + box.height)));
+	if (right <= left || bottom <= top) {
+		return;
+	}
+	const int mask_w = right - left;
+	const int mask_h = bottom - top;
+
+	// Prototype pixels the box samples from, with one more on each side for
+	// the interpolation.
+	const float scale_x = static_cast<float>(protos.width) / geometry.input_w;
+	const float scale_y = static_cast<float>(protos.height) / geometry.input_h;
+	const float first_x = to_proto(left, geometry.box_scale_x, geometry.content_x, scale_x);
+	const float last_x = to_proto(right - 1, geometry.box_scale_x, geometry.content_x, scale_x);
+	const float first_y = to_proto(top, geometry.box_scale_y, geometry.content_y, scale_y);
+	const float last_y = to_proto(bottom - 1, geometry.box_scale_y, geometry.content_y, scale_y);
+	const int roi_x = std::min(std::max(0, static_cast<int>(std::floor(first_x))), protos.width - 1);
+	const int roi_y = std::min(std::max(0, static_cast<int>(std::floor(first_y))), protos.height - 1);
+	const int roi_w = std::min(protos.width - 1, static_cast<int>(std::floor(last_x)) + 1) - roi_x + 1;
+	const int roi_h = std::min(protos.height - 1, static_cast<int>(std::floor(last_y)) + 1) - roi_y + 1;
+	if (roi_w <= 0 || roi_h <= 0) {
+		return;
+	}
+
+	// Coefficients x prototypes over the region only, a few hundred pixels
+	// for a typical box instead of the whole 160x160 plane.
+	scratch.coefficients.resize(protos.count);
+	for (int k = 0; k < protos.count; ++k) {
+		scratch.coefficients[k] = coefficients[k * stride];
+	}
+	std::vector<const float*>& rows = scratch.rows;
+	rows.resize(protos.count);
+	scratch.logits.resize(static_cast<size_t>(roi_w) * roi_h);
+	for (int y = 0; y < roi_h; ++y) {
+		for (int k = 0; k < protos.count; ++k) {
+			rows[k] = protos.data + k * protos.plane_stride + static_cast<size_t>(roi_y + y) * protos.width + roi_x;
+		}
+		combine_row(rows.data(), scratch.coefficients.data(), protos.count, roi_w, scratch.logits.data() + static_cast<size_t>(y) * roi_w);
+	}
+
+	// Horizontal taps per mask column, shared by every row.
+	scratch.columns.resize(mask_w);
+	scratch.weights.resize(mask_w);
+	for (int x = 0; x < mask_w; ++x) {
+		float px = to_proto(left + x, geometry.box_scale_x, geometry.content_x, scale_x) - roi_x;
+		px = std::min(std::max(px, 0.f), static_cast<float>(roi_w - 1));
+		const int x0 = std::min(static_cast<int>(px), std::max(roi_w - 2, 0));
+		scratch.columns[x] = x0;
+		scratch.weights[x] = px - x0;
+	}
+
+	const size_t row_bytes = (mask_w + 7) / 8;
+	detection.mask_rect = cv::Rect(left, top, mask_w, mask_h);
+	detection.mask.assign(row_bytes * mask_h, 0);
+	scratch.row.resize(roi_w + 1);
+	float* row = scratch.row.data();
+	// A one pixel wide region has no right neighbor, repeat the pixel.
+	const int step = roi_w > 1 ? 1 : 0;
+	for (int y = 0; y < mask_h; ++y) {
+		float py = to_proto(top + y, geometry.box_scale_y, geometry.content_y, scale_y) - roi_y;
+		py = std::min(std::max(py, 0.f), static_cast<float>(roi_h - 1));
+		const int y0 = static_cast<int>(py);
+		const int y1 = std::min(y0 + 1, roi_h - 1);
+		const float fy = py - y0;
+
+		// Vertical pass over the region row, then the horizontal taps.
+		const float* upper = scratch.logits.data() + static_cast<size_t>(y0) * roi_w;
+		const float* lower = scratch.logits.data() + static_cast<size_t>(y1) * roi_w;
+		const int n_vec = roi_w / VW * VW;
+		const vfloat v_fy = vdup(fy);
+		int i = 0;
+		for (; i < n_vec; i += VW) {
+			const vfloat a = vload(upper + i);
+			vstore(row + i, vadd(a, vmul(v_fy, vsub(vload(lower + i), a))));
+		}
+		for (; i < roi_w; ++i) {
+			row[i] = upper[i] + fy * (lower[i] - upper[i]);
+		}
+
+		uint8_t* bits = detection.mask.data() + y * row_bytes;
+		for (int x = 0; x < mask_w; ++x) {
+			const int x0 = scratch.columns[x];
+			const float value = row[x0] + scratch.weights[x] * (row[x0 + step] - row[x0]);
+			if (value > 0.f) {
+				bits[x >> 3] |= static_cast<uint8_t>(1u << (x & 7));
+			}
+		}
+	}
+}
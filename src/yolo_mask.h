@@ -0,0 +1,40 @@
+#ifndef YOLO_MASK_H
+#define YOLO_MASK_H
+
+#include <stddef.h>
+#include <vector>
+#include "detection.h"
+#include "preprocess.h"
+
+// Prototype masks of a YOLO-seg model: `count` planes (32 for Ultralytics
+// models) of `width x height` floats at a quarter of the input resolution,
+// `plane_stride` floats apart. A detection's mask is the sum of the planes
+// weighted by its coefficients.
+struct MaskPrototypes {
+	const float* data = nullptr;
+	int count = 0;
+	int width = 0;
+	int height = 0;
+	size_t plane_stride = 0;
+};
+
+// Buffers kept between masks.
+struct MaskScratch {
+	std::vector<float> coefficients;
+	std::vector<const float*> rows;
+	std::vector<float> logits;
+	std::vector<float> row;
+	std::vector<int> columns;
+	std::vector<float> weights;
+};
+
+// Computes the mask of `detection`, whose box is already mapped through
+// `geometry`, into its `mask_rect` and `mask`. `coefficients` holds
+// `protos.count` values, `stride` floats apart.
+//
+// Only the prototype pixels under the box are combined, in SIMD lanes along
+// the rows, and the result is upsampled bilinearly only inside the box. A
+// pixel is set where the interpolated logit is positive, the sigmoid above 0.5.
+void decode_mask(const MaskPrototypes& protos, const float* coefficients, size_t stride, const InputGeometry& geometry, Detection& detection, MaskScratch& scratch);
+
+#endif  // YOLO_MASK_H
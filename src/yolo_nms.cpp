@@ -0,0 +1,91 @@
+#include "yolo_nms.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include "simd.h"
+
+using namespace simd;
+
+void nms_boxes(const Candidates& candidates, float iou_threshold, int top_k, int max_detections, std::vector<int>& keep) {
+	keep.clear();
+	const int count = static_cast<int>(candidates.size());
+	if (count == 0) {
+		return;
+	}
+
+	// Top-k pre-selection, the order of the rest does not matter.
+	thread_local std::vector<int> order;
+	order.resize(count);
+	std::iota(order.begin(), order.end(), 0);
+	const int k = top_k > 0 ? std::min(top_k, count) : count;
+	const std::vector<float>& scores = candidates.scores;
+	// Ties keep decode order so results do not depend on the sort implementation.
+	std::partial_sort(order.begin(), order.begin() + k, order.end(), [&scores](int a, int b) {
+		return scores[a] > scores[b] || (scores[a] == scores[b] && a < b);
+	});
+
+	// Largest coordinate, so that class bands are guaranteed to be disjoint.
+	float max_coordinate = 0.f;
+	for (int i = 0; i < k; ++i) {
+		const int idx = order[i];
+		max_coordinate = std::max(max_coordinate, std::max(std::fabs(candidates.x2[idx]), std::fabs(candidates.y2[idx])));
+		max_coordinate = std::max(max_coordinate, std::max(std::fabs(candidates.x1[idx]), std::fabs(candidates.y1[idx])));
+	}
+	const float band = 2.f * max_coordinate + 1.f;
+
+	// Gather the selected boxes contiguously in score order, shifted by class.
+	thread_local std::vector<float> x1, y1, x2, y2, area, removed;
+	x1.resize(k);
+	y1.resize(k);
+	x2.resize(k);
+	y2.resize(k);
+	area.resize(k);
+	removed.assign(k, 0.f);
+	for (int i = 0; i < k; ++i) {
+		const int idx = order[i];
+		const float offset = candidates.class_ids[idx] * band;
+		x1[i] = candidates.x1[idx] + offset;
+		y1[i] = candidates.y1[idx] + offset;
+		x2[i] = candidates.x2[idx] + offset;
+		y2[i] = candidates.y2[idx] + offset;
+		area[i] = std::max(0.f, candidates.x2[idx] - candidates.x1[idx]) * std::max(0.f, candidates.y2[idx] - candidates.y1[idx]);
+	}
+
+	const vfloat v_zero = vdup(0.f);
+	const vfloat v_one = vdup(1.f);
+	const vfloat v_threshold = vdup(iou_threshold);
+
+	for (int i = 0; i < k; ++i) {
+		if (removed[i] != 0.f) {
+			continue;
+		}
+		keep.push_back(order[i]);
+		if (max_detections > 0 && static_cast<int>(keep.size()) >= max_detections) {
+			break;
+		}
+
+		// IoU > t  <=>  inter > t * (area_i + area_j - inter), no division needed.
+		const vfloat bx1 = vdup(x1[i]);
+		const vfloat by1 = vdup(y1[i]);
+		const vfloat bx2 = vdup(x2[i]);
+		const vfloat by2 = vdup(y2[i]);
+		const vfloat barea = vdup(area[i]);
+		int j = i + 1;
+		for (; j + VW <= k; j += VW) {
+			vfloat w = vmax(vsub(vmin(bx2, vload(&x2[j])), vmax(bx1, vload(&x1[j]))), v_zero);
+			vfloat h = vmax(vsub(vmin(by2, vload(&y2[j])), vmax(by1, vload(&y1[j]))), v_zero);
+			vfloat inter = vmul(w, h);
+			vfloat uni = vsub(vadd(barea, vload(&area[j])), inter);
+			vfloat overlap = vgt(inter, vmul(v_threshold, uni));
+			vstore(&removed[j], vselect(overlap, v_one, vload(&removed[j])));
+		}
+		for (; j < k; ++j) {
+			float w = std::max(std::min(x2[i], x2[j]) - std::max(x1[i], x1[j]), 0.f);
+			float h = std::max(std::min(y2[i], y2[j]) - std::max(y1[i], y1[j]), 0.f);
+			float inter = w * h;
+			if (inter > iou_threshold * (area[i] + area[j] - inter)) {
+				removed[j] = 1.f;
+			}
+		}
+	}
+}
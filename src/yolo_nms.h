@@ -0,0 +1,18 @@
+#ifndef YOLO_NMS_H
+#define YOLO_NMS_H
+
+#include <vector>
+#include "yolo_decode.h"
+
+// Class-aware greedy non-maximum suppression over decoded candidates.
+//
+// Only the `top_k` best scoring candidates are considered, selected with a
+// partial sort. Each class is shifted into its own coordinate band so boxes
+// of different classes never overlap and a single pass suppresses per class.
+// Overlaps are computed in SIMD lanes on float boxes. Suppression stops once
+// `max_detections` boxes are kept (0 keeps all of them).
+//
+// Indices into `candidates` are written to `keep`, best score first.
+void nms_boxes(const Candidates& candidates, float iou_threshold, int top_k, int max_detections, std::vector<int>& keep);
+
+#endif  // YOLO_NMS_H
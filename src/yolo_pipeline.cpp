@@ -0,0 +1,351 @@
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "frame_pool.h"
+#include "postprocess.h"
+#include "print.h"
+#include "spsc_ring.h"
+#include "yolo_ffi.h"
+#include "yolo_handle.h"
+#include "yolo_stats.h"
+
+// One frame travelling through the pipeline. Frames are recycled, so after
+// warmup their buffers no longer allocate.
+struct PipelineFrame {
+	int64_t frame_id;
+	float conf_threshold;
+	float nms_threshold;
+	bool rotate_cw;
+	// Copy of the caller's pixels and a view of it, or a view of a pool slot
+	// the frame holds a reference on until the pixels are read.
+	std::vector<uint8_t> pixels;
+	YoloFramePool* pool;
+	int slot;
+	FrameView view;
+	DetectSettings settings;
+	InputGeometry geometry;
+	std::vector<float> input;
+	std::vector<float> output;
+	int num_channels;
+	int num_anchors;
+	int num_masks;
+	// Set when the backend already produced the detections in one go.
+	bool decoded;
+	std::vector<Detection> detections;
+	// Stamped at submission, so the total includes time spent queued.
+	YoloFrameStats stats;
+};
+
+// Wakes a stage thread when there may be work for it. The queues are lock-free,
+// the mutex is only taken to go to sleep and to wake up.
+class Doorbell {
+public:
+	void ring() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			rung_ = true;
+		}
+		condition_.notify_one();
+	}
+
+	void wait(const std::atomic<bool>& stopping) {
+		std::unique_lock<std::mutex> lock(mutex_);
+		condition_.wait(lock, [&] { return rung_ || stopping.load(); });
+		rung_ = false;
+	}
+
+private:
+	std::mutex mutex_;
+	std::condition_variable condition_;
+	bool rung_ = false;
+};
+
+// Every place a frame can be: being filled by the caller, the mailbox, the
+// three stages and the two queues between them.
+static const int POOL_SIZE = 8;
+
+struct YoloPipeline {
+	YoloHandle* handle;
+	yolo_result_callback callback;
+	void* user_data;
+	bool staged;
+
+	PipelineFrame frames[POOL_SIZE];
+	// Latest submitted frame. Submitting again replaces a frame the
+	// preprocessing stage has not picked up yet.
+	std::atomic<PipelineFrame*> latest{nullptr};
+	// Preprocessing -> inference. A single slot, so the input is at most one
+	// inference behind when it is picked.
+	SpscRing<PipelineFrame*, 1> to_infer;
+	// Inference -> decode/NMS.
+	SpscRing<PipelineFrame*, 2> to_decode;
+	// Decode/NMS -> submitter, frames ready for reuse.
+	SpscRing<PipelineFrame*, POOL_SIZE> free_frames;
+	// Frame replaced in the mailbox, reused by the next submit. Only touched by the submitter.
+	PipelineFrame* spare = nullptr;
+
+	// Decode buffers, only used by the decode thread.
+	PostprocessScratch scratch;
+
+	std::atomic<int64_t> dropped{0};
+	std::atomic<bool> stopping{false};
+	Doorbell preprocess_bell;
+	Doorbell infer_bell;
+	Doorbell decode_bell;
+	std::thread preprocess_thread;
+	std::thread infer_thread;
+	std::thread decode_thread;
+};
+
+// Gives the frame's pool slot back once its pixels are no longer needed.
+static void drop_pixels(PipelineFrame* frame) {
+	if (frame->pool) {
+		frame_pool_release(frame->pool, frame->slot);
+		frame->pool = nullptr;
+	}
+}
+
+static void preprocess_loop(YoloPipeline* pipeline) {
+	while (!pipeline->stopping.load()) {
+		// Only pick a frame once inference can take it, so it is as fresh as possible.
+		PipelineFrame* frame = pipeline->to_infer.full() ? nullptr : pipeline->latest.exchange(nullptr);
+		if (!frame) {
+			pipeline->preprocess_bell.wait(pipeline->stopping);
+			continue;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(pipeline->handle->settings_mutex);
+			frame->settings = pipeline->handle->settings;
+		}
+		// Results carry boxes only, masks would go nowhere.
+		frame->settings.masks = false;
+		frame->decoded = false;
+		if (pipeline->staged) {
+			int image_w = frame->rotate_cw ? frame->view.height : frame->view.width;
+			int image_h = frame->rotate_cw ? frame->view.width : frame->view.height;
+			frame->geometry = backend_input_geometry(pipeline->handle->model, image_w, image_h, frame->settings.resize_mode, frame->settings.input_size);
+			size_t plane_size = static_cast<size_t>(frame->geometry.input_w) * frame->geometry.input_h;
+			frame->input.resize(3 * plane_size);
+			int64_t tic = stats_now_ns();
+			preprocess_frame(frame->view, frame->rotate_cw, frame->geometry, frame->input.data(), plane_size);
+			frame->stats.stage_ns[YOLO_STAGE_PREPROCESS] = stats_now_ns() - tic;
+			drop_pixels(frame);
+		}
+
+		pipeline->to_infer.try_push(frame);
+		pipeline->infer_bell.ring();
+	}
+}
+
+static void infer_loop(YoloPipeline* pipeline) {
+	while (!pipeline->stopping.load()) {
+		PipelineFrame* frame = nullptr;
+		if (pipeline->to_decode.full() || !pipeline->to_infer.try_pop(frame)) {
+			pipeline->infer_bell.wait(pipeline->stopping);
+			continue;
+		}
+		// The slot is free again, the next frame can be preprocessed meanwhile.
+		pipeline->preprocess_bell.ring();
+
+		{
+			std::lock_guard<std::mutex> lock(pipeline->handle->mutex);
+			if (!pipeline->handle->model) {
+				frame->output.clear();
+			} else if (pipeline->staged) {
+				int64_t tic = stats_now_ns();
+				if (!backend_infer(pipeline->handle->model, frame->input.data(), frame->geometry, frame->output, frame->num_channels, frame->num_anchors, frame->num_masks)) {
+					frame->output.clear();
+				}
+				frame->stats.stage_ns[YOLO_STAGE_INFERENCE] = stats_now_ns() - tic;
+				// Pre and postprocessing overlap with inference, so the
+				// latency budget applies to the inference stage here.
+				adapt_resolution(pipeline->handle, frame->settings.input_size, frame->stats.stage_ns[YOLO_STAGE_INFERENCE]);
+			} else {
+				// The backend records the frame itself.
+				backend_detect_frame(pipeline->handle->model, frame->view, frame->rotate_cw, frame->conf_threshold, frame->nms_threshold, frame->settings, frame->detections);
+				frame->decoded = true;
+			}
+		}
+		drop_pixels(frame);
+
+		pipeline->to_decode.try_push(frame);
+		pipeline->decode_bell.ring();
+	}
+}
+
+static void decode_loop(YoloPipeline* pipeline) {
+	while (!pipeline->stopping.load()) {
+		PipelineFrame* frame = nullptr;
+		if (!pipeline->to_decode.try_pop(frame)) {
+			pipeline->decode_bell.wait(pipeline->stopping);
+			continue;
+		}
+		pipeline->infer_bell.ring();
+
+		if (!frame->decoded) {
+			if (frame->output.empty()) {
+				frame->detections.clear();
+			} else {
+				// Only the count, so mask coefficients are not taken for classes.
+				MaskPrototypes protos;
+				protos.count = frame->num_masks;
+				postprocess_output(frame->output.data(), frame->num_channels, frame->num_anchors, frame->geometry, frame->conf_threshold, frame->nms_threshold, frame->settings, pipeline->scratch, frame->detections, &frame->stats, frame->num_masks > 0 ? &protos : nullptr);
+			}
+			frame->stats.stage_ns[YOLO_STAGE_TOTAL] = stats_now_ns() - frame->stats.timestamp_ns;
+			stats_record(frame->stats);
+		}
+		pipeline->callback(frame->frame_id, to_result(frame->detections), pipeline->user_data);
+
+		pipeline->free_frames.try_push(frame);
+	}
+}
+
+// Takes a free frame for the submitter, or nullptr if every frame is in flight.
+static PipelineFrame* acquire_frame(YoloPipeline* pipeline) {
+	PipelineFrame* frame = pipeline->spare;
+	if (frame) {
+		pipeline->spare = nullptr;
+		return frame;
+	}
+	pipeline->free_frames.try_pop(frame);
+	return frame;
+}
+
+// Queues a frame. Without a pool the pixels are copied, otherwise `view`
+// points into `slot`, on which the caller already took a reference for the frame.
+static bool submit_frame(YoloPipeline* pipeline, const FrameView& view, YoloFramePool* pool, int slot, bool rotate_cw, float conf_threshold, float nms_threshold, int64_t frame_id) {
+	PipelineFrame* frame = acquire_frame(pipeline);
+	if (!frame) {
+		if (pool) {
+			frame_pool_release(pool, slot);
+		}
+		pipeline->dropped.fetch_add(1);
+		return false;
+	}
+
+	frame->frame_id = frame_id;
+	frame->conf_threshold = conf_threshold;
+	frame->nms_threshold = nms_threshold;
+	frame->rotate_cw = rotate_cw;
+	frame->stats = YoloFrameStats{};
+	frame->stats.timestamp_ns = stats_now_ns();
+	frame->pool = pool;
+	frame->slot = slot;
+	frame->view = pool ? view : copy_frame(view, frame->pixels);
+
+	// Latest frame wins: a frame still waiting in the mailbox is stale now.
+	PipelineFrame* stale = pipeline->latest.exchange(frame);
+	if (stale) {
+		drop_pixels(stale);
+		pipeline->spare = stale;
+		pipeline->dropped.fetch_add(1);
+	}
+	pipeline->preprocess_bell.ring();
+	return true;
+}
+
+extern "C" {
+FFI_PLUGIN_EXPORT yolo_pipeline_t yolo_pipeline_create(yolo_handle_t handle, yolo_result_callback callback, void* user_data) {
+	if (!handle || !callback) {
+		return nullptr;
+	}
+
+	auto* pipeline = new YoloPipeline;
+	pipeline->handle = handle;
+	pipeline->callback = callback;
+	pipeline->user_data = user_data;
+	{
+		std::lock_guard<std::mutex> lock(handle->mutex);
+		pipeline->staged = handle->model && backend_has_stages(handle->model);
+	}
+	for (PipelineFrame& frame : pipeline->frames) {
+		frame.pool = nullptr;
+		pipeline->free_frames.try_push(&frame);
+	}
+
+	pipeline->preprocess_thread = std::thread(preprocess_loop, pipeline);
+	pipeline->infer_thread = std::thread(infer_loop, pipeline);
+	pipeline->decode_thread = std::thread(decode_loop, pipeline);
+	return pipeline;
+}
+
+FFI_PLUGIN_EXPORT bool yolo_pipeline_submit(yolo_pipeline_t pipeline, uint8_t* image_data, int height, int width, float conf_threshold, float nms_threshold, int64_t frame_id) {
+	if (!pipeline || !image_data) {
+		return false;
+	}
+	return submit_frame(pipeline, make_rgba_view(image_data, width, height), nullptr, -1, false, conf_threshold, nms_threshold, frame_id);
+}
+
+FFI_PLUGIN_EXPORT bool yolo_pipeline_submit_yuv(
+    yolo_pipeline_t pipeline,
+    ImageFormat format,
+    uint8_t* plane0,
+    uint8_t* plane1,
+    uint8_t* plane2,
+    int bytesPerRow0,
+    int bytesPerRow1,
+    int bytesPerRow2,
+    int bytesPerPixel1,
+    int bytesPerPixel2,
+    int width,
+    int height,
+    bool isAndroid,
+    float conf_threshold,
+    float nms_threshold,
+    int64_t frame_id) {
+	if (!pipeline || !plane0) {
+		return false;
+	}
+
+	FrameView frame = make_frame_view(format, plane0, plane1, plane2, bytesPerRow0, bytesPerRow1, bytesPerRow2, bytesPerPixel1, bytesPerPixel2, width, height);
+	// on Android the raw camera data is rotated 90 clockwise, same as convert_image
+	return submit_frame(pipeline, frame, nullptr, -1, isAndroid, conf_threshold, nms_threshold, frame_id);
+}
+
+FFI_PLUGIN_EXPORT bool yolo_pipeline_submit_slot(yolo_pipeline_t pipeline, yolo_frame_pool_t pool, int slot, int height, int width, float conf_threshold, float nms_threshold, int64_t frame_id) {
+	FrameSlot* entry = frame_pool_slot(pool, slot);
+	if (!pipeline || !entry) {
+		return false;
+	}
+
+	// Camera planes keep the layout yolo_frame_pool_write_yuv recorded,
+	// anything else is RGBA written by the caller.
+	FrameView frame = entry->frame;
+	if (frame.width <= 0) {
+		if (static_cast<size_t>(width) * height * 4 > pool->slot_size) {
+			log_message(YOLO_LOG_ERROR, "A %dx%d RGBA frame does not fit into %zu byte frame slots.", width, height, pool->slot_size);
+			return false;
+		}
+		frame = make_rgba_view(entry->data, width, height);
+	}
+	if (!frame_pool_retain(pool, slot)) {
+		return false;
+	}
+	return submit_frame(pipeline, frame, pool, slot, entry->rotate_cw, conf_threshold, nms_threshold, frame_id);
+}
+
+FFI_PLUGIN_EXPORT int64_t yolo_pipeline_dropped(yolo_pipeline_t pipeline) {
+	return pipeline ? pipeline->dropped.load() : 0;
+}
+
+FFI_PLUGIN_EXPORT void yolo_pipeline_destroy(yolo_pipeline_t pipeline) {
+	if (!pipeline) {
+		return;
+	}
+
+	pipeline->stopping.store(true);
+	pipeline->preprocess_bell.ring();
+	pipeline->infer_bell.ring();
+	pipeline->decode_bell.ring();
+	pipeline->preprocess_thread.join();
+	pipeline->infer_thread.join();
+	pipeline->decode_thread.join();
+	for (PipelineFrame& frame : pipeline->frames) {
+		drop_pixels(&frame);
+	}
+	delete pipeline;
+}
+}
@@ -0,0 +1,125 @@
+#include "yolo_stats.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+// Field count of a YoloFrameStats: the timestamp, the stages and both counts.
+static const int RECORD_FIELDS = 1 + YOLO_STAGE_COUNT + 2;
+
+// One ring entry. The sequence is odd while a writer fills the fields, so a
+// reader can tell a complete record from a torn one without taking a lock.
+struct StatsSlot {
+	std::atomic<uint64_t> sequence{0};
+	std::atomic<int64_t> fields[RECORD_FIELDS];
+};
+
+static StatsSlot slots[YOLO_STATS_RECORDS];
+// Frames recorded so far, the next one goes to `slots[next % YOLO_STATS_RECORDS]`.
+static std::atomic<uint64_t> next{0};
+// Records before this index were reset.
+static std::atomic<uint64_t> first{0};
+static std::atomic<int64_t> frames{0};
+static std::atomic<int64_t> sums[YOLO_STAGE_COUNT];
+static std::atomic<int64_t> histogram[YOLO_STAGE_COUNT][YOLO_STATS_BUCKETS];
+
+int64_t stats_now_ns() {
+	using namespace std::chrono;
+	return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Bucket i holds durations below 2^i microseconds.
+static int bucket_of(int64_t ns) {
+	uint64_t us = ns > 0 ? static_cast<uint64_t>(ns) / 1000 : 0;
+	int bucket = 0;
+	while (us && bucket < YOLO_STATS_BUCKETS - 1) {
+		us >>= 1;
+		++bucket;
+	}
+	return bucket;
+}
+
+void stats_record(const YoloFrameStats& record) {
+	int64_t values[RECORD_FIELDS];
+	values[0] = record.timestamp_ns;
+	std::copy(record.stage_ns, record.stage_ns + YOLO_STAGE_COUNT, values + 1);
+	values[1 + YOLO_STAGE_COUNT] = record.candidates;
+	values[2 + YOLO_STAGE_COUNT] = record.detections;
+
+	const uint64_t index = next.fetch_add(1, std::memory_order_relaxed);
+	StatsSlot& slot = slots[index % YOLO_STATS_RECORDS];
+	slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	for (int i = 0; i < RECORD_FIELDS; ++i) {
+		slot.fields[i].store(values[i], std::memory_order_relaxed);
+	}
+	slot.sequence.store(2 * index + 2, std::memory_order_release);
+
+	frames.fetch_add(1, std::memory_order_relaxed);
+	for (int stage = 0; stage < YOLO_STAGE_COUNT; ++stage) {
+		sums[stage].fetch_add(record.stage_ns[stage], std::memory_order_relaxed);
+		histogram[stage][bucket_of(record.stage_ns[stage])].fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+// Copies the record at `index` if it is complete and has not been overwritten.
+static bool read_record(uint64_t index, YoloFrameStats& record) {
+	const StatsSlot& slot = slots[index % YOLO_STATS_RECORDS];
+	const uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+	if (sequence != 2 * index + 2) {
+		return false;
+	}
+	int64_t values[RECORD_FIELDS];
+	for (int i = 0; i < RECORD_FIELDS; ++i) {
+		values[i] = slot.fields[i].load(std::memory_order_relaxed);
+	}
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (slot.sequence.load(std::memory_order_relaxed) != sequence) {
+		return false;
+	}
+
+	record.timestamp_ns = values[0];
+	std::copy(values + 1, values + 1 + YOLO_STAGE_COUNT, record.stage_ns);
+	record.candidates = static_cast<int32_t>(values[1 + YOLO_STAGE_COUNT]);
+	record.detections = static_cast<int32_t>(values[2 + YOLO_STAGE_COUNT]);
+	return true;
+}
+
+extern "C" {
+FFI_PLUGIN_EXPORT int yolo_get_stats(YoloStats* stats, YoloFrameStats* records, int capacity) {
+	if (stats) {
+		stats->frames = frames.load(std::memory_order_relaxed);
+		for (int stage = 0; stage < YOLO_STAGE_COUNT; ++stage) {
+			stats->sum_ns[stage] = sums[stage].load(std::memory_order_relaxed);
+			for (int bucket = 0; bucket < YOLO_STATS_BUCKETS; ++bucket) {
+				stats->histogram[stage][bucket] = histogram[stage][bucket].load(std::memory_order_relaxed);
+			}
+		}
+	}
+	if (!records || capacity <= 0) {
+		return 0;
+	}
+
+	const uint64_t end = next.load(std::memory_order_acquire);
+	uint64_t begin = std::max(first.load(std::memory_order_relaxed), end > YOLO_STATS_RECORDS ? end - YOLO_STATS_RECORDS : 0);
+	begin = std::max(begin, end > static_cast<uint64_t>(capacity) ? end - capacity : 0);
+	int count = 0;
+	for (uint64_t index = begin; index < end; ++index) {
+		// Skips records still being written or already overwritten by a newer frame.
+		if (read_record(index, records[count])) {
+			++count;
+		}
+	}
+	return count;
+}
+
+FFI_PLUGIN_EXPORT void yolo_reset_stats() {
+	first.store(next.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	frames.store(0, std::memory_order_relaxed);
+	for (int stage = 0; stage < YOLO_STAGE_COUNT; ++stage) {
+		sums[stage].store(0, std::memory_order_relaxed);
+		for (int bucket = 0; bucket < YOLO_STATS_BUCKETS; ++bucket) {
+			histogram[stage][bucket].store(0, std::memory_order_relaxed);
+		}
+	}
+}
+}
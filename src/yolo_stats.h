@@ -0,0 +1,14 @@
+#ifndef YOLO_STATS_H
+#define YOLO_STATS_H
+
+#include <stdint.h>
+#include "yolo_ffi.h"
+
+// Monotonic clock in nanoseconds, the time base of every record.
+int64_t stats_now_ns();
+
+// Adds one frame to the ring and the histograms. Lock-free and safe to call
+// from any number of threads.
+void stats_record(const YoloFrameStats& record);
+
+#endif  // YOLO_STATS_H
@@ -0,0 +1,119 @@
+#include "yolo_tiling.h"
+#include <algorithm>
+
+// Tiles whose channels all vary less than this are considered empty.
+static const double MIN_TILE_STDDEV = 2.0;
+// A box absorbs a same-class box covering this much of the smaller of the
+// two, the signature of an object cut by a tile border.
+static const float MERGE_MIN_IOS = 0.5f;
+
+// Evenly spaced starts of `tile` long windows covering `length`, at most
+// `step` apart.
+static void tile_starts(int length, int tile, int step, std::vector<int>& starts) {
+	starts.clear();
+	if (length <= tile) {
+		starts.push_back(0);
+		return;
+	}
+	const int count = (length - tile + step - 1) / step + 1;
+	for (int i = 0; i < count; ++i) {
+		starts.push_back(static_cast<int>(static_cast<int64_t>(i) * (length - tile) / (count - 1)));
+	}
+}
+
+static bool has_content(const cv::Mat& tile) {
+	cv::Scalar mean, stddev;
+	cv::meanStdDev(tile, mean, stddev);
+	return stddev[0] >= MIN_TILE_STDDEV || stddev[1] >= MIN_TILE_STDDEV || stddev[2] >= MIN_TILE_STDDEV;
+}
+
+// Greedy non-maximum merging: best boxes first, each one absorbs the weaker
+// boxes of its class it overlaps by more than `iou_threshold`, or that cover
+// MERGE_MIN_IOS of the smaller box, and grows to their union.
+static void merge_boxes(std::vector<Detection>& boxes, float iou_threshold, int max_detections, std::vector<Detection>& merged) {
+	std::sort(boxes.begin(), boxes.end(), [](const Detection& a, const Detection& b) { return a.confidence > b.confidence; });
+	std::vector<bool> absorbed(boxes.size(), false);
+	merged.clear();
+	for (size_t i = 0; i < boxes.size(); ++i) {
+		if (absorbed[i]) {
+			continue;
+		}
+		Detection detection = boxes[i];
+		for (size_t j = i + 1; j < boxes.size(); ++j) {
+			if (absorbed[j] || boxes[j].class_id != detection.class_id) {
+				continue;
+			}
+			const float inter = (boxes[i].box & boxes[j].box).area();
+			if (inter <= 0) {
+				continue;
+			}
+			const float smaller = std::min(boxes[i].box.area(), boxes[j].box.area());
+			const float uni = boxes[i].box.area() + boxes[j].box.area() - inter;
+			if (inter > iou_threshold * uni || inter >= MERGE_MIN_IOS * smaller) {
+				detection.box |= boxes[j].box;
+				absorbed[j] = true;
+			}
+		}
+		merged.push_back(detection);
+		if (max_detections > 0 && static_cast<int>(merged.size()) >= max_detections) {
+			break;
+		}
+	}
+}
+
+void detect_tiled(BackendModel* model, const cv::Mat& image, float conf_threshold, float nms_threshold, const DetectSettings& settings, std::vector<Detection>& detections) {
+	const int tile = settings.tile_size;
+	if (tile <= 0 || (image.cols <= tile && image.rows <= tile)) {
+		backend_detect(model, image, conf_threshold, nms_threshold, settings, detections);
+		return;
+	}
+
+	const float overlap = std::min(std::max(settings.tile_overlap, 0.f), 0.9f);
+	const int step = std::max(static_cast<int>(tile * (1 - overlap)), 1);
+	std::vector<int> xs, ys;
+	tile_starts(image.cols, tile, step, xs);
+	tile_starts(image.rows, tile, step, ys);
+
+	// Tiles are views into the image, nothing is copied.
+	std::vector<cv::Mat> tiles;
+	std::vector<cv::Point2f> origins;
+	for (int y : ys) {
+		for (int x : xs) {
+			cv::Mat roi = image(cv::Rect(x, y, std::min(tile, image.cols - x), std::min(tile, image.rows - y)));
+			if (has_content(roi)) {
+				tiles.push_back(roi);
+				origins.emplace_back(static_cast<float>(x), static_cast<float>(y));
+			}
+		}
+	}
+	tiles.push_back(image);
+	origins.emplace_back(0.f, 0.f);
+
+	// Letterboxed tiles report boxes in their own pixels, ready to be shifted.
+	DetectSettings tile_settings = settings;
+	tile_settings.resize_mode = RESIZE_LETTERBOX;
+	tile_settings.batch_size = std::max(settings.batch_size, 1);
+	// Merged boxes grow past any one tile's mask.
+	tile_settings.masks = false;
+	std::vector<std::vector<Detection>> results = backend_detect_batch(model, tiles, conf_threshold, nms_threshold, tile_settings);
+
+	std::vector<Detection> boxes;
+	for (size_t i = 0; i < results.size(); ++i) {
+		for (Detection detection : results[i]) {
+			detection.box.x += origins[i].x;
+			detection.box.y += origins[i].y;
+			boxes.push_back(detection);
+		}
+	}
+	merge_boxes(boxes, nms_threshold, settings.max_detections, detections);
+
+	if (settings.resize_mode == RESIZE_STRETCH) {
+		// Untiled stretched detections are in model input space, keep it that way.
+		InputGeometry geometry = backend_input_geometry(model, image.cols, image.rows, RESIZE_STRETCH, settings.input_size);
+		const float sx = geometry.input_w * geometry.box_scale_x / image.cols;
+		const float sy = geometry.input_h * geometry.box_scale_y / image.rows;
+		for (Detection& detection : detections) {
+			detection.box = cv::Rect2f(detection.box.x * sx, detection.box.y * sy, detection.box.width * sx, detection.box.height * sy);
+		}
+	}
+}
@@ -0,0 +1,22 @@
+#ifndef YOLO_TILING_H
+#define YOLO_TILING_H
+
+#include <opencv2/core.hpp>
+#include <vector>
+#include "detect_settings.h"
+#include "detection.h"
+#include "yolo_backend.h"
+
+// Sliced inference for images much larger than the network input, where a
+// single resize would shrink small objects away. The image is cut into
+// overlapping `settings.tile_size` squares that go through the backend as one
+// batch together with a downscaled copy of the whole image, which keeps the
+// objects larger than a tile. Tiles without content (flat color, e.g. the
+// border of a scan) are skipped. Boxes are shifted back to the image and
+// merged across tiles, so an object cut by a tile border comes out as one box.
+//
+// Boxes are reported in the same space as `backend_detect` would for
+// `settings.resize_mode`.
+void detect_tiled(BackendModel* model, const cv::Mat& image, float conf_threshold, float nms_threshold, const DetectSettings& settings, std::vector<Detection>& detections);
+
+#endif  // YOLO_TILING_H
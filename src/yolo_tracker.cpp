@@ -0,0 +1,232 @@
+#include "yolo_tracker.h"
+#include <algorithm>
+#include <cmath>
+
+// Detections at or above this confidence may start tracks, weaker ones only
+// extend existing tracks (the "byte" in ByteTrack).
+static const float HIGH_CONFIDENCE = 0.5f;
+// Minimum overlap to match a confident detection with any track, and a weak
+// detection with a track that was not lost.
+static const float MIN_IOU_HIGH = 0.2f;
+static const float MIN_IOU_LOW = 0.5f;
+// Lost tracks are dropped after this many frames.
+static const int MAX_LOST_FRAMES = 30;
+// A track's confidence is multiplied by this for every frame it is only predicted.
+static const float CONFIDENCE_DECAY = 0.9f;
+// Process and measurement noise relative to the box height, as in ByteTrack.
+static const float POSITION_NOISE = 1.f / 20;
+static const float VELOCITY_NOISE = 1.f / 160;
+
+static void box_to_state(const cv::Rect2f& box, float state[4]) {
+	state[0] = box.x + box.width / 2;
+	state[1] = box.y + box.height / 2;
+	state[2] = box.width;
+	state[3] = box.height;
+}
+
+static cv::Rect2f state_to_box(const KalmanAxis axes[4]) {
+	const float w = std::max(axes[2].position, 0.f);
+	const float h = std::max(axes[3].position, 0.f);
+	return cv::Rect2f(axes[0].position - w / 2, axes[1].position - h / 2, w, h);
+}
+
+static void kalman_init(KalmanAxis& axis, float position, float scale) {
+	const float position_std = 2 * POSITION_NOISE * scale;
+	const float velocity_std = 10 * VELOCITY_NOISE * scale;
+	axis.position = position;
+	axis.velocity = 0;
+	axis.p00 = position_std * position_std;
+	axis.p01 = 0;
+	axis.p11 = velocity_std * velocity_std;
+}
+
+static void kalman_predict(KalmanAxis& axis, float scale) {
+	const float q_position = POSITION_NOISE * scale * POSITION_NOISE * scale;
+	const float q_velocity = VELOCITY_NOISE * scale * VELOCITY_NOISE * scale;
+	axis.position += axis.velocity;
+	axis.p00 += 2 * axis.p01 + axis.p11 + q_position;
+	axis.p01 += axis.p11;
+	axis.p11 += q_velocity;
+}
+
+static void kalman_update(KalmanAxis& axis, float measurement, float scale) {
+	const float r = POSITION_NOISE * scale * POSITION_NOISE * scale;
+	const float s = axis.p00 + r;
+	const float k0 = axis.p00 / s;
+	const float k1 = axis.p01 / s;
+	const float innovation = measurement - axis.position;
+	axis.position += k0 * innovation;
+	axis.velocity += k1 * innovation;
+	axis.p11 -= k1 * axis.p01;
+	axis.p00 *= 1 - k0;
+	axis.p01 *= 1 - k0;
+}
+
+static float box_iou(const cv::Rect2f& a, const cv::Rect2f& b) {
+	const float inter = (a & b).area();
+	const float uni = a.area() + b.area() - inter;
+	return uni > 0 ? inter / uni : 0.f;
+}
+
+// Noise scale of a track, its height.
+static float track_scale(const Track& track) {
+	return std::max(track.axes[3].position, 1.f);
+}
+
+static float track_confidence(const Track& track, int frames_ahead) {
+	return track.confidence * std::pow(CONFIDENCE_DECAY, static_cast<float>(track.frames_since_update + frames_ahead));
+}
+
+static void update_track(Track& track, const Detection& detection) {
+	float state[4];
+	box_to_state(detection.box, state);
+	const float scale = std::max(detection.box.height, 1.f);
+	for (int i = 0; i < 4; ++i) {
+		kalman_update(track.axes[i], state[i], scale);
+	}
+	track.box = detection.box;
+	track.confidence = detection.confidence;
+	track.frames_since_update = 0;
+	track.lost = false;
+}
+
+bool Tracker::needs_detection(int detect_interval, float min_confidence) const {
+	if (!detected_ || frames_since_detection_ + 1 >= detect_interval) {
+		return true;
+	}
+
+	// Empty scenes wait for the interval, there is nothing to lose track of.
+	float sum = 0;
+	int live = 0;
+	for (const Track& track : tracks_) {
+		if (!track.lost) {
+			sum += track_confidence(track, 1);
+			++live;
+		}
+	}
+	return live > 0 && sum / live < min_confidence;
+}
+
+void Tracker::predict_tracks() {
+	for (Track& track : tracks_) {
+		const float scale = track_scale(track);
+		for (KalmanAxis& axis : track.axes) {
+			kalman_predict(axis, scale);
+		}
+		++track.frames_since_update;
+	}
+}
+
+void Tracker::match(const std::vector<Detection>& detections, std::vector<int>& track_indices, std::vector<int>& detection_indices, float min_iou) {
+	pairs_.clear();
+	for (size_t t = 0; t < track_indices.size(); ++t) {
+		const Track& track = tracks_[track_indices[t]];
+		const cv::Rect2f predicted = state_to_box(track.axes);
+		for (size_t d = 0; d < detection_indices.size(); ++d) {
+			const Detection& detection = detections[detection_indices[d]];
+			if (detection.class_id != track.class_id) {
+				continue;
+			}
+			const float iou = box_iou(predicted, detection.box);
+			if (iou >= min_iou) {
+				pairs_.push_back({iou, {static_cast<int>(t), static_cast<int>(d)}});
+			}
+		}
+	}
+
+	// Best overlaps first; matched entries are marked -1.
+	std::sort(pairs_.begin(), pairs_.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+	for (const auto& pair : pairs_) {
+		int& track_index = track_indices[pair.second.first];
+		int& detection_index = detection_indices[pair.second.second];
+		if (track_index < 0 || detection_index < 0) {
+			continue;
+		}
+		update_track(tracks_[track_index], detections[detection_index]);
+		track_index = -1;
+		detection_index = -1;
+	}
+	track_indices.erase(std::remove(track_indices.begin(), track_indices.end(), -1), track_indices.end());
+	detection_indices.erase(std::remove(detection_indices.begin(), detection_indices.end(), -1), detection_indices.end());
+}
+
+void Tracker::update(const std::vector<Detection>& detections, std::vector<Detection>& tracked) {
+	predict_tracks();
+
+	high_indices_.clear();
+	low_indices_.clear();
+	for (size_t i = 0; i < detections.size(); ++i) {
+		(detections[i].confidence >= HIGH_CONFIDENCE ? high_indices_ : low_indices_).push_back(static_cast<int>(i));
+	}
+
+	// Confident detections against every track, lost ones included.
+	track_indices_.clear();
+	for (size_t i = 0; i < tracks_.size(); ++i) {
+		track_indices_.push_back(static_cast<int>(i));
+	}
+	match(detections, track_indices_, high_indices_, MIN_IOU_HIGH);
+
+	// Weak detections keep tracks alive through occlusion and motion blur,
+	// but never revive lost tracks nor start new ones.
+	track_indices_.erase(std::remove_if(track_indices_.begin(), track_indices_.end(), [&](int i) { return tracks_[i].lost; }), track_indices_.end());
+	match(detections, track_indices_, low_indices_, MIN_IOU_LOW);
+	for (Track& track : tracks_) {
+		track.lost = track.frames_since_update > 0;
+	}
+	tracks_.erase(std::remove_if(tracks_.begin(), tracks_.end(), [](const Track& track) { return track.frames_since_update > MAX_LOST_FRAMES; }), tracks_.end());
+
+	for (int i : high_indices_) {
+		const Detection& detection = detections[i];
+		Track track;
+		track.id = next_id_++;
+		track.class_id = detection.class_id;
+		float state[4];
+		box_to_state(detection.box, state);
+		const float scale = std::max(detection.box.height, 1.f);
+		for (int axis = 0; axis < 4; ++axis) {
+			kalman_init(track.axes[axis], state[axis], scale);
+		}
+		track.box = detection.box;
+		track.confidence = detection.confidence;
+		track.frames_since_update = 0;
+		track.lost = false;
+		tracks_.push_back(track);
+	}
+
+	frames_since_detection_ = 0;
+	detected_ = true;
+	write_tracks(tracked);
+}
+
+void Tracker::predict(std::vector<Detection>& tracked) {
+	predict_tracks();
+	for (Track& track : tracks_) {
+		track.box = state_to_box(track.axes);
+	}
+	++frames_since_detection_;
+	write_tracks(tracked);
+}
+
+void Tracker::write_tracks(std::vector<Detection>& tracked) const {
+	tracked.clear();
+	for (const Track& track : tracks_) {
+		if (track.lost) {
+			continue;
+		}
+		Detection detection;
+		detection.box = track.box;
+		detection.class_id = track.class_id;
+		detection.confidence = track_confidence(track, 0);
+		detection.track_id = track.id;
+		tracked.push_back(detection);
+	}
+	// Best first, like detector output, so truncated results keep the surest tracks.
+	std::sort(tracked.begin(), tracked.end(), [](const Detection& a, const Detection& b) { return a.confidence > b.confidence; });
+}
+
+void Tracker::reset() {
+	tracks_.clear();
+	next_id_ = 0;
+	frames_since_detection_ = 0;
+	detected_ = false;
+}
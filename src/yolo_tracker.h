@@ -0,0 +1,75 @@
+#ifndef YOLO_TRACKER_H
+#define YOLO_TRACKER_H
+
+#include <vector>
+#include "detection.h"
+
+// Constant-velocity Kalman filter on one box coordinate. The box state is
+// [cx, cy, w, h] and their velocities; with the block-diagonal noise used here
+// every coordinate filters independently, so four 2x2 filters give the same
+// result as one 8x8 filter.
+struct KalmanAxis {
+	float position;
+	float velocity;
+	// Covariance [[p00, p01], [p01, p11]].
+	float p00;
+	float p01;
+	float p11;
+};
+
+struct Track {
+	int id;
+	int class_id;
+	// Confidence of the last matched detection.
+	float confidence;
+	KalmanAxis axes[4];
+	// The matched detection's box on detector frames, the prediction in between.
+	cv::Rect2f box;
+	// Frames since a detection last matched the track.
+	int frames_since_update;
+	// Missed by the last detector frame. Lost tracks are not reported but can
+	// still be picked up again by a confident detection.
+	bool lost;
+};
+
+// ByteTrack-style multi-object tracker. Detection frames associate the
+// detections with the Kalman predictions by IoU, confident detections first,
+// then the weak ones, which only extend existing tracks. Frames in between
+// only advance the predictions.
+class Tracker {
+public:
+	// Whether the detector should run on the next frame: every
+	// `detect_interval` frames, and sooner once the tracks' mean confidence
+	// falls below `min_confidence`.
+	bool needs_detection(int detect_interval, float min_confidence) const;
+
+	// Associates a detector frame and writes the live tracks to `tracked`.
+	void update(const std::vector<Detection>& detections, std::vector<Detection>& tracked);
+
+	// Advances the tracks by one frame without detections and writes the
+	// predicted boxes to `tracked`.
+	void predict(std::vector<Detection>& tracked);
+
+	// Forgets every track, ids start over.
+	void reset();
+
+private:
+	void predict_tracks();
+	// Greedy IoU matching of `tracks_[track_indices]` with
+	// `detections[detection_indices]`; matched entries are removed from both
+	// index lists and their tracks updated.
+	void match(const std::vector<Detection>& detections, std::vector<int>& track_indices, std::vector<int>& detection_indices, float min_iou);
+	void write_tracks(std::vector<Detection>& tracked) const;
+
+	std::vector<Track> tracks_;
+	int next_id_ = 0;
+	int frames_since_detection_ = 0;
+	bool detected_ = false;
+	// Reused across frames.
+	std::vector<int> track_indices_;
+	std::vector<int> high_indices_;
+	std::vector<int> low_indices_;
+	std::vector<std::pair<float, std::pair<int, int>>> pairs_;
+};
+
+#endif  // YOLO_TRACKER_H
@@ -0,0 +1,113 @@
+#include "yolo_tune.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+#include "print.h"
+
+// Synthetic RGBA frame at the default network input size.
+static const int TUNE_SIZE = 640;
+static const int TUNE_WARMUP = 2;
+static const int TUNE_FRAMES = 8;
+
+struct Tuner {
+	const ModelSource* source;
+	cv::Mat frame;
+	BackendModel* best_model = nullptr;
+	yolo_options best;
+	double best_ms = 0;
+	std::vector<Detection> detections;
+};
+
+// Median latency of one detection in milliseconds, after a warmup.
+static double time_detect(Tuner& tuner, BackendModel* model) {
+	using namespace std::chrono;
+	DetectSettings settings;
+	for (int i = 0; i < TUNE_WARMUP; ++i) {
+		backend_detect(model, tuner.frame, 0.25f, 0.45f, settings, tuner.detections);
+	}
+
+	std::vector<double> times(TUNE_FRAMES);
+	for (double& time : times) {
+		auto tic = steady_clock::now();
+		backend_detect(model, tuner.frame, 0.25f, 0.45f, settings, tuner.detections);
+		time = duration<double, std::milli>(steady_clock::now() - tic).count();
+	}
+	std::nth_element(times.begin(), times.begin() + TUNE_FRAMES / 2, times.end());
+	return times[TUNE_FRAMES / 2];
+}
+
+// Loads the model with `candidate` and keeps it if it beats the best so far.
+static void try_options(Tuner& tuner, const yolo_options& candidate) {
+	BackendModel* model = backend_open(*tuner.source, candidate);
+	if (!model) {
+		return;
+	}
+	double ms = time_detect(tuner, model);
+
+	log_message(YOLO_LOG_DEBUG, "Auto-tune: threads %d, affinity %d, spin %d, winograd %d, sgemm %d, fp16 %d, bf16 %d: %.2f ms", candidate.num_threads, candidate.cpu_affinity, candidate.spin_wait, candidate.use_winograd, candidate.use_sgemm, candidate.use_fp16, candidate.use_bf16, ms);
+
+	if (!tuner.best_model || ms < tuner.best_ms) {
+		backend_close(tuner.best_model);
+		tuner.best_model = model;
+		tuner.best = candidate;
+		tuner.best_ms = ms;
+	} else {
+		backend_close(model);
+	}
+}
+
+BackendModel* tune_backend(const ModelSource& source, yolo_options& options) {
+	Tuner tuner;
+	tuner.source = &source;
+	// Noise keeps every anchor busy, closer to a real scene than a blank frame.
+	tuner.frame.create(TUNE_SIZE, TUNE_SIZE, CV_8UC4);
+	std::mt19937 rng(42);
+	for (size_t i = 0; i < tuner.frame.total() * 4; ++i) {
+		tuner.frame.data[i] = static_cast<uint8_t>(rng());
+	}
+
+	yolo_options base = options;
+	base.auto_tune = false;
+	try_options(tuner, base);
+	if (!tuner.best_model) {
+		return nullptr;
+	}
+	if (!backend_has_options(tuner.best_model)) {
+		options = tuner.best;
+		return tuner.best_model;
+	}
+
+	// One knob at a time, each starting from the best so far. A full grid
+	// would mean dozens of model loads.
+	const int cores = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+	std::vector<int> thread_counts = {base.num_threads};
+	for (int threads : {1, 2, 4, cores}) {
+		if (threads > cores || std::find(thread_counts.begin(), thread_counts.end(), threads) != thread_counts.end()) {
+			continue;
+		}
+		thread_counts.push_back(threads);
+		yolo_options candidate = tuner.best;
+		candidate.num_threads = threads;
+		try_options(tuner, candidate);
+	}
+
+	// An explicit core mask is the caller's decision, leave it alone.
+	if (base.cpu_affinity != CPU_AFFINITY_MASK) {
+		yolo_options candidate = tuner.best;
+		candidate.cpu_affinity = base.cpu_affinity == CPU_AFFINITY_BIG ? CPU_AFFINITY_ALL : CPU_AFFINITY_BIG;
+		try_options(tuner, candidate);
+	}
+
+	for (bool yolo_options::*flag : {&yolo_options::spin_wait, &yolo_options::use_winograd, &yolo_options::use_sgemm, &yolo_options::use_fp16, &yolo_options::use_bf16}) {
+		yolo_options candidate = tuner.best;
+		candidate.*flag = !(candidate.*flag);
+		try_options(tuner, candidate);
+	}
+
+	log_message(YOLO_LOG_INFO, "Auto-tune picked %.2f ms per frame", tuner.best_ms);
+	options = tuner.best;
+	return tuner.best_model;
+}
@@ -0,0 +1,13 @@
+#ifndef YOLO_TUNE_H
+#define YOLO_TUNE_H
+
+#include "yolo_backend.h"
+#include "yolo_ffi.h"
+
+// Loads `source` with candidate variations of `options` and times each on
+// synthetic frames. Returns the model loaded with the fastest candidate and
+// writes that candidate back to `options`, or returns nullptr if the model
+// cannot be loaded.
+BackendModel* tune_backend(const ModelSource& source, yolo_options& options);
+
+#endif  // YOLO_TUNE_H